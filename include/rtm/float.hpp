@@ -100,4 +100,64 @@ inline float sin(float input)
 	#endif
 }
 
+//half precision conversion. f32_to_f16 rounds toward +inf if round_up is set otherwise toward -inf so converted bounds stay conservative
+inline uint16_t f32_to_f16(float f, bool round_up)
+{
+	uint32_t bits = *(uint32_t*)&f;
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	uint32_t abs_bits = bits & 0x7fffffffu;
+	if(abs_bits >= 0x7f800000u) return sign | 0x7c00u | (abs_bits > 0x7f800000u ? 0x200u : 0x0u); //inf or nan
+
+	//truncate the magnitude
+	uint32_t h;
+	bool inexact;
+	int exp = (int)(abs_bits >> 23) - 127 + 15;
+	if(exp >= 0x1f)
+	{
+		h = 0x7bffu;
+		inexact = true;
+	}
+	else if(exp > 0)
+	{
+		h = ((uint32_t)exp << 10) | ((abs_bits >> 13) & 0x3ffu);
+		inexact = abs_bits & 0x1fffu;
+	}
+	else if(exp >= -10)
+	{
+		uint32_t man = (abs_bits & 0x7fffffu) | 0x800000u;
+		uint32_t shift = 14 - exp;
+		h = man >> shift;
+		inexact = man & ((1u << shift) - 1);
+	}
+	else
+	{
+		h = 0x0u;
+		inexact = abs_bits != 0;
+	}
+
+	//step away from zero if that is the rounding direction. Carries into the exponent and up to inf
+	if(inexact && (sign ? !round_up : round_up)) h++;
+	return (uint16_t)(sign | h);
+}
+
+inline float f16_to_f32(uint16_t h)
+{
+	uint32_t sign = ((uint32_t)h & 0x8000u) << 16;
+	uint32_t exp = (h >> 10) & 0x1fu;
+	uint32_t man = h & 0x3ffu;
+
+	uint32_t bits;
+	if(exp == 0x1f) bits = sign | 0x7f800000u | (man << 13);
+	else if(exp > 0) bits = sign | ((exp + 112) << 23) | (man << 13);
+	else if(man == 0) bits = sign;
+	else
+	{
+		//subnormal
+		exp = 113;
+		while(!(man & 0x400u)) man <<= 1, exp--;
+		bits = sign | (exp << 23) | ((man & 0x3ffu) << 13);
+	}
+	return *(float*)&bits;
+}
+
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "ray.hpp"
 #include "aabb.hpp"
+#include "quantized-aabb.hpp"
 #include "triangle.hpp"
 #include "vec2.hpp"
 
@@ -23,6 +24,12 @@ inline float intersect(const rtm::AABB& aabb, const rtm::Ray& ray, const rtm::ve
 	return tmin;
 }
 
+//dequantize then test. The RT core models the decode as extra box pipline latency
+inline float intersect(const rtm::QuantizedAABB& qaabb, const rtm::QuantizationFrame& frame, const rtm::Ray& ray, const rtm::vec3& inv_d)
+{
+	return intersect(frame.dequantize(qaabb), ray, inv_d);
+}
+
 inline bool intersect(const rtm::Triangle& tri, const rtm::Ray& ray, rtm::Hit& hit)
 {
 #if 0
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "int.hpp"
+#include "float.hpp"
+#include "vec3.hpp"
+#include "aabb.hpp"
+
+#include <cstring>
+
+#ifndef __riscv
+#include <cmath>
+#include <type_traits>
+#endif
+
+namespace rtm
+{
+
+//8 bit child box in the frame of its parent (Ylitie et al. 2017)
+struct QuantizedAABB
+{
+	uint8_t min[3];
+	uint8_t max[3];
+};
+
+//Parent frame shared by the quantized boxes of its children. A child bound decodes to origin + q * 2^exp per axis. Each axis is
+//one word, the origin float with its low 8 mantissa bits replaced by the signed exponent, so a frame is 12 bytes. The origin is
+//rounded toward -inf and bounds are rounded outward when quantizing so decoded boxes always contain the original ones. Kept
+//trivially copyable so the simulator can memcpy it out of register words.
+struct QuantizationFrame
+{
+	uint32_t words[3];
+
+	float origin(uint i) const
+	{
+		uint32_t bits = words[i] & ~0xffu;
+		float o;
+		std::memcpy(&o, &bits, sizeof(float));
+		return o;
+	}
+
+	int exp(uint i) const { return (int8_t)(words[i] & 0xffu); }
+
+	float scale(uint i) const
+	{
+		uint32_t bits = (uint32_t)(exp(i) + 127) << 23;
+		float s;
+		std::memcpy(&s, &bits, sizeof(float));
+		return s;
+	}
+
+	AABB dequantize(const QuantizedAABB& qaabb) const
+	{
+		AABB aabb;
+		for(uint i = 0; i < 3; ++i)
+		{
+			float o = origin(i);
+			float s = scale(i);
+			aabb.min[i] = o + qaabb.min[i] * s;
+			aabb.max[i] = o + qaabb.max[i] * s;
+		}
+		return aabb;
+	}
+
+#ifndef __riscv
+	static QuantizationFrame from_aabb(const AABB& aabb)
+	{
+		QuantizationFrame frame;
+		for(uint i = 0; i < 3; ++i)
+		{
+			//drop the low mantissa bits rounding toward -inf. A larger magnitude is the next smaller negative value
+			float min = aabb.min[i];
+			uint32_t bits;
+			std::memcpy(&bits, &min, sizeof(float));
+			if(bits & 0xffu)
+			{
+				bits &= ~0xffu;
+				if(bits & 0x80000000u) bits += 0x100u;
+			}
+			frame.words[i] = bits;
+
+			float extent = aabb.max[i] - frame.origin(i);
+			int e = extent > 0.0f ? (int)std::ceil(std::log2(extent / 255.0f)) : -126;
+			e = std::min(std::max(e, -126), 127);
+
+			//the top code has to reach the parent bound after rounding
+			frame.words[i] = bits | (uint8_t)e;
+			while(e < 127 && frame.origin(i) + 255 * frame.scale(i) < aabb.max[i]) frame.words[i] = bits | (uint8_t)++e;
+		}
+		return frame;
+	}
+
+	QuantizedAABB quantize(const AABB& aabb) const
+	{
+		QuantizedAABB qaabb;
+		for(uint i = 0; i < 3; ++i)
+		{
+			float o = origin(i);
+			float s = scale(i);
+			int lo = (int)std::floor((aabb.min[i] - o) / s);
+			int hi = (int)std::ceil((aabb.max[i] - o) / s);
+			lo = std::min(std::max(lo, 0), 255);
+			hi = std::min(std::max(hi, 0), 255);
+
+			//correct for rounding in the subtraction so the decoded box is conservative
+			while(lo > 0 && o + lo * s > aabb.min[i]) lo--;
+			while(hi < 255 && o + hi * s < aabb.max[i]) hi++;
+
+			qaabb.min[i] = (uint8_t)lo;
+			qaabb.max[i] = (uint8_t)hi;
+		}
+		return qaabb;
+	}
+#endif
+};
+
+#ifndef __riscv
+static_assert(std::is_trivially_copyable<QuantizationFrame>::value, "QuantizationFrame is memcpy'd out of register words");
+static_assert(sizeof(QuantizationFrame) == 12, "QuantizationFrame must fit in three words");
+#endif
+
+}
@@ -21,5 +21,7 @@
 #include "mesh.hpp"
 #include "bvh.hpp"
 #include "packed-bvh.hpp"
+#include "quantized-aabb.hpp"
+#include "wide-bvh.hpp"
 
 #include "intersect.hpp"
\ No newline at end of file
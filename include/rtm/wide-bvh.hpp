@@ -0,0 +1,170 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "float.hpp"
+#include "quantized-aabb.hpp"
+
+#ifndef __riscv
+#include <vector>
+#endif
+
+namespace rtm
+{
+
+//N wide BVH collapsed from a binary BVH. Each node holds the boxes of its N children in half precision, rounded outward, so
+//a BVH4 node is exactly one 64 byte cache line and a BVH8 node is two. Interior children point to one node, leaf children
+//keep the triangle range of the source BVH so the triangle order is unchanged. The same tree is also encoded with 8 bit child
+//boxes in the frame of their parent, 32, 64 and 96 bytes for N = 2, 4 and 8.
+template <uint N>
+class WideBVH
+{
+public:
+	struct alignas(16 * N) Node
+	{
+		uint16_t        bounds[N][6]; //min xyz, max xyz
+		BVH::Node::Data data[N];      //unused slots are all ones
+
+		bool is_valid(uint i) const { return *(const uint32_t*)&data[i] != ~0u; }
+
+		AABB aabb(uint i) const
+		{
+			AABB aabb;
+			for(uint j = 0; j < 3; ++j)
+			{
+				aabb.min[j] = f16_to_f32(bounds[i][j]);
+				aabb.max[j] = f16_to_f32(bounds[i][j + 3]);
+			}
+			return aabb;
+		}
+	};
+
+	static_assert(sizeof(Node) == 16 * N, "wide nodes must pack into cache lines");
+
+	struct alignas(16) QuantizedNode
+	{
+		QuantizationFrame frame;
+		QuantizedAABB     boxes[N];
+		BVH::Node::Data   data[N]; //unused slots are all ones
+
+		bool is_valid(uint i) const { return *(const uint32_t*)&data[i] != ~0u; }
+		AABB aabb(uint i) const { return frame.dequantize(boxes[i]); }
+	};
+
+#ifndef __riscv
+	std::vector<Node> nodes;
+	std::vector<QuantizedNode> quantized_nodes;
+
+	WideBVH(const BVH& bvh)
+	{
+		struct NodeSet
+		{
+			uint32_t bvh_index;
+			uint32_t index;
+		};
+
+		std::vector<NodeSet> stack;
+		nodes.clear();
+		nodes.emplace_back();
+
+		//a leaf root still needs a node to hold its box
+		if(bvh.nodes[0].data.is_leaf)
+		{
+			_encode(0, &bvh.nodes[0].aabb, &bvh.nodes[0].data, 1);
+			return;
+		}
+
+		stack.push_back({0, 0});
+		while(!stack.empty())
+		{
+			NodeSet current_set = stack.back();
+			stack.pop_back();
+
+			//pull up the largest interior child until the node is full
+			std::vector<uint32_t> children;
+			const BVH::Node& bvh_node = bvh.nodes[current_set.bvh_index];
+			for(uint i = 0; i <= bvh_node.data.lst_chld_ofst; ++i)
+				children.push_back(bvh_node.data.fst_chld_ind + i);
+
+			while(true)
+			{
+				uint best = ~0u;
+				float best_sa = -1.0f;
+				for(uint i = 0; i < children.size(); ++i)
+				{
+					const BVH::Node& child = bvh.nodes[children[i]];
+					if(child.data.is_leaf || children.size() + child.data.lst_chld_ofst > N) continue;
+
+					float sa = child.aabb.surface_area();
+					if(sa > best_sa)
+					{
+						best = i;
+						best_sa = sa;
+					}
+				}
+				if(best == ~0u) break;
+
+				BVH::Node::Data data = bvh.nodes[children[best]].data;
+				children.erase(children.begin() + best);
+				for(uint i = 0; i <= data.lst_chld_ofst; ++i)
+					children.push_back(data.fst_chld_ind + i);
+			}
+
+			//pulling up children never overfills a node, but the source may already have more than N children per node
+			assert(children.size() <= N);
+
+			AABB aabbs[N];
+			BVH::Node::Data datas[N];
+			for(uint i = 0; i < children.size(); ++i)
+			{
+				aabbs[i] = bvh.nodes[children[i]].aabb;
+				datas[i] = bvh.nodes[children[i]].data;
+				if(!datas[i].is_leaf)
+				{
+					datas[i].lst_chld_ofst = 0;
+					datas[i].fst_chld_ind = nodes.size();
+					stack.push_back({children[i], (uint32_t)nodes.size()});
+					nodes.emplace_back();
+				}
+			}
+			_encode(current_set.index, aabbs, datas, children.size());
+		}
+	}
+
+private:
+	void _encode(uint index, const AABB* aabbs, const BVH::Node::Data* datas, uint num_children)
+	{
+		if(quantized_nodes.size() < nodes.size()) quantized_nodes.resize(nodes.size());
+		Node& node = nodes[index];
+		QuantizedNode& qnode = quantized_nodes[index];
+
+		AABB parent_aabb;
+		for(uint i = 0; i < num_children; ++i)
+			parent_aabb.add(aabbs[i]);
+		qnode.frame = QuantizationFrame::from_aabb(parent_aabb);
+
+		for(uint i = 0; i < N; ++i)
+		{
+			if(i < num_children)
+			{
+				for(uint j = 0; j < 3; ++j)
+				{
+					node.bounds[i][j] = f32_to_f16(aabbs[i].min[j], false);
+					node.bounds[i][j + 3] = f32_to_f16(aabbs[i].max[j], true);
+				}
+				qnode.boxes[i] = qnode.frame.quantize(aabbs[i]);
+				node.data[i] = qnode.data[i] = datas[i];
+			}
+			else
+			{
+				for(uint j = 0; j < 6; ++j)
+					node.bounds[i][j] = 0x0;
+				qnode.boxes[i] = {{0, 0, 0}, {0, 0, 0}};
+				*(uint32_t*)&node.data[i] = ~0u;
+				*(uint32_t*)&qnode.data[i] = ~0u;
+			}
+		}
+	}
+#endif
+};
+
+}
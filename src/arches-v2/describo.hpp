@@ -431,7 +431,7 @@ static void run_sim_describo(int argc, char* argv[])
 	auto stop = std::chrono::high_resolution_clock::now();
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 
-	Units::UnitTP::Log tp_log(0x10000);
+	Units::UnitTP::Log tp_log;
 	for(auto& tp : tps)
 		tp_log.accumulate(tp->log);
 	
@@ -3,6 +3,7 @@
 #include "simulator/simulator.hpp"
 
 #include "units/unit-dram.hpp"
+#include "units/unit-analytical-dram.hpp"
 #include "units/unit-blocking-cache.hpp"
 #include "units/unit-non-blocking-cache.hpp"
 #include "units/unit-buffer.hpp"
@@ -10,6 +11,8 @@
 #include "units/unit-tile-scheduler.hpp"
 #include "units/unit-sfu.hpp"
 #include "units/unit-tp.hpp"
+#include "units/unit-simt-tp.hpp"
+#include "units/unit-replay-tp.hpp"
 
 #include "units/dual-streaming/unit-stream-scheduler-dfs.hpp"
 //#include "units/dual-streaming/unit-stream-scheduler.hpp"
@@ -103,6 +106,31 @@ const static InstructionInfo isa_custom0_000_imm[8] =
 		fr[16].f32 = hit.bc[0];
 		fr[17].f32 = hit.bc[1];
 	}),
+	InstructionInfo(0x3, "qboxisect", InstrType::CUSTOM1, Encoding::U, RegType::FLOAT, EXEC_DECL
+	{
+		Register32 * fr = unit->float_regs->registers;
+
+		rtm::vec3 inv_d;
+
+		rtm::Ray ray;
+		ray.o.x = fr[0].f32;
+		ray.o.y = fr[1].f32;
+		ray.o.z = fr[2].f32;
+		inv_d.x = fr[3].f32;
+		inv_d.y = fr[4].f32;
+		inv_d.z = fr[5].f32;
+
+		//f6-f8 hold the parent frame as it is laid out in memory and f9-f10 the 6 bytes of the child box
+		uint32_t frame_words[3] = {fr[6].u32, fr[7].u32, fr[8].u32};
+		uint32_t box_words[2] = {fr[9].u32, fr[10].u32};
+
+		rtm::QuantizationFrame frame;
+		rtm::QuantizedAABB qaabb;
+		std::memcpy(&frame, frame_words, sizeof(rtm::QuantizationFrame));
+		std::memcpy(&qaabb, box_words, sizeof(rtm::QuantizedAABB));
+
+		unit->float_regs->registers[instr.u.rd].f32 = rtm::intersect(qaabb, frame, ray, inv_d);
+	}),
 };
 
 const static InstructionInfo isa_custom0_funct3[8] =
@@ -231,6 +259,24 @@ struct GlobalConfig
 	uint hit_buffer_size = 128 * 1024; // number of hits, assuming 128 * 16 * 1024 B = 2MB
 	bool use_early = 0;
 	bool hit_delay = 0; // hit delay sucks usually
+	uint dram_model = 0; // 0 - usimm, 1 - analytical
+	bool huge_pages = 0; // back main memory with transparent huge pages
+	std::string dram_config = "gddr5_16ch.cfg"; // usimm config, sets the number of dram channels
+	std::string dram_trace = ""; // record the requests usimm receives to this file
+	std::string dram_replay = ""; // only run usimm on this recorded trace
+	std::string instr_trace = ""; // record every thread's dynamic instruction stream to this file (scalar TPs only)
+	std::string instr_replay = ""; // drive the TPs from this recorded instruction trace instead of executing the kernel
+	uint warp_size = 1; // > 1 groups the threads of a TM into SIMT warps of this size
+	uint num_threads = 1; // hardware thread contexts per scalar TP
+	uint num_logical_threads = 0; // > num_threads swaps threads blocked on memory out to a backing store (scalar TPs only)
+	uint context_swap_cost = 16;
+	uint context_swap_threshold = 16; // cycles a thread waits on memory before it is swapped out
+	uint issue_width = 1; // instructions per cycle a scalar TP can issue from different threads
+	uint fetch_queue_size = 0; // > 0 enables the TP front end model (scalar TPs only)
+	uint branch_predictor = 0; // 0 - static not taken, 1 - bimodal, 2 - gshare, 3 - TAGE
+	uint btb_size = 0; // 0 - branch targets are always known
+	uint mispredict_penalty = 4;
+	std::string profile = ""; // write the per pc TP profile to <profile>.txt, .csv and .folded
 	SceneConfig scene_config;
 }global_config;
 bool readCmd = true;
@@ -372,6 +418,78 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 		{
 			global_config.hit_delay = std::stoi(value);
 		}
+		if (key == "dram_model")
+		{
+			global_config.dram_model = std::stoi(value);
+		}
+		if (key == "huge_pages")
+		{
+			global_config.huge_pages = std::stoi(value);
+		}
+		if (key == "dram_config")
+		{
+			global_config.dram_config = value;
+		}
+		if (key == "dram_trace")
+		{
+			global_config.dram_trace = value;
+		}
+		if (key == "dram_replay")
+		{
+			global_config.dram_replay = value;
+		}
+		if (key == "instr_trace")
+		{
+			global_config.instr_trace = value;
+		}
+		if (key == "instr_replay")
+		{
+			global_config.instr_replay = value;
+		}
+		if (key == "warp_size")
+		{
+			global_config.warp_size = std::stoi(value);
+		}
+		if (key == "num_threads")
+		{
+			global_config.num_threads = std::stoi(value);
+		}
+		if (key == "num_logical_threads")
+		{
+			global_config.num_logical_threads = std::stoi(value);
+		}
+		if (key == "context_swap_cost")
+		{
+			global_config.context_swap_cost = std::stoi(value);
+		}
+		if (key == "context_swap_threshold")
+		{
+			global_config.context_swap_threshold = std::stoi(value);
+		}
+		if (key == "issue_width")
+		{
+			global_config.issue_width = std::stoi(value);
+		}
+		if (key == "fetch_queue_size")
+		{
+			global_config.fetch_queue_size = std::stoi(value);
+		}
+		if (key == "branch_predictor")
+		{
+			global_config.branch_predictor = std::stoi(value);
+		}
+		if (key == "btb_size")
+		{
+			global_config.btb_size = std::stoi(value);
+		}
+		if (key == "mispredict_penalty")
+		{
+			global_config.mispredict_penalty = std::stoi(value);
+		}
+		if (key == "profile")
+		{
+			global_config.profile = value;
+		}
 		std::cout << key << ' ' << value << '\n';
 	};
 
@@ -397,7 +515,8 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	ISA::RISCV::InstructionTypeNameDatabase::get_instance()[ISA::RISCV::InstrType::CUSTOM6] = "LHIT";
 	ISA::RISCV::isa[ISA::RISCV::CUSTOM_OPCODE0] = ISA::RISCV::custom0;
 
-	uint64_t num_tps_per_tm = 64;
+	//with SIMT each TP runs one warp so the TM keeps the same number of threads
+	uint64_t num_tps_per_tm = 64 / global_config.warp_size;
 	uint64_t num_tms = 64;
 
 	uint64_t num_tps = num_tps_per_tm * num_tms;
@@ -409,6 +528,7 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 
 	Simulator simulator;
 	std::vector<Units::UnitTP*> tps;
+	std::vector<Units::UnitSIMTTP<Units::DualStreaming::UnitTP>*> simt_tps;
 	std::vector<Units::UnitSFU*> sfus;
 	std::vector<Units::DualStreaming::UnitRayStagingBuffer*> rsbs;
 	std::vector<Units::UnitThreadScheduler*> thread_schedulers;
@@ -416,6 +536,7 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	std::vector<std::vector<Units::UnitBase*>> unit_tables; unit_tables.reserve(num_tms);
 	std::vector<std::vector<Units::UnitSFU*>> sfu_lists; sfu_lists.reserve(num_tms);
 	std::vector<std::vector<Units::UnitMemoryBase*>> mem_lists; mem_lists.reserve(num_tms);
+	std::vector<Units::UnitTP::Profile> tp_profiles; tp_profiles.reserve(num_tms);
 
 	TCHAR exePath[MAX_PATH];
 	GetModuleFileName(NULL, exePath, MAX_PATH);
@@ -423,34 +544,78 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	std::wstring exeFolder = fullPath.substr(0, fullPath.find_last_of(L"\\") + 1);
 	std::string current_folder_path(exeFolder.begin(), exeFolder.end());
 
-	Units::UnitDRAM dram(64, mem_size, &simulator); dram.clear();
-	simulator.register_unit(&dram);
+	//4 ports per channel. l2 uses 2, stream scheduler 1 and hit record updater 1
+	uint num_dram_channels = Units::UnitDRAM::init_usimm(global_config.dram_config);
+	uint num_dram_ports = num_dram_channels * 4;
+
+	//stream scheduler ports, usimm favors these. Shared with the replay so it sees the same priorities
+	const uint stream_scheduler_port_offset = 1;
+	const uint stream_scheduler_port_stride = 4;
+
+	if(!global_config.dram_replay.empty())
+	{
+		std::vector<bool> priority_ports(num_dram_ports, false);
+		for(uint i = stream_scheduler_port_offset; i < num_dram_ports; i += stream_scheduler_port_stride) priority_ports[i] = true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		cycles_t cycles = Units::UnitDRAM::replay_trace(global_config.dram_replay, priority_ports);
+		auto stop = std::chrono::high_resolution_clock::now();
+
+		Units::UnitDRAM::print_usimm_stats(CACHE_BLOCK_SIZE, 4, cycles);
+
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+		printf("\nSummary\n");
+		printf("Runtime: %lldms\n", duration.count());
+		printf("Cycles: %lld\n", cycles);
+		Units::UnitDRAM::destroy_usimm();
+		return;
+	}
+
+	Util::InstrTraceWriter* instr_trace = nullptr;
+	Util::InstrTraceReader* instr_replay = nullptr;
+	if(!global_config.instr_trace.empty()) instr_trace = new Util::InstrTraceWriter(global_config.instr_trace);
+	if(!global_config.instr_replay.empty()) instr_replay = new Util::InstrTraceReader(global_config.instr_replay);
+	assert(global_config.warp_size == 1 || (!instr_trace && !instr_replay));
+
+	Units::UnitDRAM* usimm_dram = nullptr;
+	Units::UnitAnalyticalDRAM* analytical_dram = nullptr;
+	Units::UnitMainMemoryBase* dram;
+	if(global_config.dram_model == 0) dram = usimm_dram = new Units::UnitDRAM(num_dram_ports, mem_size, &simulator, global_config.huge_pages);
+	else                              dram = analytical_dram = new Units::UnitAnalyticalDRAM(num_dram_ports, mem_size, &simulator, global_config.huge_pages);
+	dram->clear();
+	simulator.register_unit(dram);
+	if(usimm_dram && !global_config.dram_trace.empty()) usimm_dram->record_trace(global_config.dram_trace);
 
 	simulator.new_unit_group();
 
 	ELF elf(current_folder_path + "../dual-streaming-kernel/riscv/kernel");
-	paddr_t heap_address = dram.write_elf(elf);
+	paddr_t heap_address = dram->write_elf(elf);
+	const ELF::LoadableSegment* text_segment = elf.text_segment();
 
-	KernelArgs kernel_args = initilize_buffers(&dram, heap_address);
+	KernelArgs kernel_args = initilize_buffers(dram, heap_address);
 
 	Units::DualStreaming::UnitStreamSchedulerDFS::Configuration stream_scheduler_config;
 	stream_scheduler_config.treelet_addr = *(paddr_t*)&kernel_args.treelets;
 	stream_scheduler_config.heap_addr = *(paddr_t*)&heap_address;
 	stream_scheduler_config.num_tms = num_tms;
 	stream_scheduler_config.num_banks = 16;
-	stream_scheduler_config.cheat_treelets = (Treelet*)&dram._data_u8[(size_t)kernel_args.treelets];
-	stream_scheduler_config.main_mem = &dram;
-	stream_scheduler_config.main_mem_port_offset = 1;
-	stream_scheduler_config.main_mem_port_stride = 4;
+	stream_scheduler_config.num_channels = num_dram_channels;
+	stream_scheduler_config.cheat_treelets = (Treelet*)&dram->_data_u8[(size_t)kernel_args.treelets];
+	stream_scheduler_config.main_mem = dram;
+	stream_scheduler_config.main_mem_port_offset = stream_scheduler_port_offset;
+	stream_scheduler_config.main_mem_port_stride = stream_scheduler_port_stride;
 	stream_scheduler_config.traversal_scheme = global_config.traversal_scheme;
 	stream_scheduler_config.num_root_rays = kernel_args.framebuffer_size;
 
 	Units::DualStreaming::UnitStreamSchedulerDFS stream_scheduler(stream_scheduler_config);
 	simulator.register_unit(&stream_scheduler);
+	if(usimm_dram) usimm_dram->set_priority_ports(stream_scheduler_config.main_mem_port_offset, stream_scheduler_config.main_mem_port_stride);
+	if(usimm_dram) usimm_dram->add_requester("Stream Scheduler", stream_scheduler_config.main_mem_port_offset, stream_scheduler_config.main_mem_port_stride);
 
 	Units::DualStreaming::UnitHitRecordUpdater::Configuration hit_record_updater_config;
 	hit_record_updater_config.num_tms = num_tms;
-	hit_record_updater_config.main_mem = &dram;
+	hit_record_updater_config.num_channels = num_dram_channels;
+	hit_record_updater_config.main_mem = dram;
 	hit_record_updater_config.main_mem_port_offset = 3;
 	hit_record_updater_config.main_mem_port_stride = 4;
 	hit_record_updater_config.hit_record_start = *(paddr_t*)&kernel_args.hit_records;
@@ -458,6 +623,7 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	hit_record_updater_config.associativity = 4;
 	Units::DualStreaming::UnitHitRecordUpdater hit_record_updater(hit_record_updater_config);
 	simulator.register_unit(&hit_record_updater);
+	if(usimm_dram) usimm_dram->add_requester("Hit Record Updater", hit_record_updater_config.main_mem_port_offset, hit_record_updater_config.main_mem_port_stride);
 
 	/*
 	Units::UnitBuffer::Configuration scene_buffer_config;
@@ -476,17 +642,18 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	l2_config.size = 32 * 1024 * 1024;
 	l2_config.associativity = 8;
 	l2_config.num_ports = num_tms * 8;
-	l2_config.num_banks = 32;
-	l2_config.cross_bar_width = 32;
-	l2_config.bank_select_mask = 0b0001'1110'0000'0100'0000ull; //The high order bits need to match the channel assignment bits
+	l2_config.num_banks = num_dram_channels * 2;
+	l2_config.cross_bar_width = std::min(l2_config.num_banks, 32u);
+	l2_config.bank_select_hash = Units::UnitDRAM::bank_select_hash(0b0100'0000ull); //each pair of banks feeds one dram channel
 	l2_config.latency = 10;
 	l2_config.cycle_time = 1;
-	l2_config.mem_higher = &dram;
+	l2_config.mem_higher = dram;
 	l2_config.mem_higher_port_offset = 0;
 	l2_config.mem_higher_port_stride = 2;
 
 	Units::UnitBlockingCache l2(l2_config);
 	simulator.register_unit(&l2);
+	if(usimm_dram) usimm_dram->add_requester("L2", l2_config.mem_higher_port_offset, l2_config.mem_higher_port_stride);
 
 	Units::UnitAtomicRegfile atomic_regs(num_tms);
 	simulator.register_unit(&atomic_regs);
@@ -573,22 +740,42 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 		sfu_lists.emplace_back(sfu_list);
 		mem_lists.emplace_back(mem_list);
 
+		if(!global_config.profile.empty() && text_segment)
+			tp_profiles.emplace_back(text_segment->vaddr, text_segment->data.size());
+
 		for(uint tp_index = 0; tp_index < num_tps_per_tm; ++tp_index)
 		{
 			Units::UnitTP::Configuration tp_config;
-			tp_config.num_threads = 1;
+			tp_config.num_threads = global_config.warp_size > 1 ? global_config.warp_size : global_config.num_threads;
+			tp_config.num_logical_threads = global_config.num_logical_threads;
+			tp_config.context_swap_cost = global_config.context_swap_cost;
+			tp_config.context_swap_threshold = global_config.context_swap_threshold;
+			tp_config.issue_width = global_config.issue_width;
+			tp_config.fetch_queue_size = global_config.fetch_queue_size;
+			tp_config.branch_predictor = (Util::BranchPredictor::Type)global_config.branch_predictor;
+			tp_config.btb_size = global_config.btb_size;
+			tp_config.mispredict_penalty = global_config.mispredict_penalty;
+			if(!tp_profiles.empty()) tp_config.profile = &tp_profiles.back();
 			tp_config.tp_index = tp_index;
 			tp_config.tm_index = tm_index;
 			tp_config.pc = elf.elf_header->e_entry.u64;
 			tp_config.sp = 0x0;
 			tp_config.gp = 0x0000000000012c34;
 			tp_config.stack_size = stack_size;
-			tp_config.cheat_memory = dram._data_u8;
+			tp_config.arena = &simulator.arena;
+			tp_config.cheat_memory = dram->_data_u8;
 			tp_config.unit_table = &unit_tables.back();
 			tp_config.unique_mems = &mem_lists.back();
 			tp_config.unique_sfus = &sfu_lists.back();
+			tp_config.instr_trace = instr_trace;
 
-			tps.push_back(new Units::DualStreaming::UnitTP(tp_config));
+			if(global_config.warp_size > 1)
+			{
+				simt_tps.push_back(new Units::UnitSIMTTP<Units::DualStreaming::UnitTP>(tp_config, global_config.warp_size));
+				tps.push_back(simt_tps.back());
+			}
+			else if(instr_replay) tps.push_back(new Units::UnitReplayTP<Units::DualStreaming::UnitTP>(tp_config, instr_replay));
+			else tps.push_back(new Units::DualStreaming::UnitTP(tp_config));
 			simulator.register_unit(tps.back());
 			simulator.units_executing++;
 		}
@@ -598,7 +785,16 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	simulator.execute();
 	auto stop = std::chrono::high_resolution_clock::now();
 
-	dram.print_usimm_stats(CACHE_BLOCK_SIZE, 4, simulator.current_cycle);
+	if(usimm_dram)
+	{
+		usimm_dram->print_usimm_stats(CACHE_BLOCK_SIZE, 4, simulator.current_cycle);
+		usimm_dram->print_requester_stats();
+	}
+	if(analytical_dram)
+	{
+		printf("\nDRAM\n");
+		analytical_dram->log.print_log();
+	}
 
 	printf("\nL2\n");
 	l2.log.print_log();
@@ -610,29 +806,68 @@ static void run_sim_dual_streaming(int argc, char* argv[])
 	l1_log.print_log();
 
 	printf("\nTP\n");
-	Units::UnitTP::Log tp_log(0x10000);
+	Units::UnitTP::Log tp_log;
 	for(auto& tp : tps)
 		tp_log.accumulate(tp->log);
+	for(auto& profile : tp_profiles)
+		tp_log.accumulate(profile);
 	tp_log.print_log();
 
+	if(!global_config.profile.empty())
+	{
+		FILE* stream = fopen((global_config.profile + ".txt").c_str(), "w");
+		if(stream)
+		{
+			tp_log.print_profile(dram->_data_u8, stream, &elf);
+			fclose(stream);
+		}
+
+		stream = fopen((global_config.profile + ".csv").c_str(), "w");
+		if(stream)
+		{
+			tp_log.print_profile_csv(dram->_data_u8, stream, &elf);
+			fclose(stream);
+		}
+
+		stream = fopen((global_config.profile + ".folded").c_str(), "w");
+		if(stream)
+		{
+			tp_log.print_profile_folded(stream, &elf);
+			fclose(stream);
+		}
+	}
+
+	if(!simt_tps.empty())
+	{
+		printf("\nSIMT\n");
+		Units::UnitSIMTTP<Units::DualStreaming::UnitTP>::SIMTLog simt_log;
+		for(auto& tp : simt_tps)
+			simt_log.accumulate(tp->simt_log);
+		simt_log.print_log();
+	}
+
 	stream_scheduler.log.print();
 
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 	printf("\nSummary\n");
 	printf("Runtime: %lldms\n", duration.count());
 	printf("Cycles: %lld\n", simulator.current_cycle);
+	printf("Main Memory Resident: %.2fMB\n", dram->resident_bytes() / (1024.0f * 1024.0f));
 	printf("MRays/s: %.2f\n", (float)kernel_args.framebuffer_size / (simulator.current_cycle / (2 * 1024)));
 
 	paddr_t paddr_frame_buffer = reinterpret_cast<paddr_t>(kernel_args.framebuffer);
 
 	std::string scene_name = scene_names[global_config.scene_id];
-	dram.dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, scene_name + "_out.png");
+	dram->dump_as_png_uint8(paddr_frame_buffer, kernel_args.framebuffer_width, kernel_args.framebuffer_height, scene_name + "_out.png");
 
 	for(auto& tp : tps) delete tp;
 	for(auto& sfu : sfus) delete sfu;
 	for(auto& rsb : rsbs) delete rsb;
 	for(auto& ts : thread_schedulers) delete ts;
 	for(auto& l1 : l1s) delete l1;
+	delete dram;
+	delete instr_trace;
+	delete instr_replay;
 }
 
 }
\ No newline at end of file
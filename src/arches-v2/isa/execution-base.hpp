@@ -11,5 +11,7 @@ namespace Arches { namespace ISA { namespace RISCV {
 		vaddr_t                    pc;
 		IntegerRegisterFile*       int_regs{nullptr};
 		FloatingPointRegisterFile* float_regs{nullptr};
+		uint8_t                    instr_size{4}; //2 if the instruction was expanded from RVC
+		VectorRegisterFile*        vector_regs{nullptr};
 	};
 }}}
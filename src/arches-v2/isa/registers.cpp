@@ -37,6 +37,16 @@ FloatingPointRegisterFile::FloatingPointRegisterFile()
 	for (int i = 0; i < sizeof(valid); ++i) valid[i] = true;
 }
 
+VectorRegisterFile::VectorRegisterFile()
+{
+	for(uint i = 0; i < 32; ++i)
+		registers[i].f32x4 = _mm_setzero_ps();
+
+	//vector instructions are illegal until the first vsetvl
+	vl = 0;
+	vtype = VTYPE_VILL;
+}
+
 void write_register(IntegerRegisterFile* int_regs, FloatingPointRegisterFile* float_regs, RegAddr dst, uint8_t size, const uint8_t* data)
 {
 	if(dst.reg_type == ISA::RISCV::RegType::INT)
@@ -9,6 +9,7 @@ enum class RegType : uint8_t
 {
 	INT,
 	FLOAT,
+	VECTOR,
 };
 
 struct RegAddr
@@ -18,9 +19,8 @@ struct RegAddr
 		struct
 		{
 			uint8_t reg : 5;
-			RegType reg_type : 1;
+			RegType reg_type : 2;
 			bool    sign_ext : 1;
-			uint8_t _reserved : 1;
 		};
 
 		uint8_t u8;
@@ -31,7 +31,7 @@ struct RegAddr
 
 	std::string mnemonic()
 	{
-		return (reg_type == RegType::INT ? "x" : "f") + std::to_string(reg);
+		return (reg_type == RegType::INT ? "x" : reg_type == RegType::FLOAT ? "f" : "v") + std::to_string(reg);
 	}
 };
 
@@ -252,6 +252,36 @@ public:
 	~FloatingPointRegisterFile() = default;
 };
 
+//RV64V
+//VLEN is 128 so a vector register maps onto one SSE register. Only SEW=32 with LMUL=1 is supported.
+constexpr uint VLEN = 128;
+constexpr uint VLMAX = VLEN / 32;
+
+constexpr uint64_t VTYPE_E32M1 = 0b010'000; //vsew in bits 5:3, vlmul in bits 2:0
+constexpr uint64_t VTYPE_VILL = 0x1ull << 63;
+
+class VectorRegister final {
+public:
+	union {
+		__m128   f32x4;
+		float    f32[VLMAX];
+		uint32_t u32[VLMAX];
+		uint8_t  u8[VLEN / 8];
+	};
+};
+
+class VectorRegisterFile final {
+public:
+	VectorRegister registers[32]; //v0 holds the mask for masked instructions
+
+	uint64_t vl;
+	uint64_t vtype;
+
+public:
+	VectorRegisterFile();
+	~VectorRegisterFile() = default;
+};
+
 void write_register(IntegerRegisterFile* int_regs, FloatingPointRegisterFile* float_regs, RegAddr dst, uint8_t size, const uint8_t* data);
 
 }}}
@@ -14,7 +14,7 @@ InstructionTypeNameDatabase* InstructionTypeNameDatabase::_instance = nullptr;
 
 const InstructionInfo Instruction::get_info() const
 {
-	//ignore two low bits which are only used for the C extension
+	//compressed instructions are expanded before this so the two low bits are always 0b11
 	return isa[opcode >> 2].resolve(*this);
 }
 
@@ -76,6 +76,198 @@ int64_t j_imm(Instruction instr)
 		(instr.j.imm_10_1  <<  1));
 }
 
+//RV64C
+static uint32_t _rvc_bits(uint32_t parcel, uint hi, uint lo)
+{
+	return (parcel >> lo) & ((0x1u << (hi - lo + 1)) - 1);
+}
+
+//sign extends the low n bits
+static int32_t _rvc_sext(uint32_t in, uint n)
+{
+	return (int32_t)(in << (32 - n)) >> (32 - n);
+}
+
+static uint32_t _encode_r(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, uint32_t rs2, uint32_t funct7)
+{
+	return opcode | rd << 7 | funct3 << 12 | rs1 << 15 | rs2 << 20 | funct7 << 25;
+}
+
+static uint32_t _encode_i(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, int32_t imm)
+{
+	return opcode | rd << 7 | funct3 << 12 | rs1 << 15 | ((uint32_t)imm & 0xfff) << 20;
+}
+
+static uint32_t _encode_s(uint32_t opcode, uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+	return opcode | ((uint32_t)imm & 0x1f) << 7 | funct3 << 12 | rs1 << 15 | rs2 << 20 | ((uint32_t)imm >> 5 & 0x7f) << 25;
+}
+
+static uint32_t _encode_b(uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm)
+{
+	uint32_t u = (uint32_t)imm;
+	return 0x63 | (u >> 11 & 0x1) << 7 | (u >> 1 & 0xf) << 8 | funct3 << 12 | rs1 << 15 | rs2 << 20 | (u >> 5 & 0x3f) << 25 | (u >> 12 & 0x1) << 31;
+}
+
+static uint32_t _encode_j(uint32_t rd, int32_t imm)
+{
+	uint32_t u = (uint32_t)imm;
+	return 0x6f | rd << 7 | (u >> 12 & 0xff) << 12 | (u >> 11 & 0x1) << 20 | (u >> 1 & 0x3ff) << 21 | (u >> 20 & 0x1) << 31;
+}
+
+#define RVC_OP_LOAD     0x03
+#define RVC_OP_OP_IMM   0x13
+#define RVC_OP_STORE    0x23
+#define RVC_OP_OP_IMM_32 0x1b
+#define RVC_OP_OP       0x33
+#define RVC_OP_LUI      0x37
+#define RVC_OP_OP_32    0x3b
+#define RVC_OP_JALR     0x67
+
+//Only the RV64 integer subset is supported. C.FLD/C.FSD/C.FLDSP/C.FSDSP need D which we don't implement.
+uint32_t expand_compressed(uint16_t parcel)
+{
+	uint32_t c = parcel;
+	uint32_t funct3 = _rvc_bits(c, 15, 13);
+	uint32_t rd = _rvc_bits(c, 11, 7);       //full register fields
+	uint32_t rs2 = _rvc_bits(c, 6, 2);
+	uint32_t rd_p = _rvc_bits(c, 4, 2) + 8;  //x8-x15 register fields
+	uint32_t rs1_p = _rvc_bits(c, 9, 7) + 8;
+
+	switch(c & 0x3)
+	{
+	case 0b00:
+		switch(funct3)
+		{
+		case 0b000: //c.addi4spn
+		{
+			uint32_t imm = _rvc_bits(c, 12, 11) << 4 | _rvc_bits(c, 10, 7) << 6 | _rvc_bits(c, 6, 6) << 2 | _rvc_bits(c, 5, 5) << 3;
+			if(imm == 0) break;
+			return _encode_i(RVC_OP_OP_IMM, rd_p, 0b000, 2, imm);
+		}
+		case 0b010: //c.lw
+			return _encode_i(RVC_OP_LOAD, rd_p, 0b010, rs1_p, _rvc_bits(c, 12, 10) << 3 | _rvc_bits(c, 6, 6) << 2 | _rvc_bits(c, 5, 5) << 6);
+		case 0b011: //c.ld
+			return _encode_i(RVC_OP_LOAD, rd_p, 0b011, rs1_p, _rvc_bits(c, 12, 10) << 3 | _rvc_bits(c, 6, 5) << 6);
+		case 0b110: //c.sw
+			return _encode_s(RVC_OP_STORE, 0b010, rs1_p, rd_p, _rvc_bits(c, 12, 10) << 3 | _rvc_bits(c, 6, 6) << 2 | _rvc_bits(c, 5, 5) << 6);
+		case 0b111: //c.sd
+			return _encode_s(RVC_OP_STORE, 0b011, rs1_p, rd_p, _rvc_bits(c, 12, 10) << 3 | _rvc_bits(c, 6, 5) << 6);
+		}
+		break;
+
+	case 0b01:
+	{
+		int32_t imm6 = _rvc_sext(_rvc_bits(c, 12, 12) << 5 | _rvc_bits(c, 6, 2), 6);
+		switch(funct3)
+		{
+		case 0b000: //c.addi
+			return _encode_i(RVC_OP_OP_IMM, rd, 0b000, rd, imm6);
+		case 0b001: //c.addiw
+			if(rd == 0) break;
+			return _encode_i(RVC_OP_OP_IMM_32, rd, 0b000, rd, imm6);
+		case 0b010: //c.li
+			return _encode_i(RVC_OP_OP_IMM, rd, 0b000, 0, imm6);
+		case 0b011:
+			if(rd == 2) //c.addi16sp
+			{
+				int32_t imm = _rvc_sext(_rvc_bits(c, 12, 12) << 9 | _rvc_bits(c, 6, 6) << 4 | _rvc_bits(c, 5, 5) << 6 | _rvc_bits(c, 4, 3) << 7 | _rvc_bits(c, 2, 2) << 5, 10);
+				if(imm == 0) break;
+				return _encode_i(RVC_OP_OP_IMM, 2, 0b000, 2, imm);
+			}
+			else //c.lui
+			{
+				if(imm6 == 0) break;
+				return RVC_OP_LUI | rd << 7 | ((uint32_t)imm6 & 0xfffff) << 12;
+			}
+		case 0b100:
+		{
+			uint32_t shamt = _rvc_bits(c, 12, 12) << 5 | _rvc_bits(c, 6, 2);
+			switch(_rvc_bits(c, 11, 10))
+			{
+			case 0b00: return _encode_i(RVC_OP_OP_IMM, rs1_p, 0b101, rs1_p, shamt);         //c.srli
+			case 0b01: return _encode_i(RVC_OP_OP_IMM, rs1_p, 0b101, rs1_p, 0x400 | shamt); //c.srai
+			case 0b10: return _encode_i(RVC_OP_OP_IMM, rs1_p, 0b111, rs1_p, imm6);          //c.andi
+			case 0b11:
+				if(_rvc_bits(c, 12, 12) == 0)
+				{
+					switch(_rvc_bits(c, 6, 5))
+					{
+					case 0b00: return _encode_r(RVC_OP_OP, rs1_p, 0b000, rs1_p, rd_p, 0x20); //c.sub
+					case 0b01: return _encode_r(RVC_OP_OP, rs1_p, 0b100, rs1_p, rd_p, 0x00); //c.xor
+					case 0b10: return _encode_r(RVC_OP_OP, rs1_p, 0b110, rs1_p, rd_p, 0x00); //c.or
+					case 0b11: return _encode_r(RVC_OP_OP, rs1_p, 0b111, rs1_p, rd_p, 0x00); //c.and
+					}
+				}
+				else
+				{
+					switch(_rvc_bits(c, 6, 5))
+					{
+					case 0b00: return _encode_r(RVC_OP_OP_32, rs1_p, 0b000, rs1_p, rd_p, 0x20); //c.subw
+					case 0b01: return _encode_r(RVC_OP_OP_32, rs1_p, 0b000, rs1_p, rd_p, 0x00); //c.addw
+					}
+				}
+				break;
+			}
+			break;
+		}
+		case 0b101: //c.j
+		{
+			int32_t imm = _rvc_sext(_rvc_bits(c, 12, 12) << 11 | _rvc_bits(c, 11, 11) << 4 | _rvc_bits(c, 10, 9) << 8 | _rvc_bits(c, 8, 8) << 10 |
+				_rvc_bits(c, 7, 7) << 6 | _rvc_bits(c, 6, 6) << 7 | _rvc_bits(c, 5, 3) << 1 | _rvc_bits(c, 2, 2) << 5, 12);
+			return _encode_j(0, imm);
+		}
+		case 0b110: //c.beqz
+		case 0b111: //c.bnez
+		{
+			int32_t imm = _rvc_sext(_rvc_bits(c, 12, 12) << 8 | _rvc_bits(c, 11, 10) << 3 | _rvc_bits(c, 6, 5) << 6 | _rvc_bits(c, 4, 3) << 1 | _rvc_bits(c, 2, 2) << 5, 9);
+			return _encode_b(funct3 == 0b110 ? 0b000 : 0b001, rs1_p, 0, imm);
+		}
+		}
+		break;
+	}
+
+	case 0b10:
+		switch(funct3)
+		{
+		case 0b000: //c.slli
+			return _encode_i(RVC_OP_OP_IMM, rd, 0b001, rd, _rvc_bits(c, 12, 12) << 5 | _rvc_bits(c, 6, 2));
+		case 0b010: //c.lwsp
+			if(rd == 0) break;
+			return _encode_i(RVC_OP_LOAD, rd, 0b010, 2, _rvc_bits(c, 12, 12) << 5 | _rvc_bits(c, 6, 4) << 2 | _rvc_bits(c, 3, 2) << 6);
+		case 0b011: //c.ldsp
+			if(rd == 0) break;
+			return _encode_i(RVC_OP_LOAD, rd, 0b011, 2, _rvc_bits(c, 12, 12) << 5 | _rvc_bits(c, 6, 5) << 3 | _rvc_bits(c, 4, 2) << 6);
+		case 0b100:
+			if(_rvc_bits(c, 12, 12) == 0)
+			{
+				if(rs2 == 0) //c.jr
+				{
+					if(rd == 0) break;
+					return _encode_i(RVC_OP_JALR, 0, 0b000, rd, 0);
+				}
+				return _encode_r(RVC_OP_OP, rd, 0b000, 0, rs2, 0x00); //c.mv
+			}
+			else
+			{
+				if(rs2 == 0)
+				{
+					if(rd == 0) return 0x00100073;                     //c.ebreak
+					return _encode_i(RVC_OP_JALR, 1, 0b000, rd, 0);  //c.jalr
+				}
+				return _encode_r(RVC_OP_OP, rd, 0b000, rd, rs2, 0x00); //c.add
+			}
+		case 0b110: //c.swsp
+			return _encode_s(RVC_OP_STORE, 0b010, 2, rs2, _rvc_bits(c, 12, 9) << 2 | _rvc_bits(c, 8, 7) << 6);
+		case 0b111: //c.sdsp
+			return _encode_s(RVC_OP_STORE, 0b011, 2, rs2, _rvc_bits(c, 12, 10) << 3 | _rvc_bits(c, 9, 7) << 6);
+		}
+		break;
+	}
+
+	throw ErrNotImplInstr("Compressed instruction " + std::to_string(parcel) + " not implemented!");
+}
+
 template <typename T> 
 MemoryRequest _prepare_load(ExecutionItem* unit, Instruction const& instr)
 {
@@ -183,13 +375,13 @@ InstructionInfo isa[32] =
 		unit->float_regs->registers[instr.r4.rd].f32 = -(unit->float_regs->registers[instr.r4.rs1].f32 * unit->float_regs->registers[instr.r4.rs2].f32) - unit->float_regs->registers[instr.r4.rs3].f32;
 	}),
 	InstructionInfo(0b10100, META_DECL { return isa_OP_FP[instr.r.funct5]; }),
-	InstructionInfo(0b10101, IMPL_NOTI),//reserved
+	InstructionInfo(0b10101, META_DECL { return isa_OP_V[instr.v.funct3]; }),
 	InstructionInfo(0b10110, IMPL_NONE),//custom-2/rv128
 	InstructionInfo(0b10111, IMPL_NOTI),//48b
 	InstructionInfo(0b11000, META_DECL{ return isa_BRANCH[instr.b.funct3]; }),
 	InstructionInfo(0b11001, "jalr", InstrType::JUMP, Encoding::I,  RegType::INT, CTRL_FLOW_DECL
 	{
-		vaddr_t next_PC = unit->pc + 4;
+		vaddr_t next_PC = unit->pc + unit->instr_size;
 		unit->pc = (unit->int_regs->registers[instr.i.rs1].u64 + i_imm(instr)) & ~0x1ull; //zeroing lowbit is explicitly defined in the spec
 		unit->int_regs->registers[instr.i.rd].u64 = next_PC;
 		return true;
@@ -197,7 +389,7 @@ InstructionInfo isa[32] =
 	InstructionInfo(0b11010, IMPL_NOTI),//reserved
 	InstructionInfo(0b11011, "jal", InstrType::JUMP, Encoding::J,  RegType::INT, CTRL_FLOW_DECL
 	{
-		unit->int_regs->registers[instr.j.rd].u64 = unit->pc + 4;
+		unit->int_regs->registers[instr.j.rd].u64 = unit->pc + unit->instr_size;
 		unit->pc += j_imm(instr);
 		return true;
 	}),
@@ -654,7 +846,7 @@ InstructionInfo const isa_AMO_64[8] = //r.funct5 >> 2
 
 
 //RV64F
-InstructionInfo const isa_LOAD_FP[4] = //i.funct3
+InstructionInfo const isa_LOAD_FP[8] = //i.funct3
 {
 	InstructionInfo(0b001, IMPL_NOTI),//flb
 	InstructionInfo(0b010, IMPL_NOTI),//flh
@@ -663,9 +855,13 @@ InstructionInfo const isa_LOAD_FP[4] = //i.funct3
 		return _prepare_load<float>(unit, instr);
 	}),
 	InstructionInfo(0b011, IMPL_NOTI),//fld
+	InstructionInfo(0b100, IMPL_NOTI),//flq
+	InstructionInfo(0b101, IMPL_NOTI),//vle16
+	InstructionInfo(0b110, META_DECL { return isa_LOAD_V32[instr.vmem.mop]; }),
+	InstructionInfo(0b111, IMPL_NOTI),//vle64
 };
 
-InstructionInfo const isa_STORE_FP[4] = //r.funct3
+InstructionInfo const isa_STORE_FP[8] = //r.funct3
 {
 	InstructionInfo(0b001, IMPL_NOTI),//fsb
 	InstructionInfo(0b010, IMPL_NOTI),//fsh
@@ -674,6 +870,10 @@ InstructionInfo const isa_STORE_FP[4] = //r.funct3
 		return _prepare_store<float>(unit,instr);
 	}),
 	InstructionInfo(0b011, IMPL_NOTI),//fsd
+	InstructionInfo(0b100, IMPL_NOTI),//fsq
+	InstructionInfo(0b101, IMPL_NOTI),//vse16
+	InstructionInfo(0b110, META_DECL { return isa_STORE_V32[instr.vmem.mop]; }),
+	InstructionInfo(0b111, IMPL_NOTI),//vse64
 };
 
 InstructionInfo const isa_OP_FP[32] = //r.funct5
@@ -830,4 +1030,372 @@ InstructionInfo const isa_OP_0x68_FP[4] = //r.rs2
 	}),
 };
 
+//RV64V
+enum : uint32_t
+{
+	OPIVV = 0b000,
+	OPFVV = 0b001,
+	OPMVV = 0b010,
+	OPIVI = 0b011,
+	OPIVX = 0b100,
+	OPFVF = 0b101,
+	OPMVX = 0b110,
+	OPCFG = 0b111,
+};
+
+//Bit i is set if element i is written. Elements past vl are left undisturbed as are masked off elements.
+static uint _vector_active(ExecutionItem* unit, Instruction const& instr)
+{
+	VectorRegisterFile* vr = unit->vector_regs;
+	if(vr->vtype & VTYPE_VILL) throw ErrNotImplInstr("Vector instruction " + std::to_string(instr.data) + " executed with an unsupported vtype!");
+
+	uint active = (uint)generate_nbit_mask((uint)vr->vl);
+	if(!instr.v.vm) active &= vr->registers[0].u32[0];
+	return active;
+}
+
+static void _write_vector(ExecutionItem* unit, Instruction const& instr, __m128 value)
+{
+	VectorRegister mask;
+	uint active = _vector_active(unit, instr);
+	for(uint i = 0; i < VLMAX; ++i)
+		mask.u32[i] = ((active >> i) & 0x1) ? ~0u : 0u;
+
+	VectorRegister& vd = unit->vector_regs->registers[instr.v.vd];
+	vd.f32x4 = _mm_or_ps(_mm_and_ps(mask.f32x4, value), _mm_andnot_ps(mask.f32x4, vd.f32x4));
+}
+
+//mask registers hold one bit per element in the low bits of the register
+static void _write_mask(ExecutionItem* unit, Instruction const& instr, uint bits)
+{
+	uint active = _vector_active(unit, instr);
+	uint32_t& vd = unit->vector_regs->registers[instr.v.vd].u32[0];
+	vd = (vd & ~active) | (bits & active);
+}
+
+static __m128 _vd(ExecutionItem* unit, Instruction const& instr) { return unit->vector_regs->registers[instr.v.vd].f32x4; }
+static __m128 _vs2(ExecutionItem* unit, Instruction const& instr) { return unit->vector_regs->registers[instr.v.vs2].f32x4; }
+
+//vs1 for .vv forms, f[rs1] broadcast for .vf forms
+static __m128 _vs1_or_f(ExecutionItem* unit, Instruction const& instr)
+{
+	if(instr.v.funct3 == OPFVF) return _mm_set_ps1(unit->float_regs->registers[instr.v.vs1].f32);
+	return unit->vector_regs->registers[instr.v.vs1].f32x4;
+}
+
+template <typename OP>
+static void _vector_reduce(ExecutionItem* unit, Instruction const& instr, OP op)
+{
+	uint active = _vector_active(unit, instr);
+	if(unit->vector_regs->vl == 0) return;
+
+	VectorRegister* vr = unit->vector_regs->registers;
+	float result = vr[instr.v.vs1].f32[0];
+	for(uint i = 0; i < VLMAX; ++i)
+		if((active >> i) & 0x1) result = op(result, vr[instr.v.vs2].f32[i]);
+	vr[instr.v.vd].f32[0] = result;
+}
+
+//.vv and .vf forms share an implementation
+static void _vfadd(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_add_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+static void _vfsub(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_sub_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+static void _vfmin(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_min_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+static void _vfmax(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_max_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+static void _vfdiv(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_div_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+static void _vfmul(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_mul_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))); }
+
+//not fused to match fmadd.s
+static void _vfmacc(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_add_ps(_vd(unit, instr), _mm_mul_ps(_vs1_or_f(unit, instr), _vs2(unit, instr)))); }
+static void _vfnmsac(Instruction const& instr, ExecutionItem* unit) { _write_vector(unit, instr, _mm_sub_ps(_vd(unit, instr), _mm_mul_ps(_vs1_or_f(unit, instr), _vs2(unit, instr)))); }
+
+static void _vmfeq(Instruction const& instr, ExecutionItem* unit) { _write_mask(unit, instr, _mm_movemask_ps(_mm_cmpeq_ps(_vs2(unit, instr), _vs1_or_f(unit, instr)))); }
+static void _vmfle(Instruction const& instr, ExecutionItem* unit) { _write_mask(unit, instr, _mm_movemask_ps(_mm_cmple_ps(_vs2(unit, instr), _vs1_or_f(unit, instr)))); }
+static void _vmflt(Instruction const& instr, ExecutionItem* unit) { _write_mask(unit, instr, _mm_movemask_ps(_mm_cmplt_ps(_vs2(unit, instr), _vs1_or_f(unit, instr)))); }
+static void _vmfne(Instruction const& instr, ExecutionItem* unit) { _write_mask(unit, instr, _mm_movemask_ps(_mm_cmpneq_ps(_vs2(unit, instr), _vs1_or_f(unit, instr)))); }
+
+template <MemoryRequest::Type TYPE>
+MemoryRequest _prepare_vector_access(ExecutionItem* unit, Instruction const& instr)
+{
+	VectorRegisterFile* vr = unit->vector_regs;
+	if(vr->vtype & VTYPE_VILL) throw ErrNotImplInstr("Vector instruction " + std::to_string(instr.data) + " executed with an unsupported vtype!");
+	if(!instr.vmem.vm || instr.vmem.nf || instr.vmem.mew) throw ErrNotImplInstr(instr);
+
+	//The TP splits the access into cache line requests. The byte stride rides in flags so the request describes the whole access.
+	int64_t stride = sizeof(float);
+	if(instr.vmem.mop == 0b10) stride = unit->int_regs->registers[instr.vmem.rs2].s64;
+	else if(instr.vmem.rs2 != 0) throw ErrNotImplInstr(instr); //whole register, mask and fault only first forms
+	if(stride != (int16_t)stride) throw ErrNotImplInstr("Vector stride " + std::to_string(stride) + " not supported!");
+
+	RegAddr reg_addr;
+	reg_addr.reg = instr.vmem.vd;
+	reg_addr.reg_type = RegType::VECTOR;
+	reg_addr.sign_ext = false;
+
+	MemoryRequest req;
+	req.type = TYPE;
+	req.size = (uint8_t)(vr->vl * sizeof(float));
+	req.flags = (uint16_t)stride;
+	req.dst = reg_addr.u8;
+	req.write_mask = generate_nbit_mask(req.size);
+	req.vaddr = unit->int_regs->registers[instr.vmem.rs1].u64;
+	if(TYPE == MemoryRequest::Type::STORE)
+		std::memcpy(req.data, vr->registers[instr.vmem.vd].u32, req.size);
+
+	return req;
+}
+
+static void _vsetvl(ExecutionItem* unit, Instruction const& instr, uint64_t avl, uint64_t vtype)
+{
+	VectorRegisterFile* vr = unit->vector_regs;
+	if((vtype & ~0xc0ull) == VTYPE_E32M1) //vta and vma are ignored. We are always undisturbed
+	{
+		vr->vtype = vtype;
+		vr->vl = std::min(avl, (uint64_t)VLMAX);
+	}
+	else
+	{
+		vr->vtype = VTYPE_VILL;
+		vr->vl = 0;
+	}
+	unit->int_regs->registers[instr.vset.rd].u64 = vr->vl;
+}
+
+template <size_t N>
+static InstructionInfo const& _resolve_funct6(Instruction const& instr, const uint8_t (&funct6s)[N], InstructionInfo const (&infos)[N])
+{
+	for(uint i = 0; i < N; ++i)
+		if(funct6s[i] == instr.v.funct6) return infos[i];
+	throw ErrNotImplInstr(instr);
+}
+
+InstructionInfo const isa_LOAD_V32[4] = //vmem.mop
+{
+	InstructionInfo(0b00, "vle32.v", InstrType::LOAD, Encoding::VL, RegType::VECTOR, RegType::INT, MEM_REQ_DECL
+	{
+		return _prepare_vector_access<MemoryRequest::Type::LOAD>(unit, instr);
+	}),
+	InstructionInfo(0b01, IMPL_NOTI),//vluxei32.v
+	InstructionInfo(0b10, "vlse32.v", InstrType::LOAD, Encoding::VL, RegType::VECTOR, RegType::INT, MEM_REQ_DECL
+	{
+		return _prepare_vector_access<MemoryRequest::Type::LOAD>(unit, instr);
+	}),
+	InstructionInfo(0b11, IMPL_NOTI),//vloxei32.v
+};
+
+InstructionInfo const isa_STORE_V32[4] = //vmem.mop
+{
+	InstructionInfo(0b00, "vse32.v", InstrType::STORE, Encoding::VS, RegType::VECTOR, RegType::INT, MEM_REQ_DECL
+	{
+		return _prepare_vector_access<MemoryRequest::Type::STORE>(unit, instr);
+	}),
+	InstructionInfo(0b01, IMPL_NOTI),//vsuxei32.v
+	InstructionInfo(0b10, "vsse32.v", InstrType::STORE, Encoding::VS, RegType::VECTOR, RegType::INT, MEM_REQ_DECL
+	{
+		return _prepare_vector_access<MemoryRequest::Type::STORE>(unit, instr);
+	}),
+	InstructionInfo(0b11, IMPL_NOTI),//vsoxei32.v
+};
+
+static const uint8_t _opivv_funct6[1] = {0b010111};
+InstructionInfo const isa_OPIVV[1] =
+{
+	InstructionInfo(0b010111, "vmv.v.v", InstrType::MOVE, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		if(!instr.v.vm) throw ErrNotImplInstr(instr); //vmerge.vvm
+		_write_vector(unit, instr, unit->vector_regs->registers[instr.v.vs1].f32x4);
+	}),
+};
+
+static const uint8_t _opivx_funct6[1] = {0b010111};
+InstructionInfo const isa_OPIVX[1] =
+{
+	InstructionInfo(0b010111, "vmv.v.x", InstrType::MOVE, Encoding::V, RegType::VECTOR, RegType::INT, EXEC_DECL
+	{
+		if(!instr.v.vm) throw ErrNotImplInstr(instr); //vmerge.vxm
+		VectorRegister value;
+		for(uint i = 0; i < VLMAX; ++i) value.u32[i] = unit->int_regs->registers[instr.v.vs1].u32;
+		_write_vector(unit, instr, value.f32x4);
+	}),
+};
+
+static const uint8_t _opivi_funct6[1] = {0b010111};
+InstructionInfo const isa_OPIVI[1] =
+{
+	InstructionInfo(0b010111, "vmv.v.i", InstrType::MOVE, Encoding::VU, RegType::VECTOR, EXEC_DECL
+	{
+		if(!instr.v.vm) throw ErrNotImplInstr(instr); //vmerge.vim
+		VectorRegister value;
+		for(uint i = 0; i < VLMAX; ++i) value.u32[i] = (uint32_t)((int32_t)(instr.v.vs1 << 27) >> 27);
+		_write_vector(unit, instr, value.f32x4);
+	}),
+};
+
+static const uint8_t _opfvv_funct6[16] = {0b000000, 0b000001, 0b000010, 0b000100, 0b000101, 0b000110, 0b000111, 0b010000, 0b011000, 0b011001, 0b011011, 0b011100, 0b100000, 0b100100, 0b101100, 0b101111};
+InstructionInfo const isa_OPFVV[16] = //v.funct6
+{
+	InstructionInfo(0b000000, "vfadd.vv", InstrType::FADD, Encoding::V, RegType::VECTOR, _vfadd),
+	InstructionInfo(0b000001, "vfredusum.vs", InstrType::FADD, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		_vector_reduce(unit, instr, [](float a, float b) { return a + b; });
+	}),
+	InstructionInfo(0b000010, "vfsub.vv", InstrType::FADD, Encoding::V, RegType::VECTOR, _vfsub),
+	InstructionInfo(0b000100, "vfmin.vv", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, _vfmin),
+	InstructionInfo(0b000101, "vfredmin.vs", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		_vector_reduce(unit, instr, [](float a, float b) { return std::min(a, b); });
+	}),
+	InstructionInfo(0b000110, "vfmax.vv", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, _vfmax),
+	InstructionInfo(0b000111, "vfredmax.vs", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		_vector_reduce(unit, instr, [](float a, float b) { return std::max(a, b); });
+	}),
+	InstructionInfo(0b010000, "vfmv.f.s", InstrType::MOVE, Encoding::VU, RegType::FLOAT, RegType::VECTOR, EXEC_DECL
+	{
+		if(instr.v.vs1 != 0) throw ErrNotImplInstr(instr); //other VWFUNARY0 instructions
+		unit->float_regs->registers[instr.v.vd].f32 = unit->vector_regs->registers[instr.v.vs2].f32[0];
+	}),
+	InstructionInfo(0b011000, "vmfeq.vv", InstrType::FCMP, Encoding::V, RegType::VECTOR, _vmfeq),
+	InstructionInfo(0b011001, "vmfle.vv", InstrType::FCMP, Encoding::V, RegType::VECTOR, _vmfle),
+	InstructionInfo(0b011011, "vmflt.vv", InstrType::FCMP, Encoding::V, RegType::VECTOR, _vmflt),
+	InstructionInfo(0b011100, "vmfne.vv", InstrType::FCMP, Encoding::V, RegType::VECTOR, _vmfne),
+	InstructionInfo(0b100000, "vfdiv.vv", InstrType::FDIV, Encoding::V, RegType::VECTOR, _vfdiv),
+	InstructionInfo(0b100100, "vfmul.vv", InstrType::FMUL, Encoding::V, RegType::VECTOR, _vfmul),
+	InstructionInfo(0b101100, "vfmacc.vv", InstrType::FFMAD, Encoding::V, RegType::VECTOR, _vfmacc),
+	InstructionInfo(0b101111, "vfnmsac.vv", InstrType::FFMAD, Encoding::V, RegType::VECTOR, _vfnmsac),
+};
+
+static const uint8_t _opfvf_funct6[18] = {0b000000, 0b000010, 0b000100, 0b000110, 0b010000, 0b010111, 0b011000, 0b011001, 0b011011, 0b011100, 0b011101, 0b011111, 0b100000, 0b100001, 0b100100, 0b100111, 0b101100, 0b101111};
+InstructionInfo const isa_OPFVF[18] = //v.funct6
+{
+	InstructionInfo(0b000000, "vfadd.vf", InstrType::FADD, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfadd),
+	InstructionInfo(0b000010, "vfsub.vf", InstrType::FADD, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfsub),
+	InstructionInfo(0b000100, "vfmin.vf", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfmin),
+	InstructionInfo(0b000110, "vfmax.vf", InstrType::FMIN_MAX, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfmax),
+	InstructionInfo(0b010000, "vfmv.s.f", InstrType::MOVE, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		if(instr.v.vs2 != 0) throw ErrNotImplInstr(instr); //other VRFUNARY0 instructions
+		if(unit->vector_regs->vl > 0) unit->vector_regs->registers[instr.v.vd].f32[0] = unit->float_regs->registers[instr.v.vs1].f32;
+	}),
+	InstructionInfo(0b010111, "vfmv.v.f", InstrType::MOVE, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		if(!instr.v.vm) throw ErrNotImplInstr(instr); //vfmerge.vfm
+		_write_vector(unit, instr, _vs1_or_f(unit, instr));
+	}),
+	InstructionInfo(0b011000, "vmfeq.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vmfeq),
+	InstructionInfo(0b011001, "vmfle.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vmfle),
+	InstructionInfo(0b011011, "vmflt.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vmflt),
+	InstructionInfo(0b011100, "vmfne.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vmfne),
+	InstructionInfo(0b011101, "vmfgt.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		_write_mask(unit, instr, _mm_movemask_ps(_mm_cmpgt_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))));
+	}),
+	InstructionInfo(0b011111, "vmfge.vf", InstrType::FCMP, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		_write_mask(unit, instr, _mm_movemask_ps(_mm_cmpge_ps(_vs2(unit, instr), _vs1_or_f(unit, instr))));
+	}),
+	InstructionInfo(0b100000, "vfdiv.vf", InstrType::FDIV, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfdiv),
+	InstructionInfo(0b100001, "vfrdiv.vf", InstrType::FDIV, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		_write_vector(unit, instr, _mm_div_ps(_vs1_or_f(unit, instr), _vs2(unit, instr)));
+	}),
+	InstructionInfo(0b100100, "vfmul.vf", InstrType::FMUL, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfmul),
+	InstructionInfo(0b100111, "vfrsub.vf", InstrType::FADD, Encoding::V, RegType::VECTOR, RegType::FLOAT, EXEC_DECL
+	{
+		_write_vector(unit, instr, _mm_sub_ps(_vs1_or_f(unit, instr), _vs2(unit, instr)));
+	}),
+	InstructionInfo(0b101100, "vfmacc.vf", InstrType::FFMAD, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfmacc),
+	InstructionInfo(0b101111, "vfnmsac.vf", InstrType::FFMAD, Encoding::V, RegType::VECTOR, RegType::FLOAT, _vfnmsac),
+};
+
+InstructionInfo const isa_OPMVV[7] =
+{
+	InstructionInfo(0b010000, "vcpop.m", InstrType::ILOGICAL, Encoding::VU, RegType::INT, RegType::VECTOR, EXEC_DECL
+	{
+		uint active = _vector_active(unit, instr);
+		unit->int_regs->registers[instr.v.vd].u64 = popcnt(unit->vector_regs->registers[instr.v.vs2].u32[0] & active);
+	}),
+	InstructionInfo(0b010000, "vfirst.m", InstrType::ILOGICAL, Encoding::VU, RegType::INT, RegType::VECTOR, EXEC_DECL
+	{
+		uint bits = unit->vector_regs->registers[instr.v.vs2].u32[0] & _vector_active(unit, instr);
+		unit->int_regs->registers[instr.v.vd].s64 = bits ? (int64_t)ctz(bits) : -1;
+	}),
+	InstructionInfo(0b011000, "vmandn.mm", InstrType::ILOGICAL, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		VectorRegister* vr = unit->vector_regs->registers;
+		_write_mask(unit, instr, vr[instr.v.vs2].u32[0] & ~vr[instr.v.vs1].u32[0]);
+	}),
+	InstructionInfo(0b011001, "vmand.mm", InstrType::ILOGICAL, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		VectorRegister* vr = unit->vector_regs->registers;
+		_write_mask(unit, instr, vr[instr.v.vs2].u32[0] & vr[instr.v.vs1].u32[0]);
+	}),
+	InstructionInfo(0b011010, "vmor.mm", InstrType::ILOGICAL, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		VectorRegister* vr = unit->vector_regs->registers;
+		_write_mask(unit, instr, vr[instr.v.vs2].u32[0] | vr[instr.v.vs1].u32[0]);
+	}),
+	InstructionInfo(0b011011, "vmxor.mm", InstrType::ILOGICAL, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		VectorRegister* vr = unit->vector_regs->registers;
+		_write_mask(unit, instr, vr[instr.v.vs2].u32[0] ^ vr[instr.v.vs1].u32[0]);
+	}),
+	InstructionInfo(0b011101, "vmnand.mm", InstrType::ILOGICAL, Encoding::V, RegType::VECTOR, EXEC_DECL
+	{
+		VectorRegister* vr = unit->vector_regs->registers;
+		_write_mask(unit, instr, ~(vr[instr.v.vs2].u32[0] & vr[instr.v.vs1].u32[0]));
+	}),
+};
+
+InstructionInfo const isa_OPCFG[3] =
+{
+	InstructionInfo(0b0, "vsetvli", InstrType::SYS, Encoding::I, RegType::INT, EXEC_DECL
+	{
+		uint64_t avl = unit->int_regs->registers[instr.vset.rs1].u64;
+		if(instr.vset.rs1 == 0) avl = instr.vset.rd == 0 ? unit->vector_regs->vl : ~0ull;
+		_vsetvl(unit, instr, avl, instr.vset.zimm | instr.vset.bit30 << 10);
+	}),
+	InstructionInfo(0b11, "vsetivli", InstrType::SYS, Encoding::U, RegType::INT, EXEC_DECL
+	{
+		_vsetvl(unit, instr, instr.vset.rs1, instr.vset.zimm);
+	}),
+	InstructionInfo(0b10, "vsetvl", InstrType::SYS, Encoding::R, RegType::INT, EXEC_DECL
+	{
+		uint64_t avl = unit->int_regs->registers[instr.vset.rs1].u64;
+		if(instr.vset.rs1 == 0) avl = instr.vset.rd == 0 ? unit->vector_regs->vl : ~0ull;
+		_vsetvl(unit, instr, avl, unit->int_regs->registers[instr.r.rs2].u64);
+	}),
+};
+
+InstructionInfo const isa_OP_V[8] = //v.funct3
+{
+	InstructionInfo(OPIVV, META_DECL { return _resolve_funct6(instr, _opivv_funct6, isa_OPIVV); }),
+	InstructionInfo(OPFVV, META_DECL { return _resolve_funct6(instr, _opfvv_funct6, isa_OPFVV); }),
+	InstructionInfo(OPMVV, META_DECL
+	{
+		switch(instr.v.funct6)
+		{
+		case 0b010000: //VWXUNARY0
+			if(instr.v.vs1 == 0b10000) return isa_OPMVV[0];
+			if(instr.v.vs1 == 0b10001) return isa_OPMVV[1];
+			break;
+		case 0b011000: return isa_OPMVV[2];
+		case 0b011001: return isa_OPMVV[3];
+		case 0b011010: return isa_OPMVV[4];
+		case 0b011011: return isa_OPMVV[5];
+		case 0b011101: return isa_OPMVV[6];
+		}
+		throw ErrNotImplInstr(instr);
+	}),
+	InstructionInfo(OPIVI, META_DECL { return _resolve_funct6(instr, _opivi_funct6, isa_OPIVI); }),
+	InstructionInfo(OPIVX, META_DECL { return _resolve_funct6(instr, _opivx_funct6, isa_OPIVX); }),
+	InstructionInfo(OPFVF, META_DECL { return _resolve_funct6(instr, _opfvf_funct6, isa_OPFVF); }),
+	InstructionInfo(OPMVX, META_NOTI),
+	InstructionInfo(OPCFG, META_DECL
+	{
+		if(!instr.vset.bit31) return isa_OPCFG[0];
+		if(instr.vset.bit30)  return isa_OPCFG[1];
+		return isa_OPCFG[2];
+	}),
+};
+
 }}}
@@ -190,6 +190,10 @@ enum class Encoding : uint8_t
 	U,
 	J,
 	C,
+	V,  //vd, vs2, rs1 (vector, float or int by src_reg_type) and v0 if masked
+	VU, //vd, vs2 and v0 if masked. The rs1 field is part of the function code
+	VL, //vd, rs1 base, rs2 stride if strided
+	VS, //vs3 in the rd field, rs1 base, rs2 stride if strided
 };
 
 class InstructionInfo;
@@ -318,6 +322,41 @@ public:
 			uint32_t imm_20		: 1;
 		}j;
 
+		struct
+		{
+			uint32_t        : 7;
+			uint32_t vd     : 5;
+			uint32_t funct3 : 3;
+			uint32_t vs1    : 5;
+			uint32_t vs2    : 5;
+			uint32_t vm     : 1;
+			uint32_t funct6 : 6;
+		}v;
+
+		struct
+		{
+			uint32_t        : 7;
+			uint32_t vd     : 5;
+			uint32_t width  : 3;
+			uint32_t rs1    : 5;
+			uint32_t rs2    : 5; //lumop/sumop if unit stride
+			uint32_t vm     : 1;
+			uint32_t mop    : 2;
+			uint32_t mew    : 1;
+			uint32_t nf     : 3;
+		}vmem;
+
+		struct
+		{
+			uint32_t        : 7;
+			uint32_t rd     : 5;
+			uint32_t funct3 : 3;
+			uint32_t rs1    : 5;
+			uint32_t zimm   : 10;
+			uint32_t bit30  : 1;
+			uint32_t bit31  : 1;
+		}vset;
+
 		uint32_t data;
 	};
 	
@@ -333,6 +372,11 @@ int64_t b_imm(Instruction instr);
 int64_t u_imm(Instruction instr);
 int64_t j_imm(Instruction instr);
 
+//RV64C
+//compressed instructions are expanded to their 32 bit equivalent before decode
+inline bool is_compressed(uint32_t parcel) { return (parcel & 0x3) != 0x3; }
+uint32_t expand_compressed(uint16_t parcel);
+
 class InstructionInfo final 
 {
 public:
@@ -400,10 +444,15 @@ public:
 		return _req_fn(instr, &unit);
 	}
 
+	static char reg_file_char(RegType reg_type)
+	{
+		return reg_type == RegType::INT ? 'x' : reg_type == RegType::FLOAT ? 'f' : 'v';
+	}
+
 	void print_instr(Instruction const& instr, FILE* stream = stdout) const
 	{
-		char drfc = dst_reg_type == RegType::INT ? 'x' : 'f';
-		char srfc = src_reg_type == RegType::INT ? 'x' : 'f';
+		char drfc = reg_file_char(dst_reg_type);
+		char srfc = reg_file_char(src_reg_type);
 
 		switch(encoding)
 		{
@@ -435,6 +484,20 @@ public:
 			fprintf(stream, "%s\t%c%d,%d", mnemonic, drfc, instr.rd, (int32_t)j_imm(instr));
 			break;
 
+		case ISA::RISCV::Encoding::V:
+			fprintf(stream, "%s\t%c%d,v%d,%c%d%s", mnemonic, drfc, instr.v.vd, instr.v.vs2, srfc, instr.v.vs1, instr.v.vm ? "" : ",v0.t");
+			break;
+
+		case ISA::RISCV::Encoding::VU:
+			fprintf(stream, "%s\t%c%d,v%d%s", mnemonic, drfc, instr.v.vd, instr.v.vs2, instr.v.vm ? "" : ",v0.t");
+			break;
+
+		case ISA::RISCV::Encoding::VL:
+		case ISA::RISCV::Encoding::VS:
+			if(instr.vmem.mop == 0b10) fprintf(stream, "%s\tv%d,(x%d),x%d", mnemonic, instr.vmem.vd, instr.vmem.rs1, instr.vmem.rs2);
+			else                       fprintf(stream, "%s\tv%d,(x%d)", mnemonic, instr.vmem.vd, instr.vmem.rs1);
+			break;
+
 		default:
 			fprintf(stream, "%s", mnemonic);
 			break;
@@ -496,9 +559,6 @@ public:
 	virtual ~ErrNotImplInstr() = default;
 };
 
-//RV64C
-//extern InstructionInfo const compressed_isa[4]; //TODO this
-
 //RV64I
 extern InstructionInfo isa[32];
 
@@ -533,8 +593,8 @@ extern InstructionInfo const isa_AMO_32[8];
 extern InstructionInfo const isa_AMO_64[8];
 
 //RV64F
-extern InstructionInfo const isa_LOAD_FP[4];
-extern InstructionInfo const isa_STORE_FP[4];
+extern InstructionInfo const isa_LOAD_FP[8];
+extern InstructionInfo const isa_STORE_FP[8];
 extern InstructionInfo const isa_OP_FP[32];
 
 extern InstructionInfo const isa_OP_FSGNJ_FP[3];
@@ -543,6 +603,19 @@ extern InstructionInfo const isa_OP_FCMP_FP[3];
 extern InstructionInfo const isa_OP_0x60_FP[4];
 extern InstructionInfo const isa_OP_0x68_FP[4];
 
+//RV64V
+extern InstructionInfo const isa_LOAD_V32[4];
+extern InstructionInfo const isa_STORE_V32[4];
+extern InstructionInfo const isa_OP_V[8];
+
+extern InstructionInfo const isa_OPIVV[1];
+extern InstructionInfo const isa_OPIVX[1];
+extern InstructionInfo const isa_OPIVI[1];
+extern InstructionInfo const isa_OPFVV[16];
+extern InstructionInfo const isa_OPFVF[18];
+extern InstructionInfo const isa_OPMVV[7];
+extern InstructionInfo const isa_OPCFG[3];
+
 #define META_DECL [](Instruction const& instr) -> InstructionInfo const&
 #define EXEC_DECL [](Instruction const& instr, ExecutionItem* unit) -> void
 #define CTRL_FLOW_DECL [](Instruction const& instr, ExecutionItem* unit) -> bool
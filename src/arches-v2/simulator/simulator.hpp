@@ -1,6 +1,8 @@
 #pragma once
 #include "stdafx.hpp"
 
+#include "util/arena.hpp"
+
 #if 1
 namespace Arches {
 
@@ -28,6 +30,9 @@ public:
 	std::atomic_uint units_executing{0};
 	cycles_t current_cycle{0};
 
+	//backs per thread state like TP stacks so it is allocated in one place instead of per unit
+	Util::Arena arena;
+
 	Simulator() { _unit_groups.emplace_back(0u, 0u); }
 
 	void register_unit(Units::UnitBase* unit);
@@ -99,6 +99,31 @@ const static InstructionInfo isa_custom0_000_imm[8] =
 		fr[16].f32 = hit.bc[0];
 		fr[17].f32 = hit.bc[1];
 	}),
+	InstructionInfo(0x3, "qboxisect", InstrType::CUSTOM1, Encoding::U, RegType::FLOAT, EXEC_DECL
+	{
+		Register32 * fr = unit->float_regs->registers;
+
+		rtm::vec3 inv_d;
+
+		rtm::Ray ray;
+		ray.o.x = fr[0].f32;
+		ray.o.y = fr[1].f32;
+		ray.o.z = fr[2].f32;
+		inv_d.x = fr[3].f32;
+		inv_d.y = fr[4].f32;
+		inv_d.z = fr[5].f32;
+
+		//f6-f8 hold the parent frame as it is laid out in memory and f9-f10 the 6 bytes of the child box
+		uint32_t frame_words[3] = {fr[6].u32, fr[7].u32, fr[8].u32};
+		uint32_t box_words[2] = {fr[9].u32, fr[10].u32};
+
+		rtm::QuantizationFrame frame;
+		rtm::QuantizedAABB qaabb;
+		std::memcpy(&frame, frame_words, sizeof(rtm::QuantizationFrame));
+		std::memcpy(&qaabb, box_words, sizeof(rtm::QuantizedAABB));
+
+		unit->float_regs->registers[instr.u.rd].f32 = rtm::intersect(qaabb, frame, ray, inv_d);
+	}),
 };
 
 const static InstructionInfo isa_custom0_funct3[8] =
@@ -119,7 +144,7 @@ const static InstructionInfo isa_custom0_funct3[8] =
 		mem_req.type = MemoryRequest::Type::STORE;
 		mem_req.size = sizeof(rtm::Ray);
 		mem_req.dst = reg_addr.u8;
-		mem_req.flags = (uint16_t)ISA::RISCV::i_imm(instr);
+		mem_req.flags = (uint16_t)ISA::RISCV::i_imm(instr); //UnitRTCore::ANY_HIT returns only the hit id to rd
 		mem_req.vaddr = 0xdeadbeefull;
 
 		Register32* fr = unit->float_regs->registers;
@@ -148,7 +173,9 @@ static RET* write_vector(Units::UnitMainMemoryBase* main_memory, size_t alignmen
 	return write_array(main_memory, alignment, v.data(), v.size(), heap_address);
 }
 
-static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address)
+//rt_core_nodes is set to a copy of the blas collapsed to rt_core_bvh_width if it isn't 2 or quantized nodes are used. The kernel
+//always sees the binary blas
+static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, paddr_t& heap_address, uint rt_core_bvh_width, bool rt_core_quantized_nodes, paddr_t& rt_core_nodes)
 {
 	rtm::Mesh mesh("../../datasets/sponza.obj");
 	rtm::BVH blas;
@@ -179,6 +206,20 @@ static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, padd
 	args.mesh.blas = write_vector(main_memory, 32, blas.nodes, heap_address);
 	args.mesh.tris = write_vector(main_memory, CACHE_BLOCK_SIZE, tris, heap_address);
 
+	//wide nodes are aligned to their size so each one fills whole cache lines
+	rt_core_nodes = (paddr_t)args.mesh.blas;
+	if(rt_core_quantized_nodes)
+	{
+		if(rt_core_bvh_width == 2) rt_core_nodes = (paddr_t)write_vector(main_memory, CACHE_BLOCK_SIZE, rtm::WideBVH<2>(blas).quantized_nodes, heap_address);
+		if(rt_core_bvh_width == 4) rt_core_nodes = (paddr_t)write_vector(main_memory, CACHE_BLOCK_SIZE, rtm::WideBVH<4>(blas).quantized_nodes, heap_address);
+		if(rt_core_bvh_width == 8) rt_core_nodes = (paddr_t)write_vector(main_memory, CACHE_BLOCK_SIZE, rtm::WideBVH<8>(blas).quantized_nodes, heap_address);
+	}
+	else
+	{
+		if(rt_core_bvh_width == 4) rt_core_nodes = (paddr_t)write_vector(main_memory, sizeof(rtm::WideBVH<4>::Node), rtm::WideBVH<4>(blas).nodes, heap_address);
+		if(rt_core_bvh_width == 8) rt_core_nodes = (paddr_t)write_vector(main_memory, sizeof(rtm::WideBVH<8>::Node), rtm::WideBVH<8>(blas).nodes, heap_address);
+	}
+
 	main_memory->direct_write(&args, sizeof(KernelArgs), KERNEL_ARGS_ADDRESS);
 
 	return args;
@@ -187,6 +228,7 @@ static KernelArgs initilize_buffers(Units::UnitMainMemoryBase* main_memory, padd
 static void run_sim_trax(int argc, char* argv[])
 {
 	uint num_threads_per_tp = 8;
+	uint issue_width = 1;
 	uint num_tps_per_tm = 32;
 	uint num_tms_per_l2 = 64;
 	uint num_l2 = 1;
@@ -194,6 +236,10 @@ static void run_sim_trax(int argc, char* argv[])
 	uint num_l2_banks = 32;
 	uint num_l1_banks = 8;
 	uint num_icache_per_tm = 8;
+	uint rt_core_bvh_width = 2; //2 for the binary bvh, 4 or 8 for a collapsed wide bvh
+	bool rt_core_quantized_nodes = false;
+	uint rt_core_short_stack_size = 0; //0 for a full stack
+	bool tp_profile = false; //per pc TP profile, one per TM
 
 	uint num_tps = num_l2 * num_tms_per_l2 * num_tps_per_tm;
 	uint num_tms = num_tms_per_l2 * num_l2;
@@ -223,6 +269,7 @@ static void run_sim_trax(int argc, char* argv[])
 	std::vector<std::vector<Units::UnitBase*>> unit_tables; unit_tables.reserve(num_tms);
 	std::vector<std::vector<Units::UnitSFU*>> sfu_lists; sfu_lists.reserve(num_tms);
 	std::vector<std::vector<Units::UnitMemoryBase*>> mem_lists; mem_lists.reserve(num_tms);
+	std::vector<Units::UnitTP::Profile> tp_profiles; tp_profiles.reserve(num_tms);
 	
 	Units::UnitDRAM mm(num_l2 * num_l2_banks, 1024ull * 1024ull * 1024ull, &simulator); mm.clear();
 	simulator.register_unit(&mm);
@@ -230,8 +277,10 @@ static void run_sim_trax(int argc, char* argv[])
 	ELF elf("../trax-kernel/riscv/kernel");
 	vaddr_t global_pointer;
 	paddr_t heap_address = mm.write_elf(elf);
+	const ELF::LoadableSegment* text_segment = elf.text_segment();
 	
-	KernelArgs kernel_args = initilize_buffers(&mm, heap_address);
+	paddr_t rt_core_nodes;
+	KernelArgs kernel_args = initilize_buffers(&mm, heap_address, rt_core_bvh_width, rt_core_quantized_nodes, rt_core_nodes);
 
 	Units::UnitAtomicRegfile atomic_regs(num_tms);
 	simulator.register_unit(&atomic_regs);
@@ -246,7 +295,7 @@ static void run_sim_trax(int argc, char* argv[])
 		l2_config.num_ports = num_l2_ports_per_tm * num_tms_per_l2;
 		l2_config.num_banks = num_l2_banks;
 		l2_config.cross_bar_width = 16;
-		l2_config.bank_select_mask = 0b0001'1110'0000'0100'0000ull;
+		l2_config.bank_select_hash = Units::UnitDRAM::bank_select_hash(0b0100'0000ull);
 		l2_config.mem_higher = &mm;
 		l2_config.mem_higher_port_offset = l2_index;
 		l2_config.mem_higher_port_stride = num_l2;
@@ -296,7 +345,37 @@ static void run_sim_trax(int argc, char* argv[])
 				simulator.register_unit(l1is.back());
 			}
 
-			rt_cores.push_back(_new  Units::UnitRTCore(256, num_tps_per_tm, (paddr_t)kernel_args.mesh.blas, (paddr_t)kernel_args.mesh.tris, l1ds.back()));
+			Units::UnitRTCore::Configuration rtc_config;
+			rtc_config.max_rays = 256;
+			rtc_config.num_clients = num_tps_per_tm;
+			rtc_config.num_box_piplines = 1;
+			rtc_config.box_pipline_latency = 3;
+			rtc_config.box_pipline_cpi = 1;
+			rtc_config.num_tri_piplines = 1;
+			rtc_config.tri_pipline_latency = 22;
+			rtc_config.tri_pipline_cpi = 4;
+			rtc_config.dispatch_width = 1;
+			rtc_config.bvh_width = rt_core_bvh_width;
+			rtc_config.quantized_nodes = rt_core_quantized_nodes;
+			rtc_config.box_decode_latency = 1;
+			rtc_config.ray_sort = Units::UnitRTCore::RaySort::NONE;
+			rtc_config.ray_sort_bins = 64;
+			rtc_config.ray_sort_node_shift = 0;
+			rtc_config.short_stack_size = rt_core_short_stack_size;
+			rtc_config.nodes_base_addr = rt_core_nodes;
+			rtc_config.triangles_base_addr = (paddr_t)kernel_args.mesh.tris;
+			rtc_config.cache = l1ds.back();
+
+			//short stacks get as many rays as fit in the storage of 256 full stack rays
+			if(rtc_config.short_stack_size)
+			{
+				Units::UnitRTCore::Configuration full_stack_config = rtc_config;
+				full_stack_config.short_stack_size = 0;
+				uint budget = rtc_config.max_rays * Units::UnitRTCore::ray_state_bytes(full_stack_config);
+				rtc_config.max_rays = std::min(budget / Units::UnitRTCore::ray_state_bytes(rtc_config), 0xfffeu);
+			}
+
+			rt_cores.push_back(_new  Units::UnitRTCore(rtc_config));
 			simulator.register_unit(rt_cores.back());
 
 			thread_schedulers.push_back(_new  Units::UnitThreadScheduler(num_tps_per_tm, tm_index, &atomic_regs, kernel_args.framebuffer_width, kernel_args.framebuffer_height, 8, 4));
@@ -334,6 +413,9 @@ static void run_sim_trax(int argc, char* argv[])
 			sfu_lists.emplace_back(sfu_list);
 			mem_lists.emplace_back(mem_list);
 
+			if(tp_profile && text_segment)
+				tp_profiles.emplace_back(text_segment->vaddr, text_segment->data.size());
+
 			for(uint tp_index = 0; tp_index < num_tps_per_tm; ++tp_index)
 			{
 				Units::UnitTP::Configuration tp_config;
@@ -342,13 +424,16 @@ static void run_sim_trax(int argc, char* argv[])
 				tp_config.pc = elf.elf_header->e_entry.u64;
 				tp_config.sp = 0x0;
 				tp_config.stack_size = stack_size;
+				tp_config.arena = &simulator.arena;
 				tp_config.cheat_memory = mm._data_u8;
+				if(!tp_profiles.empty()) tp_config.profile = &tp_profiles.back();
 				tp_config.inst_cache = nullptr; // l1is[uint(tm_index * num_icache_per_tm + tp_index / num_tps_per_i_cache)];
 				tp_config.num_tps_per_i_cache = num_tps_per_i_cache;
 				tp_config.unit_table = &unit_tables.back();
 				tp_config.unique_mems = &mem_lists.back();
 				tp_config.unique_sfus = &sfu_lists.back();
 				tp_config.num_threads = num_threads_per_tp;
+				tp_config.issue_width = issue_width;
 
 				tps.push_back(new Units::TRaX::UnitTP(tp_config));
 				simulator.register_unit(tps.back());
@@ -365,9 +450,11 @@ static void run_sim_trax(int argc, char* argv[])
 		duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
 	}
 
-	Units::UnitTP::Log tp_log(elf.segments[0]->vaddr);
+	Units::UnitTP::Log tp_log;
 	for(auto& tp : tps)
 		tp_log.accumulate(tp->log);
+	for(auto& profile : tp_profiles)
+		tp_log.accumulate(profile);
 
 	Units::UnitBlockingCache::Log i_l1_log;
 	for(auto& i_l1 : l1is)
@@ -381,7 +468,11 @@ static void run_sim_trax(int argc, char* argv[])
 	for(auto& l2 : l2s)
 		l2_log.accumulate(l2->log);
 
-	tp_log.print_profile(mm._data_u8);
+	Units::UnitRTCore::Log rtc_log;
+	for(auto& rtc : rt_cores)
+		rtc_log.accumulate(rtc->log);
+
+	if(!tp_profiles.empty()) tp_log.print_profile(mm._data_u8, stdout, &elf);
 
 	mm.print_usimm_stats(CACHE_BLOCK_SIZE, 4, simulator.current_cycle);
 
@@ -394,6 +485,9 @@ static void run_sim_trax(int argc, char* argv[])
 	printf("\nL1I$\n");
 	i_l1_log.print_log();
 
+	printf("\nRT Core\n");
+	rtc_log.print_log(stdout, rt_cores.size());
+
 	printf("\nTP\n");
 	tp_log.print_log();
 
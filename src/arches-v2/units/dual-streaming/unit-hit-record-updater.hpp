@@ -43,6 +43,7 @@ public:
 		uint associativity;
 
 		uint num_tms;
+		uint num_channels;
 
 		UnitMainMemoryBase* main_mem;
 		uint                main_mem_port_offset{ 0 };
@@ -247,8 +248,8 @@ private:
 	void issue_returns(uint channel_index);
 
 public:
-	UnitHitRecordUpdater(Configuration config) : request_network(config.num_tms, NUM_DRAM_CHANNELS, config.hit_record_start), main_memory(config.main_mem), return_network(config.num_tms), main_mem_port_offset(config.main_mem_port_offset), main_mem_port_stride(config.main_mem_port_stride), hit_record_start_address(config.hit_record_start){
-		for (int i = 0; i < NUM_DRAM_CHANNELS; i++) {
+	UnitHitRecordUpdater(Configuration config) : request_network(config.num_tms, config.num_channels, config.hit_record_start), main_memory(config.main_mem), return_network(config.num_tms), main_mem_port_offset(config.main_mem_port_offset), main_mem_port_stride(config.main_mem_port_stride), hit_record_start_address(config.hit_record_start){
+		for (uint i = 0; i < config.num_channels; i++) {
 			channels.push_back({ HitRecordCache(config.cache_size, config.associativity) });
 
 		}
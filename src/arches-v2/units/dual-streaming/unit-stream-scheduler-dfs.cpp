@@ -22,7 +22,7 @@ void UnitStreamSchedulerDFS::_update_scheduler() {
 
 		//if there is no state entry initilize it
 		if (state.total_buckets == 0)
-			_scheduler.segment_state_map[segment_index].next_channel = segment_index % NUM_DRAM_CHANNELS;
+			_scheduler.segment_state_map[segment_index].next_channel = segment_index % _channels.size();
 
 		//increment total buckets
 		state.total_buckets++;
@@ -246,7 +246,7 @@ void UnitStreamSchedulerDFS::_update_scheduler() {
 		Channel& channel = _channels[channel_index];
 		channel.work_queue.push(channel_work_item);
 
-		if (++state.next_channel >= NUM_DRAM_CHANNELS)
+		if (++state.next_channel >= _channels.size())
 			state.next_channel = 0;
 	}
 }
@@ -53,6 +53,7 @@ public:
 		uint num_root_rays;
 		uint num_tms;
 		uint num_banks;
+		uint num_channels;
 
 		uint traversal_scheme = 1; // 0-bfs, 1-dfs
 
@@ -98,8 +99,17 @@ private:
 	{
 	private:
 		paddr_t next_bucket_addr;
+		uint channel_index;
 		std::stack<paddr_t> free_buckets;
 
+		//buckets are packed into whole rows so the first row at or after paddr that maps to our channel
+		paddr_t _next_row(paddr_t paddr)
+		{
+			while ((uint)calcDramAddr(paddr).channel != channel_index)
+				paddr += ROW_BUFFER_SIZE;
+			return paddr;
+		}
+
 	public:
 		paddr_t alloc_bucket()
 		{
@@ -114,7 +124,7 @@ private:
 
 			next_bucket_addr += RAY_BUCKET_SIZE;
 			if ((next_bucket_addr % ROW_BUFFER_SIZE) == 0)
-				next_bucket_addr += (NUM_DRAM_CHANNELS - 1) * ROW_BUFFER_SIZE;
+				next_bucket_addr = _next_row(next_bucket_addr);
 
 			return bucket_address;
 		}
@@ -124,11 +134,9 @@ private:
 			free_buckets.push(bucket_address);
 		}
 
-		MemoryManager(uint channel_index, paddr_t start_address)
+		MemoryManager(uint channel_index, paddr_t start_address) : channel_index(channel_index)
 		{
-			next_bucket_addr = align_to(ROW_BUFFER_SIZE, start_address);
-			while ((next_bucket_addr / ROW_BUFFER_SIZE) % NUM_DRAM_CHANNELS != channel_index)
-				next_bucket_addr += ROW_BUFFER_SIZE;
+			next_bucket_addr = _next_row(align_to(ROW_BUFFER_SIZE, start_address));
 		}
 	};
 
@@ -179,7 +187,7 @@ private:
 
 		Scheduler(const Configuration& config) : bucket_write_cascade(config.num_banks, 1), last_segment_on_tm(config.num_tms, ~0u), num_root_rays(config.num_root_rays), traversal_scheme(config.traversal_scheme)
 		{
-			for (uint i = 0; i < NUM_DRAM_CHANNELS; ++i)
+			for (uint i = 0; i < config.num_channels; ++i)
 				memory_managers.emplace_back(i, config.heap_addr);
 
 			SegmentState& segment_state = segment_state_map[0];
@@ -248,7 +256,7 @@ private:
 	UnitMemoryBase::ReturnCrossBar _return_network;
 
 public:
-	UnitStreamSchedulerDFS(const Configuration& config) :_request_network(config.num_tms, config.num_banks), _banks(config.num_banks), _scheduler(config), _channels(NUM_DRAM_CHANNELS), _return_network(config.num_tms, NUM_DRAM_CHANNELS, NUM_DRAM_CHANNELS)
+	UnitStreamSchedulerDFS(const Configuration& config) :_request_network(config.num_tms, config.num_banks), _banks(config.num_banks), _scheduler(config), _channels(config.num_channels), _return_network(config.num_tms, config.num_channels, config.num_channels)
 	{
 		_main_mem = config.main_mem;
 		_main_mem_port_offset = config.main_mem_port_offset;
@@ -10,7 +10,7 @@ class UnitTP : public Arches::Units::UnitTP
 public:
 	UnitTP(Units::UnitTP::Configuration config) : Units::UnitTP(config) {}
 
-private:
+protected:
 	uint8_t _check_dependancies(uint thread_id) override
 	{
 		ThreadData& thread = _thread_data[thread_id];
@@ -0,0 +1,275 @@
+#include "unit-analytical-dram.hpp"
+#include "unit-dram.hpp"
+
+#include "USIMM/usimm.h"
+#include "USIMM/params.h"
+
+namespace Arches { namespace Units {
+
+UnitAnalyticalDRAM::UnitAnalyticalDRAM(uint num_ports, uint64_t size, Simulator*, bool use_huge_pages) : UnitMainMemoryBase(size, use_huge_pages),
+	_request_network(num_ports, UnitDRAM::init_usimm()), _return_network(num_ports)
+{
+	//we only use usimm to load the timing parameters and address mapping. usimmClock is never called
+	//a row holds ROW_BUFFER_SIZE bytes so row hits in this model line up with the row buffer size the rest of the sim assumes
+	assert(NUM_COLUMNS * CACHE_LINE_SIZE == ROW_BUFFER_SIZE);
+
+	_channels.resize(numDramChannels());
+	for(Channel& channel : _channels)
+	{
+		channel.banks.resize(NUM_RANKS * NUM_BANKS);
+		channel.ranks.resize(NUM_RANKS);
+		for(Rank& rank : channel.ranks)
+			rank.next_refresh = T_REFI;
+	}
+
+	_schedule_window = T_RP + T_RCD + T_CAS;
+}
+
+UnitAnalyticalDRAM::~UnitAnalyticalDRAM() /*override*/
+{
+	UnitDRAM::destroy_usimm();
+}
+
+bool UnitAnalyticalDRAM::request_port_write_valid(uint port_index)
+{
+	return _request_network.is_write_valid(port_index);
+}
+
+void UnitAnalyticalDRAM::write_request(const MemoryRequest& request)
+{
+	_request_network.write(request, request.port);
+}
+
+bool UnitAnalyticalDRAM::return_port_read_valid(uint port_index)
+{
+	return _return_network.is_read_valid(port_index);
+}
+
+const MemoryReturn& UnitAnalyticalDRAM::peek_return(uint port_index)
+{
+	return _return_network.peek(port_index);
+}
+
+const MemoryReturn UnitAnalyticalDRAM::read_return(uint port_index)
+{
+	return _return_network.read(port_index);
+}
+
+//All bank refresh every T_REFI. The rank's banks are precharged first and can't activate until T_RFC later. Refreshes are
+//applied when a request for the rank is picked so an activate scheduled past the next refresh does not see it.
+void UnitAnalyticalDRAM::_refresh(Channel& channel, uint rank_index, cycles_t now)
+{
+	Rank& rank = channel.ranks[rank_index];
+	while(rank.next_refresh <= now)
+	{
+		cycles_t start = rank.next_refresh;
+		for(uint i = 0; i < (uint)NUM_BANKS; ++i)
+		{
+			const Bank& bank = channel.banks[rank_index * NUM_BANKS + i];
+			if(bank.open_row != ~0ull) start = std::max(start, bank.pre_ready + T_RP);
+		}
+
+		for(uint i = 0; i < (uint)NUM_BANKS; ++i)
+		{
+			Bank& bank = channel.banks[rank_index * NUM_BANKS + i];
+			bank.open_row = ~0ull;
+			bank.act_ready = std::max(bank.act_ready, start + T_RFC);
+		}
+
+		rank.next_refresh += T_REFI;
+		log._refreshes++;
+	}
+}
+
+//Open page. Power down is not modeled.
+void UnitAnalyticalDRAM::_access(Channel& channel, const QueuedRequest& request, bool is_load, cycles_t now)
+{
+	_refresh(channel, request.rank, now);
+
+	Bank& bank = channel.banks[request.rank * NUM_BANKS + request.bank];
+	Rank& rank = channel.ranks[request.rank];
+
+	cycles_t cas;
+	if(bank.open_row == request.row)
+	{
+		cas = std::max(now, bank.col_ready);
+		log._row_hits++;
+	}
+	else
+	{
+		cycles_t act;
+		if(bank.open_row == ~0ull)
+		{
+			act = std::max(now, bank.act_ready);
+			log._row_empty++;
+		}
+		else
+		{
+			cycles_t pre = std::max(now, bank.pre_ready);
+			act = std::max(pre + T_RP, bank.act_ready);
+			log._row_misses++;
+		}
+
+		//at most one activate per T_RRD and four per T_FAW in a rank
+		act = std::max(act, rank.act_window[(rank.act_index + 3) % 4] + T_RRD);
+		act = std::max(act, rank.act_window[rank.act_index] + T_FAW);
+		rank.act_window[rank.act_index] = act;
+		rank.act_index = (rank.act_index + 1) % 4;
+
+		cas = act + T_RCD;
+		bank.open_row = request.row;
+		bank.act_ready = act + T_RC;
+		bank.pre_ready = act + T_RAS;
+	}
+
+	if(is_load) cas = std::max(cas, channel.last_write_data + T_WTR);
+
+	//the data bus is shared by all banks in the channel. If it is busy the column command slides back to line up with it
+	cycles_t cas_to_data = is_load ? T_CAS : T_CWD;
+	cycles_t data = std::max(cas + cas_to_data, channel.bus_free);
+	cas = data - cas_to_data;
+
+	channel.bus_free = data + T_DATA_TRANS;
+	bank.col_ready = cas + T_CCD;
+
+	if(is_load)
+	{
+		bank.pre_ready = std::max(bank.pre_ready, cas + T_RTP);
+
+		cycles_t return_cycle = (data + T_DATA_TRANS + DRAM_CLOCK_MULTIPLIER - 1) / DRAM_CLOCK_MULTIPLIER;
+		channel.return_queue.push({return_cycle, request.ret});
+
+		log._loads++;
+		log._total_load_latency += return_cycle - request.arrival_cycle;
+	}
+	else
+	{
+		bank.pre_ready = std::max(bank.pre_ready, data + T_DATA_TRANS + T_WR);
+		channel.last_write_data = data + T_DATA_TRANS;
+		log._stores++;
+	}
+}
+
+bool UnitAnalyticalDRAM::_enqueue(const MemoryRequest& request, uint channel_index)
+{
+	Channel& channel = _channels[channel_index];
+	bool is_load = request.type == MemoryRequest::Type::LOAD;
+	std::vector<QueuedRequest>& queue = is_load ? channel.read_queue : channel.write_queue;
+	if(queue.size() >= (is_load ? (size_t)MAX_QUEUE_LENGTH : (size_t)WQ_CAPACITY))
+	{
+		log._queue_full_stalls++;
+		return false;
+	}
+
+	dram_address_t const dram_addr = calcDramAddr(request.paddr);
+	assert((uint)dram_addr.channel == channel_index);
+
+	//Masked write. Stores are applied when they arrive, the same way loads copy their data, so results don't depend on the
+	//order requests are picked in
+	if(!is_load)
+		for(uint i = 0; i < request.size; ++i)
+			if((request.write_mask >> i) & 0x1)
+				_data_u8[request.paddr + i] = request.data[i];
+
+	queue.push_back({(uint)dram_addr.rank, (uint)dram_addr.bank, (uint64_t)dram_addr.row, _current_cycle, MemoryReturn(request, _data_u8 + request.paddr)});
+	return true;
+}
+
+//Picks requests the way usimm's scheduler does. A write drain starts once the write queue passes WQ_HI_WM, or when no reads
+//are waiting, and keeps going until it is back down to WQ_LO_WM. Within a queue the oldest row hit goes first, otherwise the
+//request whose bank can activate soonest, oldest first, like usimm issuing the first ready command.
+void UnitAnalyticalDRAM::_schedule(uint channel_index)
+{
+	Channel& channel = _channels[channel_index];
+	cycles_t now = _current_cycle * DRAM_CLOCK_MULTIPLIER;
+	while(channel.bus_free <= now + _schedule_window)
+	{
+		bool was_draining = channel.draining_writes;
+		channel.draining_writes = (was_draining && channel.write_queue.size() > (size_t)WQ_LO_WM) ||
+			channel.write_queue.size() > (size_t)WQ_HI_WM || channel.read_queue.empty();
+		if(channel.draining_writes && !was_draining && !channel.write_queue.empty())
+			log._write_drains++;
+
+		std::vector<QueuedRequest>& queue = channel.draining_writes ? channel.write_queue : channel.read_queue;
+		if(queue.empty()) break;
+
+		uint pick = 0;
+		cycles_t pick_ready = 0;
+		for(uint i = 0; i < queue.size(); ++i)
+		{
+			const Bank& bank = channel.banks[queue[i].rank * NUM_BANKS + queue[i].bank];
+			if(bank.open_row == queue[i].row)
+			{
+				pick = i;
+				break;
+			}
+
+			cycles_t act_ready = bank.open_row == ~0ull ? bank.act_ready : std::max(bank.pre_ready + T_RP, bank.act_ready);
+			act_ready = std::max(act_ready, now);
+			if(i == 0 || act_ready < pick_ready)
+			{
+				pick = i;
+				pick_ready = act_ready;
+			}
+		}
+
+		_access(channel, queue[pick], !channel.draining_writes, now);
+		queue.erase(queue.begin() + pick);
+	}
+}
+
+void UnitAnalyticalDRAM::clock_rise()
+{
+	_request_network.clock();
+
+	for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
+	{
+		if(_request_network.is_read_valid(channel_index))
+		{
+			if(_enqueue(_request_network.peek(channel_index), channel_index))
+				_request_network.read(channel_index);
+
+			if(!_busy)
+			{
+				_busy = true;
+				simulator->units_executing++;
+			}
+		}
+
+		_schedule(channel_index);
+	}
+}
+
+void UnitAnalyticalDRAM::clock_fall()
+{
+	++_current_cycle;
+
+	bool busy = false;
+	for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
+	{
+		Channel& channel = _channels[channel_index];
+		if(!channel.return_queue.empty())
+		{
+			const PendingReturn& pending_return = channel.return_queue.top();
+			if(_current_cycle >= pending_return.return_cycle && _return_network.is_write_valid(pending_return.ret.port))
+			{
+				_return_network.write(pending_return.ret, pending_return.ret.port);
+				channel.return_queue.pop();
+			}
+		}
+
+		if(!channel.read_queue.empty() || !channel.write_queue.empty() || !channel.return_queue.empty() ||
+			channel.bus_free > _current_cycle * DRAM_CLOCK_MULTIPLIER)
+			busy = true;
+	}
+
+	if(_busy && !busy)
+	{
+		_busy = false;
+		simulator->units_executing--;
+	}
+
+	_return_network.clock();
+}
+
+}}
@@ -0,0 +1,152 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "USIMM/memory_controller.h"
+
+#include "unit-base.hpp"
+#include "unit-main-memory-base.hpp"
+#include "util/arbitration.hpp"
+
+namespace Arches { namespace Units {
+
+//Fast alternative to UnitDRAM for design space exploration. Requests wait in per channel read and write queues like usimm's, but
+//instead of simulating every DRAM command a request is timed once, when it is picked, using per bank open row/ready times and a per
+//channel data bus. Timing parameters, queue sizes, the write drain watermarks and the address mapping are read from the same usimm
+//config files as UnitDRAM so the two models see the same channels, banks and rows. Requests are picked FR-FCFS, row hits first.
+//Writes are buffered and drained in batches once the write queue passes WQ_HI_WM until it is back to WQ_LO_WM, or when no reads are
+//waiting. Activates obey tRRD/tFAW and each rank does an all bank refresh every tREFI. usimm's other read scheduling policies are not
+//modeled.
+class UnitAnalyticalDRAM : public UnitMainMemoryBase
+{
+private:
+	struct PendingReturn
+	{
+		cycles_t return_cycle;
+		MemoryReturn ret;
+
+		friend bool operator<(const PendingReturn& l, const PendingReturn& r)
+		{
+			return l.return_cycle > r.return_cycle;
+		}
+	};
+
+	struct QueuedRequest
+	{
+		uint rank;
+		uint bank;
+		uint64_t row;
+		cycles_t arrival_cycle;
+		MemoryReturn ret; //loads read memory when they arrive so later stores don't change the result
+	};
+
+	//all times are in dram cycles
+	struct Bank
+	{
+		uint64_t open_row{~0ull};
+		cycles_t col_ready{0}; //earliest next column command
+		cycles_t pre_ready{0}; //earliest next precharge
+		cycles_t act_ready{0}; //earliest next activate
+	};
+
+	//activate window for tRRD/tFAW and the next all bank refresh
+	struct Rank
+	{
+		cycles_t act_window[4]{0, 0, 0, 0}; //last four activates, oldest at act_index
+		uint act_index{0};
+		cycles_t next_refresh{0};
+	};
+
+	struct Channel
+	{
+		//both in arrival order
+		std::vector<QueuedRequest> read_queue;
+		std::vector<QueuedRequest> write_queue;
+		bool draining_writes{false};
+
+		std::vector<Bank> banks;
+		std::vector<Rank> ranks;
+		cycles_t bus_free{0};
+		cycles_t last_write_data{0};
+		std::priority_queue<PendingReturn> return_queue;
+	};
+
+	bool _busy{false};
+
+	std::vector<Channel> _channels;
+	Casscade<MemoryRequest> _request_network;
+	FIFOArray<MemoryReturn> _return_network;
+	cycles_t _current_cycle{0};
+
+	//requests are picked once the data bus is free within this many dram cycles, the latency of a row miss. Picking later would
+	//leave the bus idle behind misses, picking earlier would give up reordering
+	cycles_t _schedule_window;
+
+public:
+	UnitAnalyticalDRAM(uint num_clients, uint64_t size, Simulator* simulator, bool use_huge_pages = false);
+	virtual ~UnitAnalyticalDRAM() override;
+
+	bool request_port_write_valid(uint port_index) override;
+	void write_request(const MemoryRequest& request) override;
+
+	bool return_port_read_valid(uint port_index) override;
+	const MemoryReturn& peek_return(uint port_index) override;
+	const MemoryReturn read_return(uint port_index) override;
+
+	void clock_rise() override;
+	void clock_fall() override;
+
+private:
+	bool _enqueue(const MemoryRequest& request, uint channel_index);
+	void _schedule(uint channel_index);
+	void _access(Channel& channel, const QueuedRequest& request, bool is_load, cycles_t now);
+	void _refresh(Channel& channel, uint rank_index, cycles_t now);
+
+public:
+	class Log
+	{
+	public:
+		uint64_t _loads;
+		uint64_t _stores;
+		uint64_t _row_hits;
+		uint64_t _row_misses;
+		uint64_t _row_empty;
+		uint64_t _refreshes;
+		uint64_t _write_drains;
+		uint64_t _queue_full_stalls;
+		uint64_t _total_load_latency;
+
+		Log() { reset(); }
+
+		void reset()
+		{
+			_loads = 0;
+			_stores = 0;
+			_row_hits = 0;
+			_row_misses = 0;
+			_row_empty = 0;
+			_refreshes = 0;
+			_write_drains = 0;
+			_queue_full_stalls = 0;
+			_total_load_latency = 0;
+		}
+
+		void print_log(FILE* stream = stdout)
+		{
+			auto ratio = [](float num, uint64_t den) { return den ? num / den : 0.0f; };
+			uint64_t total = _loads + _stores;
+
+			fprintf(stream, "Total: %lld\n", total);
+			fprintf(stream, "Loads: %lld\n", _loads);
+			fprintf(stream, "Stores: %lld\n", _stores);
+			fprintf(stream, "Row Hits: %lld(%.2f%%)\n", _row_hits, ratio(100.0f * _row_hits, total));
+			fprintf(stream, "Row Misses: %lld(%.2f%%)\n", _row_misses, ratio(100.0f * _row_misses, total));
+			fprintf(stream, "Row Empty: %lld(%.2f%%)\n", _row_empty, ratio(100.0f * _row_empty, total));
+			fprintf(stream, "Refreshes: %lld\n", _refreshes);
+			fprintf(stream, "Write Drains: %lld\n", _write_drains);
+			fprintf(stream, "Queue Full Stalls: %lld\n", _queue_full_stalls);
+			fprintf(stream, "Average Load Latency: %.2f\n", ratio((float)_total_load_latency, _loads));
+		}
+	}log;
+};
+
+}}
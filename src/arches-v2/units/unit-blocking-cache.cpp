@@ -4,7 +4,7 @@ namespace Arches {namespace Units {
 
 UnitBlockingCache::UnitBlockingCache(Configuration config) : 
 	UnitCacheBase(config.size, config.associativity),
-	_request_cross_bar(config.num_ports, config.num_banks, config.cross_bar_width, config.bank_select_mask),
+	_request_cross_bar(config.num_ports, config.num_banks, config.cross_bar_width, config.bank_select_mask, config.bank_select_hash),
 	_return_cross_bar(config.num_ports, config.num_banks, config.cross_bar_width),
 	_banks(config.num_banks, {config.latency, config.cycle_time})
 {
@@ -20,6 +20,7 @@ public:
 		uint num_banks{1};
 		uint cross_bar_width{1};
 		uint64_t bank_select_mask{0};
+		std::vector<uint64_t> bank_select_hash{}; //if set bank bit i is the parity of the address bits in bank_select_hash[i] instead of using bank_select_mask
 
 		UnitMemoryBase* mem_higher{nullptr};
 		uint            mem_higher_port_offset{0};
@@ -6,23 +6,119 @@ namespace Arches { namespace Units {
 
 #define ENABLE_DRAM_DEBUG_PRINTS 0
 
-UnitDRAM::UnitDRAM(uint num_ports, uint64_t size, Simulator* simulator) : UnitMainMemoryBase(size),
-	_request_network(num_ports, NUM_DRAM_CHANNELS), _return_network(num_ports)
+#ifndef _DEBUG
+#define DRAM_USE_TBB
+#endif
+
+static bool usimm_initialized = false;
+
+uint UnitDRAM::init_usimm(const std::string& config_file)
+{
+	if(!usimm_initialized)
+	{
+		std::string usimm_config_path = REL_PATH_BIN_TO_SAMPLES + config_file;
+		char* usimm_config_file = (char*)usimm_config_path.c_str();
+		char* usimm_vi_file = (char*)REL_PATH_BIN_TO_SAMPLES"1Gb_x16_amd2GHz.vi";
+		if (usimm_setup(usimm_config_file, usimm_vi_file) < 0) assert(false); //usimm faild to initilize
+		usimm_initialized = true;
+	}
+
+	assert(numDramChannels() <= MAX_NUM_CHANNELS);
+	return numDramChannels();
+}
+
+void UnitDRAM::destroy_usimm()
 {
-	char* usimm_config_file = (char*)REL_PATH_BIN_TO_SAMPLES"gddr5_16ch.cfg";
-	char* usimm_vi_file = (char*)REL_PATH_BIN_TO_SAMPLES"1Gb_x16_amd2GHz.vi";
-	if (usimm_setup(usimm_config_file, usimm_vi_file) < 0) assert(false); //usimm faild to initilize
+	if(!usimm_initialized) return;
 
-	assert(numDramChannels() == NUM_DRAM_CHANNELS);
+	usimmDestroy();
+	usimm_initialized = false;
+}
+
+std::vector<uint64_t> UnitDRAM::bank_select_hash(uint64_t low_bits_mask)
+{
+	init_usimm();
+
+	std::vector<uint64_t> hash;
+	for(; low_bits_mask; low_bits_mask &= low_bits_mask - 1)
+		hash.push_back(low_bits_mask & ~(low_bits_mask - 1));
+
+	for(uint64_t channel_mask : dramChannelHash())
+		hash.push_back(channel_mask);
+
+	return hash;
+}
 
+UnitDRAM::UnitDRAM(uint num_ports, uint64_t size, Simulator* simulator, bool use_huge_pages) : UnitMainMemoryBase(size, use_huge_pages),
+	_request_network(num_ports, init_usimm()), _return_network(num_ports), _priority_ports(num_ports, false), _port_requester(num_ports, 0)
+{
 	_channels.resize(numDramChannels());
+	_requesters.push_back({"Other"});
 
 	registerUsimmListener(this);
 }
 
 UnitDRAM::~UnitDRAM() /*override*/
 {
-	usimmDestroy();
+	delete _trace_writer;
+	destroy_usimm();
+}
+
+void UnitDRAM::record_trace(const std::string& trace_path)
+{
+	delete _trace_writer;
+	_trace_writer = new Util::DRAMTraceWriter(trace_path);
+}
+
+cycles_t UnitDRAM::replay_trace(const std::string& trace_path, const std::vector<bool>& priority_ports)
+{
+	uint num_channels = init_usimm();
+	registerUsimmListener(nullptr); //nothing to return to, usimm keeps its own latency stats
+
+	Util::DRAMTraceReader reader(trace_path);
+	Util::DRAMTraceRecord record;
+	bool has_record = reader.read(record);
+
+	std::vector<std::queue<Util::DRAMTraceRecord>> channel_queues(num_channels);
+	uint queued_records = 0;
+
+	cycles_t cycle = 0;
+	while(has_record || queued_records || usimmIsBusy())
+	{
+		for(; has_record && record.cycle <= cycle; has_record = reader.read(record))
+		{
+			channel_queues[calcDramAddr(record.paddr).channel].push(record);
+			queued_records++;
+		}
+
+		for(uint channel_index = 0; channel_index < num_channels; ++channel_index)
+		{
+			std::queue<Util::DRAMTraceRecord>& queue = channel_queues[channel_index];
+			if(queue.empty()) continue;
+
+			const Util::DRAMTraceRecord& head = queue.front();
+			arches_request_t arches_request;
+			arches_request.channel = channel_index;
+			arches_request.return_id = ~0u;
+			arches_request.priority = head.port < priority_ports.size() && priority_ports[head.port];
+			assert(head.requester < MAX_NUM_REQUESTERS);
+			arches_request.requester = head.requester;
+
+			dram_address_t const dram_addr = calcDramAddr(head.paddr);
+			reqInsertRet_t reqRet = head.store ? insert_write(dram_addr, arches_request, cycle * DRAM_CLOCK_MULTIPLIER) : insert_read(dram_addr, arches_request, cycle * DRAM_CLOCK_MULTIPLIER);
+			if(reqRet.retType == reqInsertRet_tt::RRT_READ_QUEUE_FULL || reqRet.retType == reqInsertRet_tt::RRT_WRITE_QUEUE_FULL) continue;
+
+			queue.pop();
+			queued_records--;
+		}
+
+		for(uint i = 0; i < DRAM_CLOCK_MULTIPLIER; ++i)
+			usimmClock();
+
+		++cycle;
+	}
+
+	return cycle;
 }
 
 bool UnitDRAM::request_port_write_valid(uint port_index)
@@ -50,6 +146,61 @@ const MemoryReturn UnitDRAM::read_return(uint port_index)
 	return _return_network.read(port_index);
 }
 
+void UnitDRAM::set_priority_ports(uint offset, uint stride)
+{
+	for(uint i = offset; i < _priority_ports.size(); i += stride)
+		_priority_ports[i] = true;
+}
+
+uint UnitDRAM::add_requester(const std::string& name, uint offset, uint stride)
+{
+	uint requester_index = _requesters.size();
+	assert(requester_index < MAX_NUM_REQUESTERS);
+	_requesters.push_back({name});
+
+	for(uint i = offset; i < _port_requester.size(); i += stride)
+		_port_requester[i] = requester_index;
+
+	return requester_index;
+}
+
+void UnitDRAM::print_requester_stats(FILE* stream)
+{
+	uint64_t total_bytes = 0;
+	for(const Requester& requester : _requesters)
+		total_bytes += requester.bytes_read + requester.bytes_written;
+
+	double total_energy = getUsimmEnergy();
+	double command_energy = 0.0;
+
+	fprintf(stream, "\nDRAM Requesters\n");
+	for(uint i = 0; i < _requesters.size(); ++i)
+	{
+		const Requester& requester = _requesters[i];
+		uint64_t bytes = requester.bytes_read + requester.bytes_written;
+
+		uint64_t col_cmds = 0, row_hits = 0;
+		for(uint c = 0; c < _channels.size(); ++c)
+		{
+			col_cmds += stats_requester_reads[c][i] + stats_requester_writes[c][i];
+			row_hits += stats_requester_row_hits[c][i];
+		}
+
+		double energy = getUsimmRequesterEnergy(i);
+		command_energy += energy;
+
+		fprintf(stream, "%s\n", requester.name.c_str());
+		fprintf(stream, "\tBytes Read: %lld\n", requester.bytes_read);
+		fprintf(stream, "\tBytes Written: %lld\n", requester.bytes_written);
+		fprintf(stream, "\tBandwidth Share: %.2f%%\n", total_bytes ? 100.0 * bytes / total_bytes : 0.0);
+		fprintf(stream, "\tRow Hit Rate: %.2f%%\n", col_cmds ? 100.0 * row_hits / col_cmds : 0.0);
+		fprintf(stream, "\tAverage Load Latency: %.2f\n", requester.loads ? (double)requester.total_load_latency / requester.loads : 0.0);
+		fprintf(stream, "\tCommand Energy: %.2fuJ(%.2f%%)\n", energy / 1000.0, total_energy > 0.0 ? 100.0 * energy / total_energy : 0.0);
+	}
+
+	fprintf(stream, "Background Energy: %.2fuJ(%.2f%%)\n", (total_energy - command_energy) / 1000.0, total_energy > 0.0 ? 100.0 * (total_energy - command_energy) / total_energy : 0.0);
+}
+
 bool UnitDRAM::usimm_busy() {
 	return usimmIsBusy();
 }
@@ -68,7 +219,7 @@ float UnitDRAM::total_power_in_watts()
 
 void UnitDRAM::UsimmNotifyEvent(cycles_t write_cycle, const arches_request_t& req)
 {
-	_channels[req.channel].return_queue.push({write_cycle, req});
+	_channels[req.channel].return_wheel.push(write_cycle, req);
 }
 
 
@@ -85,10 +236,13 @@ bool UnitDRAM::_load(const MemoryRequest& request, uint channel_index)
 
 	arches_request_t arches_request;
 	arches_request.channel = dram_addr.channel;
+	arches_request.priority = _priority_ports[request.port];
+	arches_request.requester = _port_requester[request.port];
 	if(free_return_ids.empty())
 	{
 		arches_request.return_id = returns.size();
 		returns.emplace_back();
+		_return_accept_cycle.emplace_back();
 	}
 	else
 	{
@@ -104,12 +258,13 @@ bool UnitDRAM::_load(const MemoryRequest& request, uint channel_index)
 
 	MemoryReturn& ret = returns[arches_request.return_id];
 	ret = MemoryReturn(request, _data_u8 + request.paddr);
+	_return_accept_cycle[arches_request.return_id] = _current_cycle;
 
 	assert(reqRet.retType == reqInsertRet_tt::RRT_WRITE_QUEUE || reqRet.retType == reqInsertRet_tt::RRT_READ_QUEUE);
 
 	if (reqRet.retLatencyKnown)
 	{
-		_channels[dram_addr.channel].return_queue.push({(Arches::cycles_t)reqRet.completionTime / DRAM_CLOCK_MULTIPLIER, arches_request});
+		_channels[dram_addr.channel].return_wheel.push((Arches::cycles_t)reqRet.completionTime / DRAM_CLOCK_MULTIPLIER, arches_request);
 	}
 
 	return true;
@@ -128,6 +283,8 @@ bool UnitDRAM::_store(const MemoryRequest& request, uint channel_index)
 	arches_request_t arches_request;
 	arches_request.channel = dram_addr.channel;
 	arches_request.return_id = ~0;
+	arches_request.priority = _priority_ports[request.port];
+	arches_request.requester = _port_requester[request.port];
 
 	reqInsertRet_t reqRet = insert_write(dram_addr, arches_request, _current_cycle * DRAM_CLOCK_MULTIPLIER);
 	if(reqRet.retType == reqInsertRet_tt::RRT_WRITE_QUEUE_FULL)
@@ -156,15 +313,21 @@ void UnitDRAM::clock_rise()
 
 		const MemoryRequest& request = _request_network.peek(channel_index);
 
+		bool accepted = false;
 		if(request.type == MemoryRequest::Type::STORE)
-		{
-			if(_store(request, channel_index))
-				_request_network.read(channel_index);
-		}
+			accepted = _store(request, channel_index);
 		else if(request.type == MemoryRequest::Type::LOAD)
+			accepted = _load(request, channel_index);
+
+		if(accepted)
 		{
-			if(_load(request, channel_index))
-				_request_network.read(channel_index);
+			Requester& requester = _requesters[_port_requester[request.port]];
+			if(request.type == MemoryRequest::Type::STORE) requester.bytes_written += request.size;
+			else                                           requester.bytes_read += request.size;
+
+			static_assert(sizeof(request.size) <= sizeof(Util::DRAMTraceRecord::size), "request size does not fit the dram trace");
+			if(_trace_writer) _trace_writer->write({_current_cycle, request.paddr, request.port, request.size, _port_requester[request.port], request.type == MemoryRequest::Type::STORE});
+			_request_network.read(channel_index);
 		}
 
 		if(!_busy)
@@ -177,8 +340,21 @@ void UnitDRAM::clock_rise()
 
 void UnitDRAM::clock_fall()
 {
+	//channels are independent so we can update their timing in parallel. All channels must finish a dram cycle before the next one starts
 	for(uint i = 0; i < DRAM_CLOCK_MULTIPLIER; ++i)
-		usimmClock();
+	{
+#ifdef DRAM_USE_TBB
+		tbb::parallel_for(tbb::blocked_range<uint>(0, _channels.size(), 1), [&](tbb::blocked_range<uint> r)
+		{
+			for(uint channel_index = r.begin(); channel_index < r.end(); ++channel_index)
+				usimmClockChannel(channel_index);
+		});
+#else
+		for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
+			usimmClockChannel(channel_index);
+#endif
+		usimmAdvanceClock();
+	}
 
 	if(_busy && !usimmIsBusy())
 	{
@@ -190,18 +366,22 @@ void UnitDRAM::clock_fall()
 	for(uint channel_index = 0; channel_index < _channels.size(); ++channel_index)
 	{
 		Channel& channel = _channels[channel_index];
-		if(!channel.return_queue.empty())
+		const arches_request_t* usimm_return = channel.return_wheel.peek(_current_cycle);
+		if(usimm_return)
 		{
-			const USIMMReturn& usimm_return = channel.return_queue.top();
-			const MemoryReturn& ret = returns[usimm_return.req.return_id];
-			if(_current_cycle >= usimm_return.return_cycle && _return_network.is_write_valid(ret.port))
+			const MemoryReturn& ret = returns[usimm_return->return_id];
+			if(_return_network.is_write_valid(ret.port))
 			{
 #if ENABLE_DRAM_DEBUG_PRINTS
 				printf("Load Return(%d): 0x%llx\n", ret.port, ret.paddr);
 #endif
+				Requester& requester = _requesters[_port_requester[ret.port]];
+				requester.loads++;
+				requester.total_load_latency += _current_cycle - _return_accept_cycle[usimm_return->return_id];
+
 				_return_network.write(ret, ret.port);
-				free_return_ids.push(usimm_return.req.return_id);
-				channel.return_queue.pop();
+				free_return_ids.push(usimm_return->return_id);
+				channel.return_wheel.pop();
 			}
 		}
 	}
@@ -6,28 +6,99 @@
 #include "unit-base.hpp"
 #include "unit-main-memory-base.hpp"
 #include "util/arbitration.hpp"
+#include "util/dram-trace.hpp"
 
 namespace Arches { namespace Units {
 
-#define NUM_DRAM_CHANNELS (16)
-
 class UnitDRAM : public UnitMainMemoryBase, public UsimmListener
 {
 private:
-	struct USIMMReturn
+	//Calendar queue of usimm returns. Slot i holds the returns due on cycles congruent to i modulo the number of slots.
+	//Read latency is bounded once usimm knows it so returns are never far in the future and push/pop are O(1).
+	//The wheel only grows if a return lands past the horizon.
+	class ReturnWheel
 	{
-		cycles_t return_cycle;
-		arches_request_t req;
+	private:
+		struct Slot
+		{
+			std::vector<arches_request_t> reqs;
+			uint head{0};
+
+			bool empty() const { return head == reqs.size(); }
+		};
+
+		std::vector<Slot> _slots;
+		uint64_t _slot_mask;
+		cycles_t _next_cycle{0}; //earliest cycle that can still have returns
+		uint _size{0};
+
+		void _grow(cycles_t return_cycle)
+		{
+			uint num_slots = _slots.size();
+			while((uint64_t)(return_cycle - _next_cycle) >= num_slots) num_slots *= 2;
+
+			std::vector<Slot> slots(num_slots);
+			for(cycles_t cycle = _next_cycle; cycle < _next_cycle + (cycles_t)_slots.size(); ++cycle)
+			{
+				Slot& slot = _slots[cycle & _slot_mask];
+				for(uint i = slot.head; i < slot.reqs.size(); ++i)
+					slots[cycle & (num_slots - 1)].reqs.push_back(slot.reqs[i]);
+			}
+
+			_slots.swap(slots);
+			_slot_mask = num_slots - 1;
+		}
+
+	public:
+		ReturnWheel(uint num_slots = 64) : _slots(num_slots), _slot_mask(num_slots - 1)
+		{
+			assert((num_slots & _slot_mask) == 0);
+		}
+
+		bool empty() const { return _size == 0; }
+
+		void push(cycles_t return_cycle, const arches_request_t& req)
+		{
+			return_cycle = std::max(return_cycle, _next_cycle);
+			if((uint64_t)(return_cycle - _next_cycle) >= _slots.size()) _grow(return_cycle);
+
+			_slots[return_cycle & _slot_mask].reqs.push_back(req);
+			_size++;
+		}
 
-		friend bool operator<(const USIMMReturn& l, const USIMMReturn& r)
+		//the oldest return due by current_cycle or nullptr if there isn't one
+		const arches_request_t* peek(cycles_t current_cycle)
 		{
-			return l.return_cycle > r.return_cycle;
+			if(_size == 0)
+			{
+				_next_cycle = std::max(_next_cycle, current_cycle);
+				return nullptr;
+			}
+
+			while(_next_cycle <= current_cycle)
+			{
+				Slot& slot = _slots[_next_cycle & _slot_mask];
+				if(!slot.empty()) return &slot.reqs[slot.head];
+
+				slot.reqs.clear();
+				slot.head = 0;
+				_next_cycle++;
+			}
+
+			return nullptr;
+		}
+
+		//must follow a successful peek
+		void pop()
+		{
+			_slots[_next_cycle & _slot_mask].head++;
+			_size--;
 		}
 	};
 
 	struct Channel
 	{
-		std::priority_queue<USIMMReturn> return_queue;
+		ReturnWheel return_wheel;
 	};
 
 	bool _busy{false};
@@ -40,10 +111,35 @@ private:
 	std::vector<MemoryReturn> returns;
 	std::stack<uint> free_return_ids;
 
+	std::vector<bool> _priority_ports;
+
+	//per requester accounting. Ports not given to a requester belong to requester 0
+	struct Requester
+	{
+		std::string name;
+		uint64_t bytes_read{0};
+		uint64_t bytes_written{0};
+		uint64_t loads{0};
+		uint64_t total_load_latency{0};
+	};
+
+	std::vector<Requester> _requesters;
+	std::vector<uint8_t> _port_requester;
+	std::vector<cycles_t> _return_accept_cycle;
+
+	Util::DRAMTraceWriter* _trace_writer{nullptr};
+
 public:
-	UnitDRAM(uint num_clients, uint64_t size, Simulator* simulator);
+	UnitDRAM(uint num_clients, uint64_t size, Simulator* simulator, bool use_huge_pages = false);
 	virtual ~UnitDRAM() override;
 
+	//loads the usimm config if it hasn't been loaded yet and returns the number of channels it describes
+	static uint init_usimm(const std::string& config_file = "gddr5_16ch.cfg");
+	static void destroy_usimm();
+
+	//cache bank select hash that follows the usimm channel mapping. bank = channel << popcnt(low_bits_mask) | pext(paddr, low_bits_mask)
+	static std::vector<uint64_t> bank_select_hash(uint64_t low_bits_mask = 0);
+
 	bool request_port_write_valid(uint port_index) override;
 	void write_request(const MemoryRequest& request) override;
 
@@ -54,8 +150,22 @@ public:
 	void clock_rise() override;
 	void clock_fall() override;
 
+	//requests from these ports are favored by the stream aware usimm scheduling policy
+	void set_priority_ports(uint offset, uint stride);
+
+	//gives ports offset, offset + stride, ... to a named requester so bandwidth, row hits, latency and energy can be broken down by who asked
+	uint add_requester(const std::string& name, uint offset, uint stride);
+	void print_requester_stats(FILE* stream = stdout);
+
+	//record every request accepted from here on to a trace that replay_trace can run through usimm
+	void record_trace(const std::string& trace_path);
+
+	//drives usimm alone with a recorded trace. Each channel takes at most one request per cycle, no earlier than the cycle
+	//it was recorded on, like the request network would. Returns the number of cycles until usimm drains
+	static cycles_t replay_trace(const std::string& trace_path, const std::vector<bool>& priority_ports = {});
+
 	bool usimm_busy();
-	void print_usimm_stats(uint32_t const L2_line_size, uint32_t const word_size, cycles_t cycle_count);
+	static void print_usimm_stats(uint32_t const L2_line_size, uint32_t const word_size, cycles_t cycle_count);
 	float total_power_in_watts();
 
 	virtual void UsimmNotifyEvent(cycles_t write_cycle, const arches_request_t& req);
@@ -0,0 +1,92 @@
+#include "unit-main-memory-base.hpp"
+
+#ifdef BUILD_PLATFORM_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Arches { namespace Units {
+
+UnitMainMemoryBase::UnitMainMemoryBase(size_t size, bool use_huge_pages) : UnitMemoryBase()
+{
+	size_bytes = size;
+
+#ifdef BUILD_PLATFORM_WINDOWS
+	//committed pages are zero filled on first access. Large pages would need SeLockMemoryPrivilege and can't be lazily committed so we ignore use_huge_pages
+	_data_u8 = (uint8_t*)VirtualAlloc(nullptr, size_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	assert(_data_u8);
+#else
+	void* ptr = mmap(nullptr, size_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	assert(ptr != MAP_FAILED);
+	_data_u8 = (uint8_t*)ptr;
+
+#ifdef MADV_HUGEPAGE
+	if(use_huge_pages) madvise(_data_u8, size_bytes, MADV_HUGEPAGE);
+#endif
+#endif
+}
+
+UnitMainMemoryBase::~UnitMainMemoryBase()
+{
+#ifdef BUILD_PLATFORM_WINDOWS
+	VirtualFree(_data_u8, 0, MEM_RELEASE);
+#else
+	munmap(_data_u8, size_bytes);
+#endif
+}
+
+void UnitMainMemoryBase::clear()
+{
+#ifdef BUILD_PLATFORM_WINDOWS
+	VirtualFree(_data_u8, size_bytes, MEM_DECOMMIT);
+	VirtualAlloc(_data_u8, size_bytes, MEM_COMMIT, PAGE_READWRITE);
+#else
+	//private anonymous pages read back as zero after MADV_DONTNEED
+	madvise(_data_u8, size_bytes, MADV_DONTNEED);
+#endif
+}
+
+size_t UnitMainMemoryBase::resident_bytes() const
+{
+	size_t resident_pages = 0;
+
+#ifdef BUILD_PLATFORM_WINDOWS
+	SYSTEM_INFO system_info;
+	GetSystemInfo(&system_info);
+	size_t page_size = system_info.dwPageSize;
+	size_t num_pages = (size_bytes + page_size - 1) / page_size;
+
+	const size_t batch_size = 64 * 1024;
+	std::vector<PSAPI_WORKING_SET_EX_INFORMATION> info(std::min(num_pages, batch_size));
+	for(size_t i = 0; i < num_pages; i += info.size())
+	{
+		size_t batch = std::min(num_pages - i, info.size());
+		for(size_t j = 0; j < batch; ++j)
+			info[j].VirtualAddress = _data_u8 + (i + j) * page_size;
+
+		if(!QueryWorkingSetEx(GetCurrentProcess(), info.data(), (DWORD)(batch * sizeof(PSAPI_WORKING_SET_EX_INFORMATION)))) return 0;
+
+		for(size_t j = 0; j < batch; ++j)
+			if(info[j].VirtualAttributes.Valid) resident_pages++;
+	}
+#else
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	size_t num_pages = (size_bytes + page_size - 1) / page_size;
+
+	std::vector<unsigned char> residency(num_pages);
+	if(mincore(_data_u8, size_bytes, residency.data()) != 0) return 0;
+
+	for(unsigned char page : residency)
+		if(page & 0x1) resident_pages++;
+#endif
+
+	return resident_pages * page_size;
+}
+
+}}
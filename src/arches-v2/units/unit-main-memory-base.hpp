@@ -21,21 +21,16 @@ public:
 	};
 
 public:
-	UnitMainMemoryBase(size_t size) : UnitMemoryBase()
-	{
-		size_bytes = size;
-		_data_u64 = (uint64_t*)malloc(size);
-	}
+	//Backed by an anonymous mapping that is only reserved up front. The OS supplies zeroed pages on first touch so only the pages the
+	//simulation actually uses become resident.
+	UnitMainMemoryBase(size_t size, bool use_huge_pages = false);
+	virtual ~UnitMainMemoryBase();
 
-	virtual ~UnitMainMemoryBase()
-	{
-		free(_data_u64);
-	}
+	//returns all pages to the OS. They will read back as zero
+	void clear();
 
-	void clear()
-	{
-		memset(_data_u8, 0x00, size_bytes);
-	}
+	//number of bytes currently backed by physical memory
+	size_t resident_bytes() const;
 
 	void direct_read(void* data, size_t size, paddr_t paddr) const
 	{ 
@@ -15,13 +15,14 @@ public:
 	{
 	private:
 		uint64_t mask;
+		std::vector<uint64_t> hash;
 
 	public:
-		RequestCrossBar(uint ports, uint banks, uint cross_bar_width, uint64_t bank_select_mask) : mask(bank_select_mask), CasscadedCrossBar<MemoryRequest>(ports, banks, cross_bar_width) {}
+		RequestCrossBar(uint ports, uint banks, uint cross_bar_width, uint64_t bank_select_mask, const std::vector<uint64_t>& bank_select_hash = {}) : CasscadedCrossBar<MemoryRequest>(ports, banks, cross_bar_width), mask(bank_select_mask), hash(bank_select_hash) {}
 
 		uint get_sink(const MemoryRequest& request) override
 		{
-			uint bank = pext(request.paddr, mask);
+			uint bank = hash.empty() ? pext(request.paddr, mask) : xor_hash(request.paddr, hash);
 			assert(bank < num_sinks());
 			return bank;
 		}
@@ -0,0 +1,44 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "unit-tp.hpp"
+#include "util/instr-trace.hpp"
+
+namespace Arches { namespace Units {
+
+//Trace driven TP. Instructions are still fetched, decoded and issued through the normal pipeline so dependencies, unit
+//contention and memory timing are modeled, but nothing is executed. Next pcs and memory requests come from a trace recorded
+//with UnitTP::Configuration::instr_trace. The TP, thread and kernel setup must match the recording.
+template <typename TP = UnitTP>
+class UnitReplayTP : public TP
+{
+protected:
+	using TP::_thread_data;
+	using TP::_num_threads;
+
+	std::vector<Util::InstrTraceDecoder> _trace_decoders;
+
+public:
+	UnitReplayTP(const UnitTP::Configuration& config, Util::InstrTraceReader* trace) : TP(config)
+	{
+		assert(config.instr_trace == nullptr);
+		for(uint i = 0; i < _num_threads; ++i)
+			_trace_decoders.emplace_back(trace, this->_trace_stream_id(i));
+	}
+
+protected:
+	vaddr_t _execute(uint thread_id, MemoryRequest& req) override
+	{
+		typename TP::ThreadData& thread = _thread_data[thread_id];
+
+		vaddr_t next_pc;
+		bool has_request;
+		if(!_trace_decoders[thread_id].read(thread.pc, thread.instr_size, next_pc, has_request, req))
+			return 0x0ull; //the stream ended early, halt the thread
+
+		assert(has_request == (thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY));
+		return next_pc;
+	}
+};
+
+}}
@@ -4,11 +4,31 @@
 
 #include "unit-base.hpp"
 #include "unit-memory-base.hpp"
+#include "util/free-list.hpp"
+#include "util/flat-map.hpp"
+#include "util/ring-buffer.hpp"
 
 namespace Arches { namespace Units {
 
 class UnitRTCore : public UnitMemoryBase
 {
+public:
+	//traceray flags. Any hit rays stop at the first accepted triangle and return only the hit id
+	static constexpr uint16_t ANY_HIT = 0x1;
+
+	//How rays waiting to be scheduled are binned. The scheduler sweeps the bins round robin and drains the rays each bin holds
+	//when it gets there, so rays headed for the same node or from similar origins and directions queue their fetches together.
+	enum class RaySort : uint8_t
+	{
+		NONE,      //one bin, plain FIFO
+		NEXT_NODE, //by the node or triangle range at the top of the stack, shifted by ray_sort_node_shift to group treelets
+		RAY_HASH,  //by direction octant and a coarse hash of the origin
+	};
+
+	//full stack depth and the deepest node the restart trail can track
+	static constexpr uint MAX_STACK_SIZE = 64;
+	static constexpr uint MAX_DEPTH = 64;
+
 private:
 	Casscade<MemoryRequest> _request_network;
 	FIFOArray<MemoryReturn> _return_network;
@@ -20,6 +40,8 @@ private:
 		{
 			float t;
 			rtm::BVH::Node::Data data;
+			uint8_t depth; //short stack only
+			bool last;     //short stack only, no farther sibling follows
 		};
 
 		rtm::Ray ray;
@@ -27,13 +49,41 @@ private:
 
 		rtm::Hit hit;
 
-		StackEntry stack[32];
+		StackEntry stack[MAX_STACK_SIZE]; //wide nodes push up to 7 more entries per level
 		uint8_t stack_size;
 		uint8_t current_entry;
 		uint16_t flags;
 
+		//Restart trail for short stacks. trail[d] counts the children of the node at depth d the ray has finished, TRAIL_LAST
+		//is set once it is in the last one. depth is the depth of the node being visited
+		uint8_t trail[MAX_DEPTH];
+		uint8_t depth;
+		uint8_t restart_depth; //nodes at or above this depth are being revisited after a restart
+
 		uint16_t port;
 		uint16_t dst;
+
+		uint64_t start_cycle;
+	};
+
+	static constexpr uint8_t TRAIL_LAST = 0x80;
+
+	//the result is copied out so the ray state is freed as soon as the ray finishes
+	struct RayReturn
+	{
+		rtm::Hit hit;
+		uint16_t port;
+		uint16_t dst;
+		bool any_hit;
+	};
+
+	//FIFO of rays linked through _ray_links. A ray waits on at most one staging buffer so the links never collide.
+	struct RayList
+	{
+		uint16_t head{0xffff};
+		uint16_t tail{0xffff};
+
+		bool empty() const { return head == 0xffff; }
 	};
 
 	struct NodeStagingBuffer
@@ -42,13 +92,19 @@ private:
 		{
 			uint8_t data[1];
 			rtm::BVH::Node nodes[2];
+			rtm::WideBVH<4>::Node wide4;
+			rtm::WideBVH<8>::Node wide8;
+			rtm::WideBVH<2>::QuantizedNode qwide2;
+			rtm::WideBVH<4>::QuantizedNode qwide4;
+			rtm::WideBVH<8>::QuantizedNode qwide8;
 		};
 
 		uint32_t first_id;
 		uint16_t bytes_filled;
 		uint8_t  num_entry;
+		uint16_t num_rays; //rays that shared the fetch
 
-		std::queue<uint> rays;
+		RayList rays;
 
 		NodeStagingBuffer() {};
 	};
@@ -64,8 +120,9 @@ private:
 		uint32_t first_id;
 		uint16_t bytes_filled;
 		uint8_t  num_entry;
+		uint16_t num_rays; //rays that shared the fetch
 
-		std::queue<uint> rays;
+		RayList rays;
 
 		TriStagingBuffer() {};
 	};
@@ -77,51 +134,297 @@ private:
 		uint16_t dst;
 	};
 
-	//ray scheduling hardware
-	std::queue<uint> _ray_scheduling_queue;
-	std::queue<uint> _ray_return_queue;
-	std::queue<FetchItem> _fetch_queue;
+	//ray scheduling hardware. Everything is sized by max_rays up front so nothing allocates while clocking.
+	std::vector<RayList> _sort_bins;
+	std::vector<uint16_t> _sort_bin_sizes;
+	uint _sort_bin;
+	uint _sort_budget;
+	uint _scheduled_rays;
+	Util::RingBuffer<RayReturn> _ray_return_queue;
+	Util::RingBuffer<FetchItem> _fetch_queue;
 
-	std::set<uint> _free_ray_ids;
+	Util::BitmapFreeList _free_ray_ids;
 	std::vector<RayState> _ray_states;
+	std::vector<uint16_t> _ray_links;
 
-	//node pipline
-	std::set<uint16_t> _free_node_staging_buffers;
+	//node piplines
+	Util::BitmapFreeList _free_node_staging_buffers;
 	std::vector<NodeStagingBuffer> _node_staging_buffers;
-	std::map<uint, uint16_t> _node_staging_buffer_map;
-	std::queue<uint> _node_isect_queue;
-	Pipline<uint> _box_pipline;
+	Util::FlatMap<uint16_t> _node_staging_buffer_map;
+	Util::RingBuffer<uint16_t> _node_isect_queue;
+	std::vector<Pipline<uint>> _box_piplines;
 
-	//tri pipline
-	std::set<uint16_t> _free_tri_staging_buffers;
+	//tri piplines
+	Util::BitmapFreeList _free_tri_staging_buffers;
 	std::vector<TriStagingBuffer> _tri_staging_buffers;
-	std::map<uint, uint16_t> _tri_staging_buffer_map;
-	std::queue<uint> _tri_isect_queue;
-	Pipline<uint> _tri_pipline;
+	Util::FlatMap<uint16_t> _tri_staging_buffer_map;
+	Util::RingBuffer<uint16_t> _tri_isect_queue;
+	std::vector<Pipline<uint>> _tri_piplines;
 
 	//meta data
 	uint _max_rays;
 	uint _num_tp;
+	uint _dispatch_width;
+	uint _bvh_width;
+	bool _quantized_nodes;
+	uint _node_size;
+	uint _short_stack_size;
+	RaySort _ray_sort;
+	uint _ray_sort_node_shift;
 	paddr_t _nodes_base_addr;
 	paddr_t _triangles_base_addr;
 
 public:
-	UnitRTCore(uint max_rays, uint num_tp, paddr_t nodes_base_addr, paddr_t triangles_base_addr, UnitMemoryBase* cache) : 
-		_max_rays(max_rays), _num_tp(num_tp), _nodes_base_addr(nodes_base_addr), _triangles_base_addr(triangles_base_addr),
-		_cache(cache), _request_network(num_tp, 1), _return_network(num_tp),
-		_box_pipline(3, 1), _tri_pipline(22, 4)
-	{
-		_node_staging_buffers.resize(max_rays);
-		for(uint i = 0; i < _node_staging_buffers.size(); ++i)
-			_free_node_staging_buffers.insert(i);
-
-		_tri_staging_buffers.resize(max_rays);
-		for(uint i = 0; i < _tri_staging_buffers.size(); ++i)
-			_free_tri_staging_buffers.insert(i);
-
-		_ray_states.resize(max_rays);
-		for(uint i = 0; i < _ray_states.size(); ++i)
-			_free_ray_ids.insert(i);
+	struct Configuration
+	{
+		uint max_rays{256};
+		uint num_clients{1};
+
+		uint num_box_piplines{1};
+		uint box_pipline_latency{3};
+		uint box_pipline_cpi{1};
+
+		uint num_tri_piplines{1};
+		uint tri_pipline_latency{22};
+		uint tri_pipline_cpi{4};
+
+		//rays a staging buffer can hand to the piplines per cycle
+		uint dispatch_width{1};
+
+		//2 fetches sibling rtm::BVH::Nodes, 4 or 8 fetches one rtm::WideBVH node per interior stack entry
+		uint bvh_width{2};
+
+		//fetch rtm::WideBVH<bvh_width>::QuantizedNodes instead. Dequantizing adds box_decode_latency to the box piplines
+		bool quantized_nodes{false};
+		uint box_decode_latency{1};
+
+		//0 keeps a full stack per ray. Otherwise each ray keeps this many entries, dropping the farthest when full, and restarts
+		//from the root guided by a per level trail when it runs out (Vaidyanathan et al. 2019)
+		uint short_stack_size{0};
+
+		RaySort ray_sort{RaySort::NONE};
+		uint ray_sort_bins{64};
+		uint ray_sort_node_shift{0};
+
+		paddr_t nodes_base_addr{0x0ull};
+		paddr_t triangles_base_addr{0x0ull};
+
+		UnitMemoryBase* cache{nullptr};
+	};
+
+	UnitRTCore(const Configuration& config) : 
+		_max_rays(config.max_rays), _num_tp(config.num_clients), _dispatch_width(config.dispatch_width), _bvh_width(config.bvh_width), _quantized_nodes(config.quantized_nodes),
+		_short_stack_size(config.short_stack_size), _ray_sort(config.ray_sort), _ray_sort_node_shift(config.ray_sort_node_shift), _nodes_base_addr(config.nodes_base_addr), _triangles_base_addr(config.triangles_base_addr),
+		_cache(config.cache), _request_network(config.num_clients, 1), _return_network(config.num_clients),
+		_box_piplines(config.num_box_piplines, {config.box_pipline_latency + (config.quantized_nodes ? config.box_decode_latency : 0), config.box_pipline_cpi}), 
+		_tri_piplines(config.num_tri_piplines, {config.tri_pipline_latency, config.tri_pipline_cpi}),
+		_sort_bins(config.ray_sort == RaySort::NONE ? 1 : config.ray_sort_bins), _sort_bin_sizes(_sort_bins.size(), 0), _sort_bin(0), _sort_budget(0), _scheduled_rays(0),
+		_ray_return_queue(2 * config.max_rays),
+		_fetch_queue(config.max_rays * (sizeof(rtm::WideBVH<8>::Node) / CACHE_BLOCK_SIZE + 1 + sizeof(rtm::Triangle) * 8 / CACHE_BLOCK_SIZE + 2)), //up to one line more than a full node or tri buffer spans
+		_free_ray_ids(config.max_rays), _ray_links(config.max_rays, 0xffff),
+		_free_node_staging_buffers(config.max_rays), _node_staging_buffer_map(config.max_rays), _node_isect_queue(config.max_rays),
+		_free_tri_staging_buffers(config.max_rays), _tri_staging_buffer_map(config.max_rays), _tri_isect_queue(config.max_rays),
+		log(config.num_box_piplines, config.num_tri_piplines)
+	{
+		assert(config.max_rays < 0xffff);
+		assert(config.num_box_piplines > 0 && config.num_tri_piplines > 0 && config.dispatch_width > 0);
+		assert(config.bvh_width == 2 || config.bvh_width == 4 || config.bvh_width == 8);
+		assert(config.ray_sort == RaySort::NONE || config.ray_sort_bins > 0);
+		assert(config.short_stack_size <= MAX_STACK_SIZE);
+
+		if(_quantized_nodes)
+		{
+			if(_bvh_width == 4)      _node_size = sizeof(rtm::WideBVH<4>::QuantizedNode);
+			else if(_bvh_width == 8) _node_size = sizeof(rtm::WideBVH<8>::QuantizedNode);
+			else                     _node_size = sizeof(rtm::WideBVH<2>::QuantizedNode);
+		}
+		else
+		{
+			if(_bvh_width == 4)      _node_size = sizeof(rtm::WideBVH<4>::Node);
+			else if(_bvh_width == 8) _node_size = sizeof(rtm::WideBVH<8>::Node);
+			else                     _node_size = sizeof(rtm::BVH::Node);
+		}
+		_node_staging_buffers.resize(config.max_rays);
+		_tri_staging_buffers.resize(config.max_rays);
+		_ray_states.resize(config.max_rays);
+
+		log._ray_state_bytes = ray_state_bytes(config);
+		log._ray_storage_bytes = log._ray_state_bytes * config.max_rays;
+	}
+
+	//Modeled storage per ray: ray, inverse direction, hit, stack and trail plus a few bytes of ids and counters. Short stack
+	//entries also hold their depth and last bit, trail levels hold a child index and a last bit
+	static uint ray_state_bytes(const Configuration& config)
+	{
+		uint bytes = sizeof(rtm::Ray) + sizeof(rtm::vec3) + sizeof(rtm::Hit) + 8;
+		if(config.short_stack_size == 0) return bytes + MAX_STACK_SIZE * 8;
+
+		uint trail_bits = MAX_DEPTH * (log2i(config.bvh_width) + 1);
+		return bytes + config.short_stack_size * 9 + (trail_bits + 7) / 8;
+	}
+
+	void _push_ray(RayList& list, uint ray_id)
+	{
+		_ray_links[ray_id] = 0xffff;
+		if(list.empty()) list.head = ray_id;
+		else             _ray_links[list.tail] = ray_id;
+		list.tail = ray_id;
+	}
+
+	uint _pop_ray(RayList& list)
+	{
+		uint ray_id = list.head;
+		list.head = _ray_links[ray_id];
+		return ray_id;
+	}
+
+	//removes ray_id from anywhere in the list given the ray before it (0xffff at the head)
+	void _unlink_ray(RayList& list, uint prev_id, uint ray_id)
+	{
+		if(prev_id == 0xffff) list.head = _ray_links[ray_id];
+		else                  _ray_links[prev_id] = _ray_links[ray_id];
+		if(list.tail == ray_id) list.tail = prev_id;
+	}
+
+	uint _sort_key(uint ray_id)
+	{
+		const RayState& ray_state = _ray_states[ray_id];
+		if(_ray_sort == RaySort::NEXT_NODE)
+		{
+			//finished rays share a bin on their way out
+			if(ray_state.stack_size == 0 || _any_hit_found(ray_state)) return 0;
+			const rtm::BVH::Node::Data& data = ray_state.stack[ray_state.stack_size - 1].data;
+			return ((data.fst_chld_ind >> _ray_sort_node_shift) << 1 | data.is_leaf) + 1;
+		}
+
+		if(_ray_sort == RaySort::RAY_HASH)
+		{
+			//octant in the low bits above a hash of the sign, exponent and top 3 mantissa bits of each origin component
+			uint octant = 0, hash = 0;
+			for(uint i = 0; i < 3; ++i)
+			{
+				float o = ray_state.ray.o[i];
+				uint32_t bits;
+				std::memcpy(&bits, &o, sizeof(uint32_t));
+				hash = hash * 0x9e3779b1u + (bits >> 20);
+				if(ray_state.ray.d[i] < 0.0f) octant |= 0x1u << i;
+			}
+			return (hash ^ hash >> 16) << 3 | octant;
+		}
+
+		return 0;
+	}
+
+	void _schedule_ray(uint ray_id)
+	{
+		uint bin = _sort_key(ray_id) % _sort_bins.size();
+		_push_ray(_sort_bins[bin], ray_id);
+		_sort_bin_sizes[bin]++;
+		_scheduled_rays++;
+	}
+
+	//the ray the scheduler is looking at. Only valid if _scheduled_rays > 0
+	uint _peek_scheduled_ray()
+	{
+		//move on once the current bin is drained of the rays it held when we got to it
+		if(_sort_budget == 0 || _sort_bins[_sort_bin].empty())
+		{
+			do _sort_bin = (_sort_bin + 1) % _sort_bins.size();
+			while(_sort_bins[_sort_bin].empty());
+			_sort_budget = _sort_bin_sizes[_sort_bin];
+		}
+		return _sort_bins[_sort_bin].head;
+	}
+
+	void _pop_scheduled_ray()
+	{
+		_pop_ray(_sort_bins[_sort_bin]);
+		_sort_bin_sizes[_sort_bin]--;
+		_sort_budget--;
+		_scheduled_rays--;
+	}
+
+	void _push_root(RayState& ray_state)
+	{
+		RayState::StackEntry& entry = ray_state.stack[ray_state.stack_size++];
+		entry.t = ray_state.ray.t_min;
+		entry.data.fst_chld_ind = 0;
+		entry.data.lst_chld_ofst = 0;
+		entry.data.is_leaf = 0;
+		entry.depth = 0;
+		entry.last = true;
+	}
+
+	void _push_short_stack(RayState& ray_state, const RayState::StackEntry& entry)
+	{
+		if(ray_state.stack_size == _short_stack_size)
+		{
+			//drop the farthest entry, a restart will find it again
+			for(uint i = 1; i < ray_state.stack_size; ++i)
+				ray_state.stack[i - 1] = ray_state.stack[i];
+			ray_state.stack_size--;
+			log.log_stack_drop();
+		}
+		ray_state.stack[ray_state.stack_size++] = entry;
+	}
+
+	//Called once the node at depth and everything under it is done. Advances the trail of the deepest ancestor with children
+	//left. Its next child is on top of the stack unless it was dropped, in which case the ray restarts from the root.
+	void _finish_node(RayState& ray_state, uint depth)
+	{
+		uint level = depth;
+		while(level > 0 && (ray_state.trail[level - 1] & TRAIL_LAST)) --level;
+		for(uint i = level; i <= depth; ++i)
+			ray_state.trail[i] = 0;
+
+		if(level == 0)
+		{
+			assert(ray_state.stack_size == 0);
+			return;
+		}
+
+		uint8_t& trail = ray_state.trail[level - 1];
+		trail++;
+		if(ray_state.stack_size > 0)
+		{
+			assert(ray_state.stack[ray_state.stack_size - 1].depth == level);
+			if(ray_state.stack[ray_state.stack_size - 1].last) trail |= TRAIL_LAST;
+		}
+		else
+		{
+			_push_root(ray_state);
+			ray_state.restart_depth = level - 1;
+			log.log_restart();
+		}
+	}
+
+	//Children come sorted farthest first. Skips the ones finished before a restart, culling can only remove the farthest so
+	//the finished ones are still the nearest, and pushes the rest with the nearest on top.
+	void _descend(RayState& ray_state, RayState::StackEntry* children, uint num_children)
+	{
+		uint depth = ray_state.depth;
+		assert(depth + 1 < MAX_DEPTH);
+
+		if(ray_state.restart_depth != 0xff)
+		{
+			log.log_restart_visit();
+			if(depth >= ray_state.restart_depth) ray_state.restart_depth = 0xff;
+		}
+
+		uint finished = ray_state.trail[depth] & ~TRAIL_LAST;
+		if(finished >= num_children)
+		{
+			_finish_node(ray_state, depth);
+			return;
+		}
+
+		ray_state.trail[depth] = finished | (finished + 1 == num_children ? TRAIL_LAST : 0);
+		for(uint i = 0; i < num_children - finished; ++i)
+		{
+			children[i].depth = depth + 1;
+			children[i].last = i == 0;
+			_push_short_stack(ray_state, children[i]);
+		}
 	}
 
 	paddr_t block_address(paddr_t addr)
@@ -129,34 +432,74 @@ public:
 		return (addr >> log2i(CACHE_BLOCK_SIZE)) << log2i(CACHE_BLOCK_SIZE);
 	}
 
+	template <typename NODE>
+	static bool _decode_wide_child(const NODE& node, uint i, rtm::AABB& aabb, rtm::BVH::Node::Data& data)
+	{
+		if(!node.is_valid(i)) return false;
+		aabb = node.aabb(i);
+		data = node.data[i];
+		return true;
+	}
+
+	//returns false for unused slots of wide nodes
+	bool _decode_child(const NodeStagingBuffer& buffer, uint i, rtm::AABB& aabb, rtm::BVH::Node::Data& data)
+	{
+		if(_quantized_nodes)
+		{
+			if(_bvh_width == 4) return _decode_wide_child(buffer.qwide4, i, aabb, data);
+			if(_bvh_width == 8) return _decode_wide_child(buffer.qwide8, i, aabb, data);
+			return _decode_wide_child(buffer.qwide2, i, aabb, data);
+		}
+
+		if(_bvh_width == 4) return _decode_wide_child(buffer.wide4, i, aabb, data);
+		if(_bvh_width == 8) return _decode_wide_child(buffer.wide8, i, aabb, data);
+
+		aabb = buffer.nodes[i].aabb;
+		data = buffer.nodes[i].data;
+		return true;
+	}
+
+	//Moves the ray at the head of the scheduler into the staging buffer for its next node. The ray has to leave its bin before
+	//it joins the buffer's list since both go through _ray_links
 	bool try_queue_nodes(uint ray_id, uint first_node_id, uint num_nodes)
 	{
-		paddr_t start = _nodes_base_addr + first_node_id * sizeof(rtm::BVH::Node);
+		paddr_t start = _nodes_base_addr + first_node_id * _node_size;
+		paddr_t end = start + num_nodes * _node_size;
 
 		uint16_t buffer_id;
-		if(_node_staging_buffer_map.find(first_node_id) == _node_staging_buffer_map.end())
+		uint16_t* mapped_buffer_id = _node_staging_buffer_map.find(first_node_id);
+		if(!mapped_buffer_id)
 		{
 			if(_free_node_staging_buffers.empty()) return false;
-			buffer_id = *_free_node_staging_buffers.begin();
+			buffer_id = _free_node_staging_buffers.allocate();
 
 			assert(_node_staging_buffers[buffer_id].rays.empty());
 
-			_free_node_staging_buffers.erase(buffer_id);
-			_node_staging_buffer_map[first_node_id] = buffer_id;
+			_node_staging_buffer_map.insert(first_node_id, buffer_id);
 
 			_node_staging_buffers[buffer_id].first_id = first_node_id;
 			_node_staging_buffers[buffer_id].num_entry = num_nodes;
 			_node_staging_buffers[buffer_id].bytes_filled = 0;
+			_node_staging_buffers[buffer_id].num_rays = 0;
 
-
-			_fetch_queue.push({start, (uint8_t)(sizeof(rtm::BVH::Node) * num_nodes), buffer_id});
+			//split request at cache boundries
+			paddr_t addr = start;
+			while(addr < end)
+			{
+				paddr_t next_boundry = std::min(end, block_address(addr + CACHE_BLOCK_SIZE));
+				uint8_t size = next_boundry - addr;
+				_fetch_queue.push({addr, size, buffer_id});
+				addr += size;
+			}
 		}
 		else
 		{
-			buffer_id = _node_staging_buffer_map[first_node_id];
+			buffer_id = *mapped_buffer_id;
 		}
 
-		_node_staging_buffers[buffer_id].rays.push(ray_id);
+		_pop_scheduled_ray();
+		_push_ray(_node_staging_buffers[buffer_id].rays, ray_id);
+		_node_staging_buffers[buffer_id].num_rays++;
 		return true;
 	}
 
@@ -166,19 +509,20 @@ public:
 		paddr_t end = _triangles_base_addr + (first_tri_id + num_tris) * sizeof(rtm::Triangle);
 
 		uint16_t buffer_id;
-		if(_tri_staging_buffer_map.find(first_tri_id) == _tri_staging_buffer_map.end())
+		uint16_t* mapped_buffer_id = _tri_staging_buffer_map.find(first_tri_id);
+		if(!mapped_buffer_id)
 		{
 			if(_free_tri_staging_buffers.empty()) return false;
-			buffer_id = *_free_tri_staging_buffers.begin();
+			buffer_id = _free_tri_staging_buffers.allocate();
 
 			assert(_tri_staging_buffers[buffer_id].rays.empty());
 
-			_free_tri_staging_buffers.erase(buffer_id);
-			_tri_staging_buffer_map[first_tri_id] = buffer_id;
+			_tri_staging_buffer_map.insert(first_tri_id, buffer_id);
 
 			_tri_staging_buffers[buffer_id].first_id = first_tri_id;
 			_tri_staging_buffers[buffer_id].num_entry = num_tris;
 			_tri_staging_buffers[buffer_id].bytes_filled = 0;
+			_tri_staging_buffers[buffer_id].num_rays = 0;
 
 			//split request at cache boundries
 			//queue the requests to fill the buffer
@@ -193,25 +537,43 @@ public:
 		}
 		else
 		{
-			buffer_id = _tri_staging_buffer_map[first_tri_id];
+			buffer_id = *mapped_buffer_id;
 		}
 
-		_tri_staging_buffers[buffer_id].rays.push(ray_id);
+		_pop_scheduled_ray();
+		_push_ray(_tri_staging_buffers[buffer_id].rays, ray_id);
+		_tri_staging_buffers[buffer_id].num_rays++;
 		return true;
 	}
 
+	bool _any_hit_found(const RayState& ray_state)
+	{
+		return (ray_state.flags & ANY_HIT) && ray_state.hit.id != ~0u;
+	}
+
+	void _return_ray(uint ray_id)
+	{
+		const RayState& ray_state = _ray_states[ray_id];
+		bool any_hit = ray_state.flags & ANY_HIT;
+		_ray_return_queue.push({ray_state.hit, ray_state.port, ray_state.dst, any_hit});
+		_free_ray_ids.free(ray_id);
+		log.log_ray_complete(any_hit, log._cycles - ray_state.start_cycle);
+	}
+
 	void clock_rise() override
 	{
 		//read requests
 		_request_network.clock();
 
-		if(_request_network.is_read_valid(0) && !_free_ray_ids.empty())
+		//every live ray may still queue a return
+		bool return_space = _ray_return_queue.size() + (_max_rays - _free_ray_ids.num_free()) < _ray_return_queue.capacity();
+		if(_request_network.is_read_valid(0) && !_free_ray_ids.empty() && return_space)
 		{
 			//creates a ray entry and queue up the ray
 			const MemoryRequest request = _request_network.read(0);
 
-			uint ray_id = *_free_ray_ids.begin();
-			_free_ray_ids.erase(ray_id);
+			uint ray_id = _free_ray_ids.allocate();
+			log.log_ray();
 
 			RayState& ray_state = _ray_states[ray_id];
 			std::memcpy(&ray_state.ray, request.data, sizeof(rtm::Ray));
@@ -219,17 +581,17 @@ public:
 			ray_state.hit.t = ray_state.ray.t_max;
 			ray_state.hit.bc = rtm::vec2(0.0f);
 			ray_state.hit.id = ~0u;
-			ray_state.stack_size = 1;
-			ray_state.stack[0].t = ray_state.ray.t_min;
-			ray_state.stack[0].data.fst_chld_ind = 0;
-			ray_state.stack[0].data.lst_chld_ofst = 0;
-			ray_state.stack[0].data.is_leaf = 0;
+			ray_state.stack_size = 0;
+			_push_root(ray_state);
+			std::memset(ray_state.trail, 0, sizeof(ray_state.trail));
+			ray_state.restart_depth = 0xff;
 			ray_state.current_entry = 0;
 			ray_state.flags = request.flags;
 			ray_state.dst = request.dst;
 			ray_state.port = request.port;
+			ray_state.start_cycle = log._cycles;
 
-			_ray_scheduling_queue.push(ray_id);
+			_schedule_ray(ray_id);
 		}
 
 
@@ -252,10 +614,10 @@ public:
 			else
 			{
 				NodeStagingBuffer& buffer = _node_staging_buffers[buffer_id];
-				paddr_t buffer_addr = buffer.first_id * sizeof(rtm::BVH::Node) + _nodes_base_addr;
+				paddr_t buffer_addr = buffer.first_id * _node_size + _nodes_base_addr;
 				std::memcpy(buffer.data + (ret.paddr - buffer_addr), ret.data, ret.size);
 				buffer.bytes_filled += ret.size;
-				if(buffer.bytes_filled == buffer.num_entry * sizeof(rtm::BVH::Node))
+				if(buffer.bytes_filled == buffer.num_entry * _node_size)
 				{
 					_node_isect_queue.push(buffer_id);
 				}
@@ -264,117 +626,149 @@ public:
 
 
 		//pop a entry from next rays stack and queue it up
-		if(!_ray_scheduling_queue.empty())
+		if(_scheduled_rays > 0)
 		{
-			uint ray_id = _ray_scheduling_queue.front();
+			uint ray_id = _peek_scheduled_ray();
 			RayState& ray_state = _ray_states[ray_id];
 
-			//TODO handle any hit
-			bool any_hit_found = (ray_state.flags & 0x1) && ray_state.hit.id != ~0u;
-			if(!any_hit_found && ray_state.stack_size > 0)
+			if(!_any_hit_found(ray_state) && ray_state.stack_size > 0)
 			{
 				RayState::StackEntry& entry = ray_state.stack[--ray_state.stack_size];
 				if(entry.t < ray_state.hit.t) //pop cull
 				{
+					ray_state.depth = entry.depth;
 					if(entry.data.is_leaf) 
 					{
-						if(try_queue_tris(ray_id, entry.data.fst_chld_ind, entry.data.lst_chld_ofst + 1))
-						{
-							_ray_scheduling_queue.pop();
-						}
-						else
+						if(!try_queue_tris(ray_id, entry.data.fst_chld_ind, entry.data.lst_chld_ofst + 1))
 						{
 							++ray_state.stack_size;
 						}
 					}
 					else                   
 					{
-						if(try_queue_nodes(ray_id, entry.data.fst_chld_ind, entry.data.lst_chld_ofst + 1))
-						{
-							_ray_scheduling_queue.pop();
-						}
-						else
+						if(!try_queue_nodes(ray_id, entry.data.fst_chld_ind, entry.data.lst_chld_ofst + 1))
 						{
 							++ray_state.stack_size;
 						}
 					}
 				}
+				else if(_short_stack_size)
+				{
+					//a culled entry finishes its subtree without a visit
+					_finish_node(ray_state, entry.depth);
+				}
 			}
 			else
 			{
 				//stack empty or anyhit found return the hit
-				_ray_return_queue.push(ray_id);
-				_ray_scheduling_queue.pop();
+				_pop_scheduled_ray();
+				_return_ray(ray_id);
 			}
 		}
 
 
-		//Simualte intersectors
-		if(!_node_isect_queue.empty() && _box_pipline.is_write_valid())
+		//Simualte intersectors. The staging buffer at the head of each queue hands up to _dispatch_width rays per cycle to
+		//whichever piplines can accept them
+		if(!_node_isect_queue.empty())
 		{
 			uint buffer_id = _node_isect_queue.front();
 			NodeStagingBuffer& buffer = _node_staging_buffers[buffer_id];
 
-			if(!buffer.rays.empty())
+			uint dispatched = 0;
+			for(uint i = 0; i < _box_piplines.size() && dispatched < _dispatch_width && !buffer.rays.empty(); ++i)
 			{
-				uint ray_id = buffer.rays.front();
+				if(!_box_piplines[i].is_write_valid()) continue;
+
+				uint ray_id = _pop_ray(buffer.rays);
 				RayState& ray_state = _ray_states[ray_id];
 
 				rtm::Ray& ray = ray_state.ray;
 				rtm::vec3& inv_d = ray_state.inv_d;
 				rtm::Hit& hit = ray_state.hit;
 
-				uint temp_stack_size = ray_state.stack_size;
-				for(uint i = 0; i < buffer.num_entry; ++i)
+				//all children of the buffer are tested in one pass through the pipline
+				uint num_children = (_bvh_width == 2 && !_quantized_nodes) ? buffer.num_entry : _bvh_width;
+				uint num_boxes = 0;
+				uint num_hits = 0;
+				RayState::StackEntry children[8];
+				for(uint j = 0; j < num_children; ++j)
 				{
-					float t = rtm::intersect(buffer.nodes[i].aabb, ray, inv_d);
+					rtm::AABB aabb;
+					rtm::BVH::Node::Data data;
+					if(!_decode_child(buffer, j, aabb, data)) continue;
+					num_boxes++;
+
+					float t = rtm::intersect(aabb, ray, inv_d);
 					if(t < hit.t) //push cull
 					{
-						//insertion sort
-						uint index = ray_state.stack_size++;
-						for(; index > temp_stack_size; --index)
+						//insertion sort, farthest first so the nearest child ends up on top of the stack
+						uint index = num_hits++;
+						for(; index > 0; --index)
 						{
-							if(ray_state.stack[index - 1].t < t) break;
-							ray_state.stack[index] = ray_state.stack[index - 1];
+							if(children[index - 1].t >= t) break;
+							children[index] = children[index - 1];
 						}
-						ray_state.stack[index] = {t, buffer.nodes[i].data};
+						children[index] = {t, data};
 					}
 				}
 
-				buffer.rays.pop();
-				_box_pipline.write(ray_id);
+				if(_short_stack_size)
+				{
+					_descend(ray_state, children, num_hits);
+				}
+				else
+				{
+					//the full stack keeps the original order, nearest at the bottom and farthest on top
+					assert(ray_state.stack_size + num_hits <= MAX_STACK_SIZE);
+					for(uint j = num_hits; j > 0; --j)
+						ray_state.stack[ray_state.stack_size++] = children[j - 1];
+				}
+
+				_box_piplines[i].write(ray_id);
+				log.log_box_issue(i, num_boxes);
+				dispatched++;
 			}
 
+			if(dispatched == 0) log.log_box_stall();
+
 			if(buffer.rays.empty())
 			{
 				//if all rays are drained from the buffer then free it
+				log.log_node_buffer(buffer.num_rays);
 				_node_staging_buffer_map.erase(buffer.first_id);
-				_free_node_staging_buffers.insert(buffer_id);
+				_free_node_staging_buffers.free(buffer_id);
 				_node_isect_queue.pop();
 			}
 		}
 
-		_box_pipline.clock();
-
-		if(_box_pipline.is_read_valid())
+		for(auto& pipline : _box_piplines)
 		{
-			uint ray_id = _box_pipline.read();
-			if(ray_id != ~0u)
-				_ray_scheduling_queue.push(ray_id);
+			pipline.clock();
+			if(pipline.is_read_valid())
+			{
+				uint ray_id = pipline.read();
+				if(ray_id != ~0u)
+					_schedule_ray(ray_id);
+			}
 		}
 
-		if(!_tri_isect_queue.empty() && _tri_pipline.is_write_valid())
+		if(!_tri_isect_queue.empty())
 		{
 			uint buffer_id = _tri_isect_queue.front();
 			TriStagingBuffer& buffer = _tri_staging_buffers[buffer_id];
 
-			if(!buffer.rays.empty())
+			//each dispatched ray tests its next triangle so rays further down the list can share the cycle
+			uint dispatched = 0;
+			uint prev_id = 0xffff;
+			uint ray_id = buffer.rays.head;
+			for(uint i = 0; i < _tri_piplines.size() && dispatched < _dispatch_width && ray_id != 0xffff; ++i)
 			{
-				uint ray_id = buffer.rays.front();
+				if(!_tri_piplines[i].is_write_valid()) continue;
+
+				uint next_id = _ray_links[ray_id];
 				RayState& ray_state = _ray_states[ray_id];
 
 				rtm::Ray& ray = ray_state.ray;
-				rtm::vec3& inv_d = ray_state.inv_d;
 				rtm::Hit& hit = ray_state.hit;
 
 				uint current_tri = ray_state.current_entry++;
@@ -382,33 +776,52 @@ public:
 				if(rtm::intersect(buffer.tris[current_tri], ray, hit))
 					hit.id = buffer.first_id + current_tri;
 
-				//Only the last box triggers stack pop
-				if(ray_state.current_entry == buffer.num_entry)
+				//Only the last tri triggers stack pop. Any hit rays leave as soon as they hit something
+				if(ray_state.current_entry == buffer.num_entry || _any_hit_found(ray_state))
 				{
 					ray_state.current_entry = 0;
-					buffer.rays.pop();
-					_tri_pipline.write(ray_id);
+					if(_short_stack_size && !_any_hit_found(ray_state)) _finish_node(ray_state, ray_state.depth);
+					_unlink_ray(buffer.rays, prev_id, ray_id);
+					_tri_piplines[i].write(ray_id);
 				}
-				else _tri_pipline.write(~0);
+				else
+				{
+					_tri_piplines[i].write(~0);
+					prev_id = ray_id;
+				}
+
+				log.log_tri_issue(i);
+				dispatched++;
+				ray_id = next_id;
 			}
 
+			if(dispatched == 0) log.log_tri_stall();
+
 			if(buffer.rays.empty())
 			{
 				//if all rays are drained from the buffer then free it
+				log.log_tri_buffer(buffer.num_rays);
 				_tri_staging_buffer_map.erase(buffer.first_id);
-				_free_tri_staging_buffers.insert(buffer_id);
+				_free_tri_staging_buffers.free(buffer_id);
 				_tri_isect_queue.pop();
 			}
 		}
 
-		_tri_pipline.clock();
-
-		if(_tri_pipline.is_read_valid())
+		for(auto& pipline : _tri_piplines)
 		{
-			uint ray_id = _tri_pipline.read();
-			if(ray_id != ~0u)
-				_ray_scheduling_queue.push(ray_id);
+			pipline.clock();
+			if(pipline.is_read_valid())
+			{
+				uint ray_id = pipline.read();
+				if(ray_id == ~0u) continue;
+
+				//terminated any hit rays skip the scheduler
+				if(_any_hit_found(_ray_states[ray_id])) _return_ray(ray_id);
+				else                                    _schedule_ray(ray_id);
+			}
 		}
+
+		log.log_cycle();
 	}
 
 	void clock_fall() override
@@ -425,27 +838,34 @@ public:
 			request.port = _num_tp;
 			_cache->write_request(request);
 			_fetch_queue.pop();
+
+			if(request.dst & 0x8000) log.log_tri_fetch(request.size);
+			else                     log.log_node_fetch(request.size);
 		}
 
 
 		//issue returns
 		if(!_ray_return_queue.empty())
 		{
-			uint ray_id = _ray_return_queue.front();
-			const RayState& ray_state = _ray_states[ray_id];
-
-			if(_return_network.is_write_valid(ray_state.port))
+			const RayReturn& ray_return = _ray_return_queue.front();
+			if(_return_network.is_write_valid(ray_return.port))
 			{
-				//fetch the next block
+				//any hit rays only return the hit id
 				MemoryReturn ret;
-				ret.size = sizeof(rtm::Hit);
-				ret.dst = ray_state.dst;
-				ret.port = ray_state.port;
+				ret.dst = ray_return.dst;
+				ret.port = ray_return.port;
 				ret.paddr = 0xdeadbeefull;
-				std::memcpy(ret.data, &ray_state.hit, sizeof(rtm::Hit));
+				if(ray_return.any_hit)
+				{
+					ret.size = sizeof(uint32_t);
+					std::memcpy(ret.data, &ray_return.hit.id, sizeof(uint32_t));
+				}
+				else
+				{
+					ret.size = sizeof(rtm::Hit);
+					std::memcpy(ret.data, &ray_return.hit, sizeof(rtm::Hit));
+				}
 				_return_network.write(ret, ret.port);
-
-				_free_ray_ids.insert(ray_id);
 				_ray_return_queue.pop();
 			}
 		}
@@ -477,6 +897,153 @@ public:
 	{
 		return _return_network.read(port_index);
 	}
+
+public:
+	class Log
+	{
+	public:
+		uint64_t _cycles;
+		uint64_t _rays;
+		uint64_t _box_tests;
+		uint64_t _node_fetches;
+		uint64_t _tri_fetches;
+		uint64_t _node_bytes;
+		uint64_t _tri_bytes;
+		uint64_t _node_buffers;
+		uint64_t _node_buffer_rays;
+		uint64_t _tri_buffers;
+		uint64_t _tri_buffer_rays;
+		uint64_t _stack_drops;
+		uint64_t _restarts;
+		uint64_t _restart_visits;
+		uint64_t _closest_hit_rays;
+		uint64_t _closest_hit_latency;
+		uint64_t _any_hit_rays;
+		uint64_t _any_hit_latency;
+		uint64_t _box_stalls;
+		uint64_t _tri_stalls;
+		std::vector<uint64_t> _box_issues;
+		std::vector<uint64_t> _tri_issues;
+
+		//configuration, kept across resets
+		uint64_t _ray_state_bytes{0};
+		uint64_t _ray_storage_bytes{0};
+
+		Log(uint num_box_piplines = 1, uint num_tri_piplines = 1) : _box_issues(num_box_piplines), _tri_issues(num_tri_piplines) { reset(); }
+
+		void reset()
+		{
+			_cycles = 0;
+			_rays = 0;
+			_box_tests = 0;
+			_node_fetches = 0;
+			_tri_fetches = 0;
+			_node_bytes = 0;
+			_tri_bytes = 0;
+			_node_buffers = 0;
+			_node_buffer_rays = 0;
+			_tri_buffers = 0;
+			_tri_buffer_rays = 0;
+			_stack_drops = 0;
+			_restarts = 0;
+			_restart_visits = 0;
+			_closest_hit_rays = 0;
+			_closest_hit_latency = 0;
+			_any_hit_rays = 0;
+			_any_hit_latency = 0;
+			_box_stalls = 0;
+			_tri_stalls = 0;
+			std::fill(_box_issues.begin(), _box_issues.end(), 0);
+			std::fill(_tri_issues.begin(), _tri_issues.end(), 0);
+		}
+
+		void accumulate(const Log& other)
+		{
+			_cycles += other._cycles;
+			_rays += other._rays;
+			_box_tests += other._box_tests;
+			_node_fetches += other._node_fetches;
+			_tri_fetches += other._tri_fetches;
+			_node_bytes += other._node_bytes;
+			_tri_bytes += other._tri_bytes;
+			_node_buffers += other._node_buffers;
+			_node_buffer_rays += other._node_buffer_rays;
+			_tri_buffers += other._tri_buffers;
+			_tri_buffer_rays += other._tri_buffer_rays;
+			_stack_drops += other._stack_drops;
+			_restarts += other._restarts;
+			_restart_visits += other._restart_visits;
+			_ray_state_bytes = other._ray_state_bytes;
+			_ray_storage_bytes += other._ray_storage_bytes;
+			_closest_hit_rays += other._closest_hit_rays;
+			_closest_hit_latency += other._closest_hit_latency;
+			_any_hit_rays += other._any_hit_rays;
+			_any_hit_latency += other._any_hit_latency;
+			_box_stalls += other._box_stalls;
+			_tri_stalls += other._tri_stalls;
+
+			if(_box_issues.size() < other._box_issues.size()) _box_issues.resize(other._box_issues.size(), 0);
+			for(uint i = 0; i < other._box_issues.size(); ++i) _box_issues[i] += other._box_issues[i];
+
+			if(_tri_issues.size() < other._tri_issues.size()) _tri_issues.resize(other._tri_issues.size(), 0);
+			for(uint i = 0; i < other._tri_issues.size(); ++i) _tri_issues[i] += other._tri_issues[i];
+		}
+
+		void log_cycle() { _cycles++; }
+		void log_ray() { _rays++; }
+		void log_box_issue(uint pipline_index, uint num_boxes) { _box_issues[pipline_index]++; _box_tests += num_boxes; }
+		void log_tri_issue(uint pipline_index) { _tri_issues[pipline_index]++; }
+		void log_ray_complete(bool any_hit, uint64_t latency)
+		{
+			if(any_hit) _any_hit_rays++, _any_hit_latency += latency;
+			else        _closest_hit_rays++, _closest_hit_latency += latency;
+		}
+
+		void log_node_fetch(uint bytes) { _node_fetches++; _node_bytes += bytes; }
+		void log_tri_fetch(uint bytes) { _tri_fetches++; _tri_bytes += bytes; }
+		void log_node_buffer(uint rays) { _node_buffers++; _node_buffer_rays += rays; }
+		void log_tri_buffer(uint rays) { _tri_buffers++; _tri_buffer_rays += rays; }
+		void log_stack_drop() { _stack_drops++; }
+		void log_restart() { _restarts++; }
+		void log_restart_visit() { _restart_visits++; }
+		void log_box_stall() { _box_stalls++; }
+		void log_tri_stall() { _tri_stalls++; }
+
+		//utilization is issues over cycles so a pipline with cpi n saturates at 1/n
+		void print_log(FILE* stream = stdout, uint units = 1)
+		{
+			uint64_t box_issues = 0, tri_issues = 0;
+			for(auto& issues : _box_issues) box_issues += issues;
+			for(auto& issues : _tri_issues) tri_issues += issues;
+
+			float fc = std::max<uint64_t>(_cycles, 1) / 100.0f; //no cycles logged prints 0% rather than nan
+			auto ratio = [](float num, uint64_t den) { return den ? num / den : 0.0f; };
+
+			fprintf(stream, "Rays: %lld\n", _rays / units);
+			fprintf(stream, "Ray State: %lld bytes per ray(%lld bytes)\n", _ray_state_bytes, _ray_storage_bytes / units);
+			fprintf(stream, "Closest Hit Rays: %lld(%.4f per cycle, %.1f cycle latency)\n", _closest_hit_rays / units, ratio(_closest_hit_rays, _cycles), ratio(_closest_hit_latency, _closest_hit_rays));
+			fprintf(stream, "Any Hit Rays: %lld(%.4f per cycle, %.1f cycle latency)\n", _any_hit_rays / units, ratio(_any_hit_rays, _cycles), ratio(_any_hit_latency, _any_hit_rays));
+			fprintf(stream, "Box Tests: %lld\n", _box_tests / units);
+			fprintf(stream, "Tri Tests: %lld\n", tri_issues / units);
+			fprintf(stream, "Node Fetches: %lld(%.2f per ray)\n", _node_fetches / units, ratio(_node_fetches, _rays));
+			fprintf(stream, "Tri Fetches: %lld(%.2f per ray)\n", _tri_fetches / units, ratio(_tri_fetches, _rays));
+			fprintf(stream, "Node Bytes: %lld(%.2f per ray)\n", _node_bytes / units, ratio(_node_bytes, _rays));
+			fprintf(stream, "Tri Bytes: %lld(%.2f per ray)\n", _tri_bytes / units, ratio(_tri_bytes, _rays));
+			fprintf(stream, "Node Staging Buffers: %lld(%.2f rays per buffer)\n", _node_buffers / units, ratio(_node_buffer_rays, _node_buffers));
+			fprintf(stream, "Tri Staging Buffers: %lld(%.2f rays per buffer)\n", _tri_buffers / units, ratio(_tri_buffer_rays, _tri_buffers));
+			fprintf(stream, "Short Stack Drops: %lld(%.2f per ray)\n", _stack_drops / units, ratio(_stack_drops, _rays));
+			fprintf(stream, "Restarts: %lld(%.2f per ray)\n", _restarts / units, ratio(_restarts, _rays));
+			fprintf(stream, "Restart Node Visits: %lld(%.2f per ray)\n", _restart_visits / units, ratio(_restart_visits, _rays));
+			fprintf(stream, "Box Issues: %lld(%.2f%%)\n", box_issues / units, box_issues / fc / _box_issues.size());
+			for(uint i = 0; i < _box_issues.size(); ++i)
+				fprintf(stream, "\tBox Pipline %d: %lld(%.2f%%)\n", i, _box_issues[i] / units, _box_issues[i] / fc);
+			fprintf(stream, "Box Stalls: %lld(%.2f%%)\n", _box_stalls / units, _box_stalls / fc);
+			fprintf(stream, "Tri Issues: %lld(%.2f%%)\n", tri_issues / units, tri_issues / fc / _tri_issues.size());
+			for(uint i = 0; i < _tri_issues.size(); ++i)
+				fprintf(stream, "\tTri Pipline %d: %lld(%.2f%%)\n", i, _tri_issues[i] / units, _tri_issues[i] / fc);
+			fprintf(stream, "Tri Stalls: %lld(%.2f%%)\n", _tri_stalls / units, _tri_stalls / fc);
+		}
+	}log;
 };
 
 }}
\ No newline at end of file
@@ -0,0 +1,513 @@
+#pragma once
+
+#include "stdafx.hpp"
+
+#include "unit-tp.hpp"
+
+namespace Arches {
+namespace Units {
+
+//GPU style variant of a thread processor. Threads are grouped into warps of warp_size lanes that share a pc and issue one
+//instruction per cycle for all active lanes. TP is the scalar thread processor to build on so its dependency checks for custom
+//instructions are reused per lane.
+//
+//Divergence is handled with a per warp reconvergence stack of {pc, lane mask} entries sorted so the top has the lowest pc. The top
+//entry issues and merges with any entry it reaches. We have no post dominator info from the compiler so this reconverges at the
+//earliest common pc, which is the post dominator for structured if/else and loops.
+//
+//Loads and stores that go to the cache are coalesced into one request per line. Everything else (atomics, custom units, ...) issues
+//one request per lane. A memory instruction that needs more than one request replays the rest on the following cycles and blocks
+//issue from the TP while it does.
+template <typename TP = UnitTP>
+class UnitSIMTTP : public TP
+{
+protected:
+	using ThreadData = typename TP::ThreadData;
+	using ThreadState = typename TP::ThreadState;
+	using TP::_thread_data;
+	using TP::_thread_states;
+	using TP::_num_threads;
+	using TP::_tp_index;
+	using TP::_unit_table;
+	using TP::_thread_exec_arbiter;
+	using TP::_thread_fetch_arbiter;
+	using TP::_replay_queue;
+	using TP::_replay_type;
+	using TP::_replay_pc;
+
+	//coalesced loads are tagged with 0x80 | slot in the high byte of dst. Scalar returns have the thread id there.
+	static constexpr uint MAX_PENDING_LOADS = 128;
+	static constexpr uint MAX_PENDING_SFUS = 256; //slot lives in the top byte of SFURequest::dst
+
+	struct StackEntry
+	{
+		vaddr_t  pc;
+		uint64_t mask;
+	};
+
+	struct Warp
+	{
+		std::vector<StackEntry> stack; //the back is the top
+	};
+
+	struct PendingLoad
+	{
+		uint     first_thread;
+		uint64_t lane_mask;
+		paddr_t  line;
+		uint8_t  size;
+		std::vector<uint8_t> lane_offset;
+	};
+
+	//lanes that were active when an SFU op issued. Only those wait on the return
+	struct PendingSFU
+	{
+		uint     first_thread;
+		uint64_t lane_mask;
+	};
+
+	struct CoalescedRequest
+	{
+		MemoryRequest req;
+		uint slot;
+	};
+
+	uint _warp_size;
+	uint _num_warps;
+	uint _num_halted_warps{0};
+	uint _last_warp{0};
+	std::vector<Warp> _warps;
+
+	std::vector<PendingLoad> _pending_loads;
+	std::vector<uint> _free_load_slots;
+
+	std::vector<PendingSFU> _pending_sfus;
+	std::vector<uint> _free_sfu_slots;
+
+	//scratch space reused every issue
+	std::vector<StackEntry> _next_pcs;
+	std::vector<CoalescedRequest> _coalesced;
+
+public:
+	UnitSIMTTP(const UnitTP::Configuration& config, uint warp_size) : TP(config), _warp_size(warp_size)
+	{
+		assert(warp_size > 0 && warp_size <= 64 && config.num_threads % warp_size == 0);
+		assert(config.fetch_queue_size == 0); //warps fetch through the i-buffer directly
+		assert(config.num_logical_threads <= config.num_threads); //warps are never swapped out
+
+		_num_warps = config.num_threads / warp_size;
+		_warps.resize(_num_warps);
+		for(Warp& warp : _warps)
+			warp.stack.push_back({config.pc, generate_nbit_mask(warp_size)});
+
+		//warps issue and fetch through their first thread
+		_thread_exec_arbiter = RoundRobinArbiter(_num_warps);
+		for(uint i = 0; i < _num_threads; ++i)
+			if(i % _warp_size != 0) _thread_fetch_arbiter.remove(i);
+
+		_pending_loads.resize(MAX_PENDING_LOADS);
+		for(uint i = 0; i < MAX_PENDING_LOADS; ++i)
+		{
+			_pending_loads[i].lane_offset.resize(warp_size);
+			_free_load_slots.push_back(MAX_PENDING_LOADS - 1 - i);
+		}
+
+		_pending_sfus.resize(MAX_PENDING_SFUS);
+		for(uint i = 0; i < MAX_PENDING_SFUS; ++i)
+			_free_sfu_slots.push_back(MAX_PENDING_SFUS - 1 - i);
+	}
+
+	void clock_fall() override
+	{
+		this->_issue_i_fetch();
+
+		//Replay the rest of the last memory instruction's requests
+		if(!_replay_queue.empty())
+		{
+			if(_replay_queue.front().first->request_port_write_valid(_tp_index))
+			{
+				_replay_queue.front().first->write_request(_replay_queue.front().second);
+				_replay_queue.pop_front();
+			}
+			this->log.log_resource_stall(_replay_type, _replay_pc);
+			this->log.log_issue_cycle(1, 0);
+			simt_log._replay_cycles++;
+			return;
+		}
+
+		for(uint i = 0; i < _num_warps; ++i)
+			if(!_decode_warp(i)) _thread_exec_arbiter.add(i);
+			else                 _thread_exec_arbiter.remove(i);
+
+		uint warp_index = _thread_exec_arbiter.get_index();
+		this->log.log_issue_cycle(1, warp_index != ~0u);
+		if(warp_index == ~0u)
+		{
+			ThreadData& last_leader = _thread_data[_last_warp * _warp_size];
+			uint8_t stall_type = _decode_warp(_last_warp);
+			if(stall_type < 128)
+			{
+				if(!_warps[_last_warp].stack.empty())
+					this->log.log_data_stall((ISA::RISCV::InstrType)stall_type, last_leader.pc);
+			}
+			else this->log.log_resource_stall((ISA::RISCV::InstrType)(stall_type - 128), last_leader.pc);
+
+			_last_warp = (_last_warp + 1) % _num_warps;
+			return;
+		}
+
+		Warp& warp = _warps[warp_index];
+		uint first_thread = warp_index * _warp_size;
+		ThreadData& leader = _thread_data[first_thread];
+		const ISA::RISCV::Instruction instr = leader.instr;
+		const ISA::RISCV::InstructionInfo instr_info = leader.instr_info;
+		const StackEntry top = warp.stack.back();
+		warp.stack.pop_back();
+
+		this->log.log_instruction_issue(instr_info.instr_type, top.pc);
+		simt_log._warp_instructions++;
+		simt_log._active_lanes += popcnt(top.mask);
+
+		_next_pcs.clear();
+		if(instr_info.exec_type == ISA::RISCV::ExecType::CONTROL_FLOW)
+		{
+			for(uint lane = 0; lane < _warp_size; ++lane)
+			{
+				if(!((top.mask >> lane) & 0x1)) continue;
+				ThreadState& state = _thread_states[first_thread + lane];
+				ISA::RISCV::ExecutionItem exec_item = {top.pc, &state.int_regs, &state.float_regs, leader.instr_size, &state.vector_regs};
+				vaddr_t next_pc = instr_info.execute_branch(exec_item, instr) ? exec_item.pc : top.pc + leader.instr_size;
+				state.int_regs.zero.u64 = 0x0ull;
+				_add_next_pc(next_pc, 0x1ull << lane);
+			}
+			if(_next_pcs.size() > 1) simt_log._divergent_branches++;
+		}
+		else if(instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
+		{
+			for(uint lane = 0; lane < _warp_size; ++lane)
+			{
+				if(!((top.mask >> lane) & 0x1)) continue;
+				ThreadState& state = _thread_states[first_thread + lane];
+				ISA::RISCV::ExecutionItem exec_item = {top.pc, &state.int_regs, &state.float_regs, leader.instr_size, &state.vector_regs};
+				instr_info.execute(exec_item, instr);
+				state.int_regs.zero.u64 = 0x0ull;
+			}
+
+			//one request for the whole warp. The return clears the register for the lanes active at issue.
+			UnitSFU* sfu = (UnitSFU*)_unit_table[(uint)instr_info.instr_type];
+			if(sfu)
+			{
+				ISA::RISCV::RegAddr reg_addr;
+				reg_addr.reg = instr.rd;
+				reg_addr.reg_type = instr_info.dst_reg_type;
+
+				uint slot = _free_sfu_slots.back();
+				_free_sfu_slots.pop_back();
+				_pending_sfus[slot] = {first_thread, top.mask};
+
+				SFURequest req;
+				req.dst = (slot << 8) | reg_addr.u8;
+				req.port = _tp_index;
+
+				for(uint lane = 0; lane < _warp_size; ++lane)
+					if((top.mask >> lane) & 0x1) this->_set_dependancies(first_thread + lane);
+				sfu->write_request(req);
+			}
+			_add_next_pc(top.pc + leader.instr_size, top.mask);
+		}
+		else if(instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
+		{
+			_issue_memory(warp_index, top);
+			_add_next_pc(top.pc + leader.instr_size, top.mask);
+		}
+		else assert(false);
+
+		//lanes that reached pc 0 are done
+		for(const StackEntry& entry : _next_pcs)
+		{
+			if(entry.pc == 0x0ull) continue;
+
+			uint i = 0;
+			for(; i < warp.stack.size(); ++i)
+				if(warp.stack[i].pc <= entry.pc) break;
+
+			if(i < warp.stack.size() && warp.stack[i].pc == entry.pc)
+			{
+				warp.stack[i].mask |= entry.mask;
+				simt_log._reconvergences++;
+			}
+			else warp.stack.insert(warp.stack.begin() + i, entry);
+		}
+
+		leader.instr.data = 0;
+		_last_warp = warp_index;
+
+		if(warp.stack.empty())
+		{
+			leader.pc = 0x0ull;
+			_num_halted_warps++;
+			if(_num_halted_warps == _num_warps)
+				--this->simulator->units_executing;
+		}
+		else
+		{
+			leader.pc = warp.stack.back().pc;
+			this->_check_i_buffer(first_thread, leader.pc);
+		}
+	}
+
+protected:
+	void _add_next_pc(vaddr_t pc, uint64_t mask)
+	{
+		for(StackEntry& entry : _next_pcs)
+		{
+			if(entry.pc != pc) continue;
+			entry.mask |= mask;
+			return;
+		}
+		_next_pcs.push_back({pc, mask});
+	}
+
+	uint8_t _decode_warp(uint warp_index)
+	{
+		Warp& warp = _warps[warp_index];
+		if(warp.stack.empty()) return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
+
+		uint first_thread = warp_index * _warp_size;
+		if(!this->_fetch_instr(first_thread)) return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
+
+		//every active lane has to be free of hazards
+		const ThreadData& leader = _thread_data[first_thread];
+		uint64_t mask = warp.stack.back().mask;
+		for(uint lane = 0; lane < _warp_size; ++lane)
+		{
+			if(!((mask >> lane) & 0x1)) continue;
+			ThreadData& thread = _thread_data[first_thread + lane];
+			thread.instr = leader.instr;
+			thread.instr_info = leader.instr_info;
+			thread.instr_size = leader.instr_size;
+			if(uint8_t type = this->_check_dependancies(first_thread + lane))
+				return type;
+		}
+
+		//worst case every lane touches a different line
+		if(leader.instr_info.instr_type == ISA::RISCV::InstrType::LOAD && _free_load_slots.size() < popcnt(mask))
+			return 128 + (uint)ISA::RISCV::InstrType::LOAD;
+
+		if(leader.instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE && _unit_table[(uint)leader.instr_info.instr_type] && _free_sfu_slots.empty())
+			return 128 + (uint)leader.instr_info.instr_type;
+
+		return this->_check_pipline_hazard(first_thread);
+	}
+
+	void _issue_memory(uint warp_index, const StackEntry& top)
+	{
+		uint first_thread = warp_index * _warp_size;
+		ThreadData& leader = _thread_data[first_thread];
+		const ISA::RISCV::InstructionInfo& instr_info = leader.instr_info;
+		UnitMemoryBase* mem = (UnitMemoryBase*)_unit_table[(uint)instr_info.instr_type];
+		bool coalesce = instr_info.instr_type == ISA::RISCV::InstrType::LOAD || instr_info.instr_type == ISA::RISCV::InstrType::STORE;
+		assert(instr_info.encoding != ISA::RISCV::Encoding::VL && instr_info.encoding != ISA::RISCV::Encoding::VS); //lanes are the vector
+
+		_coalesced.clear();
+		for(uint lane = 0; lane < _warp_size; ++lane)
+		{
+			if(!((top.mask >> lane) & 0x1)) continue;
+
+			uint thread_id = first_thread + lane;
+			ThreadState& state = _thread_states[thread_id];
+			ISA::RISCV::ExecutionItem exec_item = {top.pc, &state.int_regs, &state.float_regs, leader.instr_size, &state.vector_regs};
+			MemoryRequest req = instr_info.generate_request(exec_item, leader.instr);
+
+			if(req.vaddr >= (~0x0ull << 20))
+			{
+				//stacks are private to each lane
+				if((req.vaddr | state.stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), assert(false);
+				paddr_t buffer_addr = req.vaddr & state.stack_mask;
+				if(instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
+					write_register(&state.int_regs, &state.float_regs, req.dst, req.size, &state.stack_mem[buffer_addr]);
+				else if(instr_info.instr_type == ISA::RISCV::InstrType::STORE)
+					std::memcpy(&state.stack_mem[buffer_addr], req.data, req.size);
+				else assert(false);
+				state.int_regs.zero.u64 = 0x0ull;
+				continue;
+			}
+
+			assert(req.vaddr < 4ull * 1024ull * 1024ull * 1024ull);
+			this->_set_dependancies(thread_id);
+			simt_log._memory_lanes++;
+
+			if(!coalesce)
+			{
+				req.dst = (thread_id << 8) | req.dst;
+				req.port = _tp_index;
+				_replay_queue.push_back({mem, req});
+				continue;
+			}
+
+			paddr_t line = req.paddr & ~(paddr_t)(CACHE_BLOCK_SIZE - 1);
+			uint offset = req.paddr - line;
+			assert(offset + req.size <= CACHE_BLOCK_SIZE);
+
+			uint i = 0;
+			for(; i < _coalesced.size(); ++i)
+				if((_coalesced[i].req.paddr & ~(paddr_t)(CACHE_BLOCK_SIZE - 1)) == line) break;
+
+			if(i == _coalesced.size())
+			{
+				//build every line request at the line base and trim it once all lanes are in
+				CoalescedRequest coalesced;
+				coalesced.req.type = req.type;
+				coalesced.req.size = CACHE_BLOCK_SIZE;
+				coalesced.req.flags = req.flags;
+				coalesced.req.port = _tp_index;
+				coalesced.req.paddr = line;
+				coalesced.req.write_mask = 0x0ull;
+				coalesced.slot = ~0u;
+
+				if(req.type == MemoryRequest::Type::LOAD)
+				{
+					coalesced.slot = _free_load_slots.back();
+					_free_load_slots.pop_back();
+
+					PendingLoad& load = _pending_loads[coalesced.slot];
+					load.first_thread = first_thread;
+					load.lane_mask = 0x0ull;
+					load.line = line;
+					load.size = req.size;
+					coalesced.req.dst = ((0x80 | coalesced.slot) << 8) | req.dst;
+				}
+				_coalesced.push_back(coalesced);
+			}
+
+			CoalescedRequest& coalesced = _coalesced[i];
+			if(req.type == MemoryRequest::Type::LOAD)
+			{
+				PendingLoad& load = _pending_loads[coalesced.slot];
+				load.lane_mask |= 0x1ull << lane;
+				load.lane_offset[lane] = offset;
+				coalesced.req.write_mask |= generate_nbit_mask(req.size) << offset; //tracks the bytes we need
+			}
+			else
+			{
+				for(uint j = 0; j < req.size; ++j)
+					if((req.write_mask >> j) & 0x1) coalesced.req.data[offset + j] = req.data[j];
+				coalesced.req.write_mask |= req.write_mask << offset;
+			}
+		}
+
+		for(CoalescedRequest& coalesced : _coalesced)
+		{
+			MemoryRequest& req = coalesced.req;
+			uint start = ctz(req.write_mask);
+			uint end = log2i(req.write_mask) + 1;
+			req.paddr += start;
+			req.size = end - start;
+			if(req.type == MemoryRequest::Type::LOAD)
+			{
+				req.write_mask = 0x0ull;
+			}
+			else
+			{
+				req.write_mask >>= start;
+				std::memmove(req.data, req.data + start, req.size);
+			}
+			_replay_queue.push_back({mem, req});
+		}
+
+		simt_log._memory_requests += _replay_queue.size();
+		if(_replay_queue.empty()) return;
+
+		//the first request goes out this cycle. _decode_warp already checked the port.
+		_replay_queue.front().first->write_request(_replay_queue.front().second);
+		_replay_queue.pop_front();
+		_replay_type = instr_info.instr_type;
+		_replay_pc = top.pc;
+	}
+
+	void _process_load_return(const MemoryReturn& ret) override
+	{
+		uint tag = ret.dst >> 8;
+		if(!(tag & 0x80))
+		{
+			TP::_process_load_return(ret);
+			return;
+		}
+
+		uint slot = tag & 0x7f;
+		PendingLoad& load = _pending_loads[slot];
+		ISA::RISCV::RegAddr reg_addr((uint8_t)ret.dst);
+		for(uint lane = 0; lane < _warp_size; ++lane)
+		{
+			if(!((load.lane_mask >> lane) & 0x1)) continue;
+
+			uint thread_id = load.first_thread + lane;
+			ThreadState& state = _thread_states[thread_id];
+			write_register(&state.int_regs, &state.float_regs, reg_addr, load.size, ret.data + (load.line + load.lane_offset[lane] - ret.paddr));
+			this->_clear_register_pending(thread_id, reg_addr);
+		}
+		_free_load_slots.push_back(slot);
+	}
+
+	void _process_sfu_return(const SFURequest& ret) override
+	{
+		uint slot = ret.dst >> 8;
+		const PendingSFU& sfu = _pending_sfus[slot];
+		for(uint lane = 0; lane < _warp_size; ++lane)
+			if((sfu.lane_mask >> lane) & 0x1) this->_clear_register_pending(sfu.first_thread + lane, (uint8_t)ret.dst);
+		_free_sfu_slots.push_back(slot);
+	}
+
+public:
+	class SIMTLog
+	{
+	public:
+		uint64_t _warp_size;
+		uint64_t _warp_instructions;
+		uint64_t _active_lanes;
+		uint64_t _divergent_branches;
+		uint64_t _reconvergences;
+		uint64_t _memory_lanes;
+		uint64_t _memory_requests;
+		uint64_t _replay_cycles;
+
+		SIMTLog(uint warp_size = 1) : _warp_size(warp_size) { reset(); }
+
+		void reset()
+		{
+			_warp_instructions = 0;
+			_active_lanes = 0;
+			_divergent_branches = 0;
+			_reconvergences = 0;
+			_memory_lanes = 0;
+			_memory_requests = 0;
+			_replay_cycles = 0;
+		}
+
+		void accumulate(const SIMTLog& other)
+		{
+			_warp_size = other._warp_size;
+			_warp_instructions += other._warp_instructions;
+			_active_lanes += other._active_lanes;
+			_divergent_branches += other._divergent_branches;
+			_reconvergences += other._reconvergences;
+			_memory_lanes += other._memory_lanes;
+			_memory_requests += other._memory_requests;
+			_replay_cycles += other._replay_cycles;
+		}
+
+		void print_log(FILE* stream = stdout, uint num_units = 1)
+		{
+			fprintf(stream, "Warp Size: %lld\n", _warp_size);
+			fprintf(stream, "Warp Instructions: %lld\n", _warp_instructions / num_units);
+			fprintf(stream, "SIMD Efficiency: %.2f%%\n", _warp_instructions ? 100.0f * _active_lanes / (_warp_instructions * _warp_size) : 0.0f);
+			fprintf(stream, "Divergent Branches: %lld\n", _divergent_branches / num_units);
+			fprintf(stream, "Reconvergences: %lld\n", _reconvergences / num_units);
+			fprintf(stream, "Memory Requests Per Lane Access: %.2f\n", _memory_lanes ? (float)_memory_requests / _memory_lanes : 0.0f);
+			fprintf(stream, "Replay Cycles: %lld\n", _replay_cycles / num_units);
+		}
+	}simt_log{_warp_size};
+};
+
+}
+}
@@ -11,43 +11,80 @@ namespace Units {
 #endif
 
 UnitTP::UnitTP(const Configuration& config) :
+	_last_thread_id(0), 
+	_num_threads(std::max(config.num_threads, config.num_logical_threads)), 
+	_issue_width(config.issue_width), 
+	_fetch_queue_size(config.fetch_queue_size), 
+	_fetch_width(config.fetch_width), 
+	_mispredict_penalty(config.mispredict_penalty), 
+	_branch_predictor(config.branch_predictor, config.branch_predictor_size_log2), 
+	_btb(config.btb_size), 
+	_num_halted_threads(0), 
+	_thread_exec_arbiter(std::max(config.num_threads, config.num_logical_threads)),
+	_thread_fetch_arbiter(std::max(config.num_threads, config.num_logical_threads)),
+	_context_swap_cost(config.context_swap_cost), 
+	_context_swap_threshold(config.context_swap_threshold), 
 	_unit_table(*config.unit_table), 
-	_unique_mems(*config.unique_mems), 
 	_unique_sfus(*config.unique_sfus), 
+	_unique_mems(*config.unique_mems), 
 	_inst_cache(config.inst_cache), 
-	log(0x10000), 
-	_num_threads(config.num_threads), 
-	_thread_fetch_arbiter(config.num_threads),
-	_thread_exec_arbiter(config.num_threads),
-	_num_halted_threads(0), 
-	_last_thread_id(0)
+	log(config.profile)
 {
-	for (int i = 0; i < config.num_threads; i++) 
+	assert(config.arena);
+	uint8_t* stack_mem = config.arena->allocate((size_t)_num_threads * config.stack_size);
+
+	for (uint i = 0; i < _num_threads; i++) 
 	{
+		ThreadState state = {};
+		state.int_regs.zero.u64 = 0;
+		state.int_regs.sp.u64 = config.sp;
+		state.int_regs.ra.u64 = 0x0ull;
+		state.int_regs.gp.u64 = config.gp;
+		state.stack_mem = stack_mem + (size_t)i * config.stack_size;
+		state.stack_mask = generate_nbit_mask(log2i(config.stack_size));
+		_thread_states.push_back(state);
+
 		ThreadData thread = {};
-		thread.int_regs.zero.u64 = 0;
-		thread.int_regs.sp.u64 = config.sp;
-		thread.int_regs.ra.u64 = 0x0ull;
-		thread.int_regs.gp.u64 = config.gp;
 		thread.pc = config.pc;
 		thread.cheat_memory = config.cheat_memory;
-		thread.stack_mem.resize(config.stack_size);
-		thread.stack_mask = generate_nbit_mask(log2i(config.stack_size));
 		thread.instr.data = 0;
+		thread.i_fetch_paddr = config.pc & ~(vaddr_t)(CACHE_BLOCK_SIZE - 1);
+		thread.fetch_pc = config.pc;
 
 		for (uint i = 0; i < 32; ++i)
 		{
 			thread.int_regs_pending[i] = 0;
 			thread.float_regs_pending[i] = 0;
+			thread.vector_regs_pending[i] = 0;
 		}
 
+		//the first num_threads threads start resident
+		if(i < config.num_threads)
+		{
+			thread.context = i;
+			_contexts.push_back({(uint)i});
+			_thread_fetch_arbiter.add(i);
+		}
+		else _backing_store.push_back(i);
+
 		_thread_data.push_back(thread);
-		_thread_fetch_arbiter.add(i);
 	}
 
+	for(uint i = 0; i < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++i)
+		_long_latency[i] = i < _unit_table.size() && _unit_table[i] && std::find(_unique_mems.begin(), _unique_mems.end(), _unit_table[i]) != _unique_mems.end();
+
+	assert(_issue_width > 0 && _issue_width <= MAX_ISSUE_WIDTH);
+
 	_num_tps_per_i_cache = config.num_tps_per_i_cache;
 	_tp_index = config.tp_index;
 	_tm_index = config.tm_index;
+
+	if(config.instr_trace)
+	{
+		assert(_tp_index < 256);
+		for(uint i = 0; i < _num_threads; ++i)
+			_trace_encoders.emplace_back(config.instr_trace, _trace_stream_id(i));
+	}
 }
 
 void UnitTP::_clear_register_pending(uint thread_id, ISA::RISCV::RegAddr dst)
@@ -58,16 +95,21 @@ void UnitTP::_clear_register_pending(uint thread_id, ISA::RISCV::RegAddr dst)
 	}
 
 	ThreadData& thread = _thread_data[thread_id];
-	if      (dst.reg_type == ISA::RISCV::RegType::INT)  thread.int_regs_pending[dst.reg] = 0;
-	else if (dst.reg_type == ISA::RISCV::RegType::FLOAT) thread.float_regs_pending[dst.reg] = 0;
+	thread.regs_pending(dst.reg_type)[dst.reg] = 0;
 }
 
 void UnitTP::_process_load_return(const MemoryReturn& ret)
 {
 	uint16_t ret_thread_id = ret.dst >> 8;
-	ThreadData& ret_thread = _thread_data[ret_thread_id];
+	ThreadState& ret_thread = _thread_states[ret_thread_id];
 	ISA::RISCV::RegAddr reg_addr((uint8_t)ret.dst);
-	if(reg_addr.reg_type == ISA::RISCV::RegType::FLOAT)
+	if(reg_addr.reg_type == ISA::RISCV::RegType::VECTOR)
+	{
+		_write_vector_elements(ret_thread_id, reg_addr.reg, ret.paddr, ret.size, ret.data);
+		if(--ret_thread.vector_loads[reg_addr.reg].pending == 0)
+			_clear_register_pending(ret_thread_id, reg_addr);
+	}
+	else if(reg_addr.reg_type == ISA::RISCV::RegType::FLOAT)
 	{
 		for(uint i = 0; i < ret.size / sizeof(float); ++i)
 		{
@@ -83,14 +125,20 @@ void UnitTP::_process_load_return(const MemoryReturn& ret)
 	}
 }
 
+void UnitTP::_process_sfu_return(const SFURequest& ret)
+{
+	_clear_register_pending(ret.dst >> 8, (uint8_t)ret.dst);
+}
+
 uint8_t UnitTP::_check_dependancies(uint thread_id)
 {
 	ThreadData& thread = _thread_data[thread_id];
 	const ISA::RISCV::Instruction& instr = thread.instr;
 	const ISA::RISCV::InstructionInfo& instr_info = thread.instr_info;
 
-	uint8_t* dst_pending = instr_info.dst_reg_type == ISA::RISCV::RegType::INT ? thread.int_regs_pending : thread.float_regs_pending;
-	uint8_t* src_pending = instr_info.src_reg_type == ISA::RISCV::RegType::INT ? thread.int_regs_pending : thread.float_regs_pending;
+	uint8_t* dst_pending = thread.regs_pending(instr_info.dst_reg_type);
+	uint8_t* src_pending = thread.regs_pending(instr_info.src_reg_type);
+	uint8_t* vector_pending = thread.vector_regs_pending;
 
 	switch (thread.instr_info.encoding)
 	{
@@ -129,6 +177,26 @@ uint8_t UnitTP::_check_dependancies(uint thread_id)
 	case ISA::RISCV::Encoding::J:
 		if (dst_pending[instr.rd]) return dst_pending[instr.rd];
 		break;
+
+	case ISA::RISCV::Encoding::V:
+		if (dst_pending[instr.v.vd]) return dst_pending[instr.v.vd];
+		if (vector_pending[instr.v.vs2]) return vector_pending[instr.v.vs2];
+		if (src_pending[instr.v.vs1]) return src_pending[instr.v.vs1];
+		if (!instr.v.vm && vector_pending[0]) return vector_pending[0];
+		break;
+
+	case ISA::RISCV::Encoding::VU:
+		if (dst_pending[instr.v.vd]) return dst_pending[instr.v.vd];
+		if (vector_pending[instr.v.vs2]) return vector_pending[instr.v.vs2];
+		if (!instr.v.vm && vector_pending[0]) return vector_pending[0];
+		break;
+
+	case ISA::RISCV::Encoding::VL:
+	case ISA::RISCV::Encoding::VS:
+		if (vector_pending[instr.vmem.vd]) return vector_pending[instr.vmem.vd];
+		if (src_pending[instr.vmem.rs1]) return src_pending[instr.vmem.rs1];
+		if (instr.vmem.mop == 0b10 && src_pending[instr.vmem.rs2]) return src_pending[instr.vmem.rs2];
+		break;
 	}
 
 	thread.int_regs_pending[0] = 0;
@@ -141,8 +209,8 @@ void UnitTP::_set_dependancies(uint thread_id)
 	const ISA::RISCV::Instruction& instr = thread.instr;
 	const ISA::RISCV::InstructionInfo& instr_info = thread.instr_info;
 
-	uint8_t* dst_pending = instr_info.dst_reg_type == ISA::RISCV::RegType::INT ? thread.int_regs_pending : thread.float_regs_pending;
-	if ((instr_info.encoding == ISA::RISCV::Encoding::B) || (instr_info.encoding == ISA::RISCV::Encoding::S)) return;
+	uint8_t* dst_pending = thread.regs_pending(instr_info.dst_reg_type);
+	if ((instr_info.encoding == ISA::RISCV::Encoding::B) || (instr_info.encoding == ISA::RISCV::Encoding::S) || (instr_info.encoding == ISA::RISCV::Encoding::VS)) return;
 	dst_pending[instr.rd] = (uint8_t)instr_info.instr_type;
 }
 
@@ -161,58 +229,214 @@ void UnitTP::_log_instruction_issue(uint thread_id)
 #endif
 }
 
-uint8_t UnitTP::_decode(uint thread_id)
+bool UnitTP::_read_i_buffer(const ThreadData& thread, vaddr_t pc, uint16_t& parcel)
+{
+	int64_t offset = (int64_t)(pc - thread.i_buffer.paddr);
+	if(offset < (thread.i_buffer.has_prev ? -2 : 0) || offset >= CACHE_BLOCK_SIZE) return false;
+	std::memcpy(&parcel, thread.i_buffer.data + 2 + offset, sizeof(uint16_t));
+	return true;
+}
+
+//Queues an i-buffer fetch if the instruction at pc isn't fully buffered. A 4 byte instruction in the last parcel of the line needs the next line.
+void UnitTP::_check_i_buffer(uint thread_id, vaddr_t pc)
 {
 	ThreadData& thread = _thread_data[thread_id];
+	if(thread.i_fetch_pending) return;
 
-	//Check for instruction fetch hazard
-	if(thread.pc == 0x0ull) return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
-	if(thread.instr.data == 0)
+	uint16_t parcel;
+	if(!_read_i_buffer(thread, pc, parcel))
+		thread.i_fetch_paddr = pc & ~(vaddr_t)(CACHE_BLOCK_SIZE - 1);
+	else if(!ISA::RISCV::is_compressed(parcel) && !_read_i_buffer(thread, pc + 2, parcel))
+		thread.i_fetch_paddr = thread.i_buffer.paddr + CACHE_BLOCK_SIZE;
+	else return;
+
+	_thread_fetch_arbiter.add(thread_id);
+}
+
+//Reads and expands the instruction at pc. Returns false if it isn't fully in the i-buffer.
+bool UnitTP::_read_instr(const ThreadData& thread, vaddr_t pc, uint32_t& instr, uint8_t& size)
+{
+	uint16_t parcels[2];
+	if(_inst_cache == nullptr)
+	{
+		assert(thread.cheat_memory != nullptr);
+		std::memcpy(parcels, thread.cheat_memory + pc, sizeof(parcels));
+	}
+	else
 	{
-		if(_inst_cache == nullptr)
+		if(!_read_i_buffer(thread, pc, parcels[0]))
+			return false;
+
+		if(!ISA::RISCV::is_compressed(parcels[0]) && !_read_i_buffer(thread, pc + 2, parcels[1]))
+			return false;
+	}
+
+	if(ISA::RISCV::is_compressed(parcels[0]))
+	{
+		instr = ISA::RISCV::expand_compressed(parcels[0]);
+		size = 2;
+	}
+	else
+	{
+		instr = parcels[0] | (uint32_t)parcels[1] << 16;
+		size = 4;
+	}
+	return true;
+}
+
+bool UnitTP::_fetch_instr(uint thread_id)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	if(thread.instr.data != 0) return true;
+
+	if(_fetch_queue_size)
+	{
+		//the front end already read the instruction
+		if(thread.fetch_queue.empty()) return false;
+		assert(thread.fetch_queue.front().pc == thread.pc);
+		thread.instr.data = thread.fetch_queue.front().instr;
+		thread.instr_size = thread.fetch_queue.front().size;
+	}
+	else if(!_read_instr(thread, thread.pc, thread.instr.data, thread.instr_size)) return false;
+
+	thread.instr_info = thread.instr.get_info();
+	return true;
+}
+
+//Fills one thread's fetch queue along the predicted path. Fetch groups end at predicted taken branches and i-buffer misses.
+void UnitTP::_clock_front_end()
+{
+	uint thread_id = ~0u;
+	for(uint i = 1; i <= _num_threads; ++i)
+	{
+		uint candidate = (_front_end_thread_id + i) % _num_threads;
+		const ThreadData& thread = _thread_data[candidate];
+		if(thread.context == ~0u || thread.fetch_pc == 0x0ull || thread.fetch_blocked || _current_cycle < thread.fetch_resume_cycle || thread.fetch_queue.size() >= _fetch_queue_size) continue;
+		thread_id = candidate;
+		break;
+	}
+	if(thread_id == ~0u) return;
+	_front_end_thread_id = thread_id;
+
+	ThreadData& thread = _thread_data[thread_id];
+	for(uint i = 0; i < _fetch_width && thread.fetch_queue.size() < _fetch_queue_size; ++i)
+	{
+		FetchQueueEntry entry;
+		entry.pc = thread.fetch_pc;
+		entry.history = thread.branch_history;
+		if(!_read_instr(thread, entry.pc, entry.instr, entry.size))
 		{
-			assert(thread.cheat_memory != nullptr);
-			thread.instr.data = reinterpret_cast<uint32_t*>(thread.cheat_memory)[thread.pc / 4];
+			_check_i_buffer(thread_id, entry.pc);
+			break;
 		}
-		else
+
+		ISA::RISCV::Instruction instr(entry.instr);
+		const ISA::RISCV::InstructionInfo instr_info = instr.get_info();
+
+		vaddr_t next_pc = entry.pc + entry.size;
+		if(instr_info.instr_type == ISA::RISCV::InstrType::BRANCH || instr_info.instr_type == ISA::RISCV::InstrType::JUMP)
 		{
-			paddr_t addr_offset = thread.pc - thread.i_buffer.paddr;
-			if(addr_offset < CACHE_BLOCK_SIZE)
+			//without a btb direct targets are known as soon as the instruction is read
+			vaddr_t target = 0x0ull;
+			bool has_target;
+			if(_btb.enabled()) has_target = _btb.lookup(entry.pc, target);
+			else if(instr_info.encoding == ISA::RISCV::Encoding::B) has_target = true, target = entry.pc + ISA::RISCV::b_imm(instr);
+			else if(instr_info.encoding == ISA::RISCV::Encoding::J) has_target = true, target = entry.pc + ISA::RISCV::j_imm(instr);
+			else has_target = false;
+
+			if(instr_info.encoding == ISA::RISCV::Encoding::B)
 			{
-				thread.instr.data = reinterpret_cast<uint32_t*>(thread.i_buffer.data)[addr_offset / 4];
+				bool taken = _branch_predictor.predict(entry.pc, entry.history);
+				if(taken && has_target) next_pc = target;
+				thread.branch_history = entry.history << 1 | taken;
+			}
+			else if(has_target) next_pc = target;
+			else if(instr_info.encoding == ISA::RISCV::Encoding::I)
+			{
+				//indirect jump with no prediction. Stop fetching until it resolves.
+				thread.fetch_blocked = true;
 			}
-			else return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
 		}
-		thread.instr_info = thread.instr.get_info();
+
+		entry.predicted_pc = thread.fetch_blocked ? ~0x0ull : next_pc;
+		thread.fetch_queue.push_back(entry);
+		thread.fetch_pc = next_pc;
+		if(thread.fetch_blocked || next_pc != entry.pc + entry.size) break;
 	}
+}
 
-	//Check for data hazards
-	if(uint8_t type = _check_dependancies(thread_id))
-		return type;
+//Checks the issued instruction against the path the front end followed. Mispredicts flush the fetch queue and stall fetch.
+void UnitTP::_resolve_front_end(uint thread_id)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	FetchQueueEntry entry = thread.fetch_queue.front();
+	thread.fetch_queue.pop_front();
 
-	//check for pipline hazards
+	bool is_branch = thread.instr_info.instr_type == ISA::RISCV::InstrType::BRANCH;
+	bool is_jump = thread.instr_info.instr_type == ISA::RISCV::InstrType::JUMP;
+	if(!is_branch && !is_jump) return;
+
+	bool taken = thread.pc != entry.pc + entry.size;
+	if(is_branch) _branch_predictor.update(entry.pc, entry.history, taken);
+	if(taken && _btb.enabled()) _btb.update(entry.pc, thread.pc);
+
+	if(entry.predicted_pc == ~0x0ull)
+	{
+		//fetch was waiting for this jump
+		thread.fetch_blocked = false;
+		thread.fetch_pc = thread.pc;
+		log.log_branch(entry.pc, false);
+		return;
+	}
+
+	bool mispredicted = entry.predicted_pc != thread.pc;
+	log.log_branch(entry.pc, mispredicted);
+	if(!mispredicted) return;
+
+	thread.fetch_queue.clear();
+	thread.fetch_pc = thread.pc;
+	thread.fetch_blocked = false;
+	thread.fetch_resume_cycle = _current_cycle + _mispredict_penalty;
+	thread.branch_history = is_branch ? (entry.history << 1 | taken) : entry.history;
+}
+
+uint8_t UnitTP::_check_pipline_hazard(uint thread_id)
+{
+	ThreadData& thread = _thread_data[thread_id];
 	if(_unit_table[(uint)thread.instr_info.instr_type])
 	{
 		if(thread.instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
 		{
-			//check for pipline hazard
 			UnitSFU* sfu = (UnitSFU*)_unit_table[(uint)thread.instr_info.instr_type];
 			if(!sfu->request_port_write_valid(_tp_index))
 				return 128 + (uint)thread.instr_info.instr_type;
 		}
 		else if(thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
 		{
-			//check for pipline hazard
 			UnitMemoryBase* mem = (UnitMemoryBase*)_unit_table[(uint)thread.instr_info.instr_type];
 			if(!mem->request_port_write_valid(_tp_index))
 				return 128 + (uint)thread.instr_info.instr_type;
 		}
 	}
-
-	//no hazards found
 	return 0;
 }
 
+uint8_t UnitTP::_decode(uint thread_id)
+{
+	ThreadData& thread = _thread_data[thread_id];
+
+	//Check for instruction fetch hazard
+	if(thread.pc == 0x0ull) return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
+	if(!_fetch_instr(thread_id)) return (uint8_t)ISA::RISCV::InstrType::INSRT_FETCH;
+
+	//Check for data hazards
+	if(uint8_t type = _check_dependancies(thread_id))
+		return type;
+
+	//check for pipline hazards
+	return _check_pipline_hazard(thread_id);
+}
+
 void UnitTP::clock_rise()
 {
 	for (auto& unit : _unique_mems)
@@ -226,7 +450,7 @@ void UnitTP::clock_rise()
 	{
 		if (!unit->return_port_read_valid(_tp_index)) continue;
 		const SFURequest& ret = unit->read_return(_tp_index);
-		_clear_register_pending(ret.dst >> 8, (uint8_t)ret.dst);
+		_process_sfu_return(ret);
 	}
 
 	if(_inst_cache)
@@ -238,15 +462,85 @@ void UnitTP::clock_rise()
 
 			uint thread_id = ret.dst;
 			ThreadData& thread = _thread_data[thread_id];
-			std::memcpy(thread.i_buffer.data, ret.data, CACHE_BLOCK_SIZE);
+			thread.i_buffer.has_prev = ret.paddr == thread.i_buffer.paddr + CACHE_BLOCK_SIZE;
+			if(thread.i_buffer.has_prev) std::memcpy(thread.i_buffer.data, thread.i_buffer.data + CACHE_BLOCK_SIZE, 2);
+			std::memcpy(thread.i_buffer.data + 2, ret.data, CACHE_BLOCK_SIZE);
 			thread.i_buffer.paddr = ret.paddr;
+
+			//the line we got might only hold the first half of the instruction
+			thread.i_fetch_pending = false;
+			if(thread.context != ~0u) _check_i_buffer(thread_id, _fetch_queue_size ? thread.fetch_pc : thread.pc);
 		}
 	}
 }
 
-void UnitTP::clock_fall()
+//A backing store thread can be swapped in if its next instruction won't wait on a result
+bool UnitTP::_is_swap_ready(uint thread_id)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	if(thread.instr.data == 0) return true;
+	return _check_dependancies(thread_id) == 0;
+}
+
+//Swaps resident threads that are halted or have been blocked on a memory result for _context_swap_threshold cycles for
+//backing store threads that can make progress. Short stalls such as L1 hits are waited out. The context can't issue for
+//_context_swap_cost cycles while the register state moves. Decodes each context once and leaves the result in stall_type
+//for issue.
+void UnitTP::_clock_contexts()
+{
+	for(uint context_index = 0; context_index < _contexts.size(); ++context_index)
+	{
+		Context& context = _contexts[context_index];
+		if(context.swap_cycles)
+		{
+			if(--context.swap_cycles == 0) context.stall_type = _decode(context.thread_id);
+			continue;
+		}
+
+		ThreadData& thread = _thread_data[context.thread_id];
+		context.stall_type = _decode(context.thread_id);
+		if(thread.pc != 0x0ull)
+		{
+			uint8_t stall_type = context.stall_type;
+			if(stall_type == 0 || stall_type >= 128 || !_long_latency[stall_type])
+			{
+				context.stall_cycles = 0;
+				continue;
+			}
+			if(++context.stall_cycles < _context_swap_threshold) continue;
+		}
+
+		auto it = std::find_if(_backing_store.begin(), _backing_store.end(), [&](uint thread_id) { return _is_swap_ready(thread_id); });
+		if(it == _backing_store.end()) continue;
+
+		uint thread_id = *it;
+		_backing_store.erase(it);
+
+		//outstanding requests still return to the swapped out thread's state
+		if(thread.pc != 0x0ull) _backing_store.push_back(context.thread_id);
+		thread.context = ~0u;
+		_thread_exec_arbiter.remove(context.thread_id);
+		_thread_fetch_arbiter.remove(context.thread_id);
+
+		ThreadData& new_thread = _thread_data[thread_id];
+		new_thread.context = context_index;
+		context.thread_id = thread_id;
+		context.swap_cycles = _context_swap_cost;
+		context.stall_cycles = 0;
+		_check_i_buffer(thread_id, _fetch_queue_size ? new_thread.fetch_pc : new_thread.pc);
+		if(!context.swap_cycles) context.stall_type = _decode(thread_id);
+		log.log_context_swap();
+	}
+}
+
+void UnitTP::_decode_contexts()
+{
+	for(Context& context : _contexts)
+		context.stall_type = _decode(context.thread_id);
+}
+
+void UnitTP::_issue_i_fetch()
 {
-	//Fetch next i-buffer
 	uint fetch_thread_id = _thread_fetch_arbiter.get_index();
 	if(fetch_thread_id != ~0u)
 	{
@@ -257,13 +551,14 @@ void UnitTP::clock_fall()
 			if(_inst_cache->request_port_write_valid(i_cache_port))
 			{
 				MemoryRequest i_req;
-				i_req.paddr = fetch_thread.pc & ~0x3full;
+				i_req.paddr = fetch_thread.i_fetch_paddr;
 				i_req.port = i_cache_port;
 				i_req.dst = fetch_thread_id;
 				i_req.type = MemoryRequest::Type::LOAD;
 				i_req.size = CACHE_BLOCK_SIZE;
 				_inst_cache->write_request(i_req);
 				_thread_fetch_arbiter.remove(fetch_thread_id);
+				fetch_thread.i_fetch_pending = true;
 			}
 		}
 		else
@@ -271,18 +566,67 @@ void UnitTP::clock_fall()
 			_thread_fetch_arbiter.remove(fetch_thread_id);
 		}
 	}
+}
 
-	for(uint i = 0; i < _num_threads; ++i)
-		if(!_decode(i)) _thread_exec_arbiter.add(i);
-		else            _thread_exec_arbiter.remove(i);
+void UnitTP::clock_fall()
+{
+	_current_cycle++;
+
+	//Fetch next i-buffer
+	_issue_i_fetch();
+	if(_fetch_queue_size) _clock_front_end();
+	if(_contexts.size() < _num_threads) _clock_contexts();
 
-	uint exec_thread_id = _thread_exec_arbiter.get_index();
-	if(exec_thread_id == ~0u)
+	//Send the rest of the last vector memory instruction's requests
+	if(!_replay_queue.empty())
+	{
+		if(_replay_queue.front().first->request_port_write_valid(_tp_index))
+		{
+			_replay_queue.front().first->write_request(_replay_queue.front().second);
+			_replay_queue.pop_front();
+		}
+		log.log_resource_stall(_replay_type, _replay_pc);
+		log.log_issue_cycle(_issue_width, 0);
+		return;
+	}
+
+	if(_contexts.size() == _num_threads) _decode_contexts();
+	for(const Context& context : _contexts)
+		if(!context.swap_cycles && !context.stall_type) _thread_exec_arbiter.add(context.thread_id);
+		else                                            _thread_exec_arbiter.remove(context.thread_id);
+
+	//Issue up to _issue_width ready threads. Each unit has one port per TP so a thread issued earlier this cycle may have taken it.
+	uint issued = 0;
+	for(; issued < _issue_width; ++issued)
+	{
+		uint exec_thread_id = _thread_exec_arbiter.get_index();
+		while(exec_thread_id != ~0u && issued > 0 && _check_pipline_hazard(exec_thread_id))
+		{
+			_thread_exec_arbiter.remove(exec_thread_id);
+			exec_thread_id = _thread_exec_arbiter.get_index();
+		}
+		if(exec_thread_id == ~0u) break;
+
+		_thread_exec_arbiter.remove(exec_thread_id);
+		_issue(exec_thread_id);
+		if(!_replay_queue.empty())
+		{
+			issued++;
+			break;
+		}
+	}
+	log.log_issue_cycle(_issue_width, issued);
+
+	if(issued == 0)
 	{
 		//log data stall
 		ThreadData& last_thread = _thread_data[_last_thread_id];
-		uint8_t last_thread_stall_type = _decode(_last_thread_id);
-		if(last_thread_stall_type < 128)
+		uint8_t last_thread_stall_type = last_thread.context != ~0u ? _contexts[last_thread.context].stall_type : 0;
+		if(last_thread.context == ~0u || _contexts[last_thread.context].swap_cycles)
+		{
+			log.log_context_swap_stall();
+		}
+		else if(last_thread_stall_type < 128)
 		{
 			if(last_thread.pc != 0)
 			{
@@ -303,49 +647,156 @@ void UnitTP::clock_fall()
 			printf("\033[0m\n");
 		}
 
-		_last_thread_id = (_last_thread_id + 1) % _num_threads;
-		return;
+		do _last_thread_id = (_last_thread_id + 1) % _num_threads;
+		while(_thread_data[_last_thread_id].context == ~0u);
 	}
+}
 
-	//Reg/PC read
-	ThreadData& thread = _thread_data[exec_thread_id];
-	_log_instruction_issue(exec_thread_id);
-	ISA::RISCV::ExecutionItem exec_item = {thread.pc, &thread.int_regs, &thread.float_regs};
+//Functional execution. Returns the next pc and fills req for memory instructions
+vaddr_t UnitTP::_execute(uint thread_id, MemoryRequest& req)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	ThreadState& state = _thread_states[thread_id];
+	ISA::RISCV::ExecutionItem exec_item = {thread.pc, &state.int_regs, &state.float_regs, thread.instr_size, &state.vector_regs};
 
-	//Execute
-	bool jump = false;
 	if (thread.instr_info.exec_type == ISA::RISCV::ExecType::CONTROL_FLOW) //SYS is the first non memory instruction type so this divides mem and non mem ops
 	{
 		if(thread.instr_info.execute_branch(exec_item, thread.instr))
-		{
-			jump = true;
-			thread.pc = exec_item.pc;
-		}
+			return exec_item.pc;
 	}
 	else if (thread.instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
 	{
 		thread.instr_info.execute(exec_item, thread.instr);
+	}
+	else if (thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
+	{
+		req = thread.instr_info.generate_request(exec_item, thread.instr);
+	}
+	else assert(false);
+
+	return thread.pc + thread.instr_size;
+}
+
+//Vector elements are written into the register by their offset from the start of the access
+void UnitTP::_write_vector_elements(uint thread_id, uint vreg, vaddr_t vaddr, uint size, const uint8_t* data)
+{
+	ThreadState& state = _thread_states[thread_id];
+	const VectorLoad& load = state.vector_loads[vreg];
+	ISA::RISCV::VectorRegister& reg = state.vector_regs.registers[vreg];
+
+	if(load.stride == 0)
+	{
+		//every element reads the same word
+		for(uint i = 0; i < load.num_elements; ++i)
+			std::memcpy(&reg.u32[i], data, sizeof(float));
+		return;
+	}
+
+	uint index = (uint)((int64_t)(vaddr - load.vaddr) / load.stride);
+	assert(index * sizeof(float) + size <= sizeof(reg));
+	std::memcpy(&reg.u32[index], data, size);
+}
+
+//Splits a vector access into a request per run of contiguous elements in the same cache line. The first request goes out
+//this cycle and the rest drain from the replay queue.
+void UnitTP::_issue_vector_request(uint thread_id, const MemoryRequest& vector_req)
+{
+	ThreadData& thread = _thread_data[thread_id];
+	ThreadState& state = _thread_states[thread_id];
+	UnitMemoryBase* mem = (UnitMemoryBase*)_unit_table[(uint)thread.instr_info.instr_type];
+	ISA::RISCV::RegAddr reg_addr((uint8_t)vector_req.dst);
+
+	VectorLoad& load = state.vector_loads[reg_addr.reg];
+	load.vaddr = vector_req.vaddr;
+	load.stride = (int16_t)vector_req.flags;
+	load.num_elements = vector_req.size / sizeof(float);
+	load.pending = 0;
+
+	uint num_elements = load.stride == 0 ? std::min(load.num_elements, (uint8_t)1) : load.num_elements;
+	for(uint i = 0; i < num_elements;)
+	{
+		MemoryRequest req;
+		req.type = vector_req.type;
+		req.flags = 0;
+		req.dst = (thread_id << 8) | reg_addr.u8;
+		req.port = _tp_index;
+		req.vaddr = vector_req.vaddr + (int64_t)i * load.stride;
+		assert((req.vaddr & (sizeof(float) - 1)) == 0);
+
+		uint j = i + 1;
+		if(load.stride == sizeof(float))
+		{
+			paddr_t line = req.vaddr & ~(paddr_t)(CACHE_BLOCK_SIZE - 1);
+			while(j < num_elements && ((req.vaddr + (j - i) * sizeof(float)) & ~(paddr_t)(CACHE_BLOCK_SIZE - 1)) == line) ++j;
+		}
+
+		req.size = (j - i) * sizeof(float);
+		req.write_mask = generate_nbit_mask(req.size);
+		if(req.type == MemoryRequest::Type::STORE)
+			std::memcpy(req.data, vector_req.data + i * sizeof(float), req.size);
+		i = j;
+
+		if(req.vaddr >= (~0x0ull << 20))
+		{
+			if((req.vaddr | state.stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), assert(false);
+			paddr_t buffer_addr = req.vaddr & state.stack_mask;
+			if(req.type == MemoryRequest::Type::LOAD) _write_vector_elements(thread_id, reg_addr.reg, req.vaddr, req.size, &state.stack_mem[buffer_addr]);
+			else                                      std::memcpy(&state.stack_mem[buffer_addr], req.data, req.size);
+			continue;
+		}
+
+		assert(req.vaddr < 4ull * 1024ull * 1024ull * 1024ull);
+		if(req.type == MemoryRequest::Type::LOAD) load.pending++;
+		_replay_queue.push_back({mem, req});
+	}
+
+	if(load.pending) _set_dependancies(thread_id);
+	if(_replay_queue.empty()) return;
+
+	//_decode already checked the port
+	_replay_queue.front().first->write_request(_replay_queue.front().second);
+	_replay_queue.pop_front();
+	_replay_type = thread.instr_info.instr_type;
+	_replay_pc = thread.pc;
+}
 
+void UnitTP::_issue(uint exec_thread_id)
+{
+	//Reg/PC read
+	ThreadData& thread = _thread_data[exec_thread_id];
+	_log_instruction_issue(exec_thread_id);
+
+	//Execute
+	MemoryRequest req;
+	vaddr_t next_pc = _execute(exec_thread_id, req);
+	if(!_trace_encoders.empty())
+		_trace_encoders[exec_thread_id].write(thread.pc, thread.instr_size, next_pc, thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY ? &req : nullptr);
+
+	if (thread.instr_info.exec_type == ISA::RISCV::ExecType::EXECUTABLE)
+	{
 		//Issue to SFU
 		ISA::RISCV::RegAddr reg_addr;
 		reg_addr.reg = thread.instr.rd;
 		reg_addr.reg_type = thread.instr_info.dst_reg_type;
 
-		SFURequest req;
-		req.dst = (exec_thread_id << 8) | reg_addr.u8;
-		req.port = _tp_index;
+		SFURequest sfu_req;
+		sfu_req.dst = (exec_thread_id << 8) | reg_addr.u8;
+		sfu_req.port = _tp_index;
 
 		//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set the pending bit
 		UnitSFU* sfu = (UnitSFU*)_unit_table[(uint)thread.instr_info.instr_type];
 		if (sfu)
 		{
 			_set_dependancies(exec_thread_id);
-			sfu->write_request(req);
+			sfu->write_request(sfu_req);
 		} 
 	}
+	else if (thread.instr_info.encoding == ISA::RISCV::Encoding::VL || thread.instr_info.encoding == ISA::RISCV::Encoding::VS)
+	{
+		_issue_vector_request(exec_thread_id, req);
+	}
 	else if (thread.instr_info.exec_type == ISA::RISCV::ExecType::MEMORY)
 	{
-		MemoryRequest req = thread.instr_info.generate_request(exec_item, thread.instr);
 		req.dst = (exec_thread_id << 8) | req.dst;
 		req.port = _tp_index;
 
@@ -358,25 +809,26 @@ void UnitTP::clock_fall()
 		}
 		else
 		{
-			if ((req.vaddr | thread.stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), assert(false);
+			ThreadState& state = _thread_states[exec_thread_id];
+			if ((req.vaddr | state.stack_mask) != ~0x0ull) printf("STACK OVERFLOW!!!\n"), assert(false);
 			if (thread.instr_info.instr_type == ISA::RISCV::InstrType::LOAD)
 			{
 				//Because of forwarding instruction with latency 1 don't cause stalls so we don't need to set pending bit
-				paddr_t buffer_addr = req.vaddr & thread.stack_mask;
-				write_register(&thread.int_regs, &thread.float_regs, req.dst, req.size, &thread.stack_mem[buffer_addr]);
+				paddr_t buffer_addr = req.vaddr & state.stack_mask;
+				write_register(&state.int_regs, &state.float_regs, req.dst, req.size, &state.stack_mem[buffer_addr]);
 			}
 			else if (thread.instr_info.instr_type == ISA::RISCV::InstrType::STORE)
 			{
-				paddr_t buffer_addr = req.vaddr & thread.stack_mask;
-				std::memcpy(&thread.stack_mem[buffer_addr], req.data, req.size);
+				paddr_t buffer_addr = req.vaddr & state.stack_mask;
+				std::memcpy(&state.stack_mem[buffer_addr], req.data, req.size);
 			}
 			else assert(false);
 		}
 	}
-	else assert(false);
 
-	if(!jump) thread.pc += 4;
-	thread.int_regs.zero.u64 = 0x0ull; //Compilers generate instructions with zero register as target so we need to zero the register every cycle
+	thread.pc = next_pc;
+	_thread_states[exec_thread_id].int_regs.zero.u64 = 0x0ull; //Compilers generate instructions with zero register as target so we need to zero the register every cycle
+	if(_fetch_queue_size) _resolve_front_end(exec_thread_id);
 	thread.instr.data = 0;
 	_last_thread_id = exec_thread_id;
 
@@ -387,9 +839,9 @@ void UnitTP::clock_fall()
 		if(_num_halted_threads == _num_threads)
 			--simulator->units_executing;
 	} 
-	else if((thread.pc - thread.i_buffer.paddr) >= CACHE_BLOCK_SIZE)
+	else if(!_fetch_queue_size)
 	{
-		_thread_fetch_arbiter.add(exec_thread_id); //queue i buffer fetch
+		_check_i_buffer(exec_thread_id, thread.pc);
 	}
 }
 
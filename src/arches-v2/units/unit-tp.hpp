@@ -9,13 +9,21 @@
 #include "isa/riscv.hpp"
 
 #include "util/bit-manipulation.hpp"
+#include "util/branch-predictor.hpp"
+#include "util/elf.hpp"
+#include "util/instr-trace.hpp"
+#include "util/arena.hpp"
 
 namespace Arches {
 namespace Units {
 
+#define MAX_ISSUE_WIDTH 8
+
 class UnitTP : public UnitBase
 {
 public:
+	class Profile;
+
 	struct Configuration
 	{
 		vaddr_t pc{ 0x0 };
@@ -27,9 +35,29 @@ public:
 		uint tp_index{ 0 };
 		uint tm_index{ 0 };
 
-		uint num_threads{ 8 };
+		uint num_threads{ 8 }; //hardware thread contexts
+		uint issue_width{ 1 }; //max instructions issued per cycle, each from a different thread
+
+		//Oversubscription. Threads beyond num_threads wait in a backing context store and are swapped in when a resident thread
+		//blocks on a memory result.
+		uint num_logical_threads{ 0 }; //0 means num_threads
+		uint context_swap_cost{ 16 }; //cycles a context can't issue while its state is swapped
+		uint context_swap_threshold{ 16 }; //cycles a thread must wait on a memory result before it is swapped out
+
+		//Front end model. With fetch_queue_size 0 instructions are read straight from the i-buffer and branches resolve for free.
+		uint fetch_queue_size{ 0 }; //instructions buffered per thread
+		uint fetch_width{ 1 }; //instructions the front end reads per cycle for one thread
+		uint mispredict_penalty{ 4 }; //cycles before fetch resumes after a redirect
+		Util::BranchPredictor::Type branch_predictor{ Util::BranchPredictor::Type::STATIC };
+		uint branch_predictor_size_log2{ 10 };
+		uint btb_size{ 0 }; //0 means direct branch targets are known when the instruction is read
 
 		uint stack_size{ 512 };
+		Util::Arena* arena{ nullptr }; //thread stacks are allocated from this
+
+		Profile* profile{ nullptr }; //per pc counters, shared by the TPs of a TM. Profiling is off if nullptr
+
+		Util::InstrTraceWriter* instr_trace{ nullptr }; //records every thread's dynamic instruction stream
 
 		const std::vector<UnitBase*>* unit_table;
 		const std::vector<UnitSFU*>* unique_sfus;
@@ -39,30 +67,84 @@ public:
 	};
 
 protected:
+	struct FetchQueueEntry
+	{
+		vaddr_t  pc;
+		vaddr_t  predicted_pc; //~0 if fetch stopped here
+		uint64_t history; //branch history before this instruction
+		uint32_t instr;
+		uint8_t  size;
+	};
 
+	//Hot per thread state. Scanned by decode every cycle so it is kept apart from the register files and stack.
 	struct ThreadData
 	{
-		ISA::RISCV::IntegerRegisterFile       int_regs{};
-		ISA::RISCV::FloatingPointRegisterFile float_regs{};
-		vaddr_t                               pc{};
+		vaddr_t pc{};
+		ISA::RISCV::Instruction instr{0x0ull};
+		uint8_t instr_size{4};
+		ISA::RISCV::InstructionInfo instr_info;
+
+		uint8_t float_regs_pending[32];
+		uint8_t int_regs_pending[32];
+		uint8_t vector_regs_pending[32];
+
+		uint8_t* regs_pending(ISA::RISCV::RegType reg_type)
+		{
+			if(reg_type == ISA::RISCV::RegType::INT)   return int_regs_pending;
+			if(reg_type == ISA::RISCV::RegType::FLOAT) return float_regs_pending;
+			return vector_regs_pending;
+		}
+
+		uint context{~0u}; //hardware context holding this thread. ~0 if it is in the backing store
 
 		uint8_t* cheat_memory{nullptr};
 		struct IBuffer
 		{
-			uint8_t data[CACHE_BLOCK_SIZE];
+			//data[0-1] holds the last parcel of the previous line if it was fetched right before this one. This lets 4 byte
+			//instructions straddle two lines.
+			uint8_t data[2 + CACHE_BLOCK_SIZE];
 			paddr_t paddr{0};
+			bool    has_prev{false};
 		}i_buffer;
+		paddr_t i_fetch_paddr{0};
+		bool    i_fetch_pending{false};
+
+		std::deque<FetchQueueEntry> fetch_queue;
+		vaddr_t  fetch_pc{0};
+		uint64_t branch_history{0};
+		cycles_t fetch_resume_cycle{0}; //fetch waits out the mispredict penalty until this cycle
+		bool     fetch_blocked{false};
+	};
 
-		ISA::RISCV::Instruction instr{0x0ull};
-		ISA::RISCV::InstructionInfo instr_info;
+	//Vector load in flight. Returns find their elements from the address since dst only has room for the register.
+	struct VectorLoad
+	{
+		vaddr_t vaddr;
+		int16_t stride;
+		uint8_t num_elements;
+		uint8_t pending; //requests still in flight
+	};
 
-		uint8_t float_regs_pending[32];
-		uint8_t int_regs_pending[32];
+	//Cold per thread state. Only touched when the thread issues or a load returns.
+	struct ThreadState
+	{
+		ISA::RISCV::IntegerRegisterFile       int_regs{};
+		ISA::RISCV::FloatingPointRegisterFile float_regs{};
+		ISA::RISCV::VectorRegisterFile        vector_regs{};
+		VectorLoad                            vector_loads[32];
 
-		std::vector<uint8_t> stack_mem;
+		uint8_t* stack_mem{nullptr}; //from the simulator arena
 		uint64_t stack_mask;
 	};
 
+	struct Context
+	{
+		uint thread_id;
+		uint swap_cycles{0};
+		uint stall_cycles{0}; //consecutive cycles the resident thread has waited on a memory result
+		uint8_t stall_type{0}; //this cycle's _decode result for the resident thread
+	};
+
 
 	uint _tp_index;
 	uint _tm_index;
@@ -70,10 +152,33 @@ protected:
 
 	uint _last_thread_id;
 	uint _num_threads;
+	uint _issue_width;
+
+	uint _fetch_queue_size;
+	uint _fetch_width;
+	uint _mispredict_penalty;
+	uint _front_end_thread_id{0};
+	cycles_t _current_cycle{0};
+	Util::BranchPredictor _branch_predictor;
+	Util::BranchTargetBuffer _btb;
 	uint _num_halted_threads;
 	RoundRobinArbiter _thread_exec_arbiter;
 	RoundRobinArbiter _thread_fetch_arbiter;
 	std::vector<ThreadData> _thread_data;
+	std::vector<ThreadState> _thread_states;
+
+	std::vector<Context> _contexts;
+	std::deque<uint> _backing_store; //threads that aren't resident in order of swap out
+	uint _context_swap_cost;
+	uint _context_swap_threshold;
+	bool _long_latency[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)]; //instruction types serviced by a memory unit
+
+	std::vector<Util::InstrTraceEncoder> _trace_encoders; //one per thread if recording
+
+	//Instructions that need more than one memory request send one per cycle from here. Issue is blocked until it drains.
+	std::deque<std::pair<UnitMemoryBase*, MemoryRequest>> _replay_queue;
+	ISA::RISCV::InstrType _replay_type;
+	vaddr_t _replay_pc;
 
 	const std::vector<UnitBase*>& _unit_table;
 	const std::vector<UnitSFU*>& _unique_sfus;
@@ -87,44 +192,120 @@ public:
 	void clock_fall() override;
 
 protected:
+	bool _read_i_buffer(const ThreadData& thread, vaddr_t pc, uint16_t& parcel);
+	void _check_i_buffer(uint thread_id, vaddr_t pc);
+	void _issue_i_fetch();
+	bool _read_instr(const ThreadData& thread, vaddr_t pc, uint32_t& instr, uint8_t& size);
+	bool _fetch_instr(uint thread_id);
+	void _clock_front_end();
+	void _resolve_front_end(uint thread_id);
+	bool _is_swap_ready(uint thread_id);
+	void _clock_contexts();
+	void _decode_contexts();
+	uint8_t _check_pipline_hazard(uint thread_id);
 	uint8_t _decode(uint thread_id);
+	virtual vaddr_t _execute(uint thread_id, MemoryRequest& req);
+	void _issue(uint thread_id);
+	void _issue_vector_request(uint thread_id, const MemoryRequest& req);
+	void _write_vector_elements(uint thread_id, uint vreg, vaddr_t vaddr, uint size, const uint8_t* data);
+	uint32_t _trace_stream_id(uint thread_id) const { return _tm_index << 16 | _tp_index << 8 | thread_id; }
 	virtual uint8_t _check_dependancies(uint thread_id);
 	virtual void _set_dependancies(uint thread_id);
-	void _process_load_return(const MemoryReturn& ret);
+	virtual void _process_load_return(const MemoryReturn& ret);
+	virtual void _process_sfu_return(const SFURequest& ret);
 	void _clear_register_pending(uint thread_id, ISA::RISCV::RegAddr dst);
 	void _log_instruction_issue(uint thread_id);
 
 public:
+	//Cycles spent on one instruction split by what it was doing
+	template <typename T>
+	struct ProfileCounters
+	{
+		T issue;
+		T resource_stall;
+		T data_stall[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)]; //by the type of the instruction it was waiting on. INSRT_FETCH for i-fetch stalls
+		T mispredicts;
+
+		uint64_t total() const
+		{
+			uint64_t total = (uint64_t)issue + resource_stall;
+			for(uint i = 0; i < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++i)
+				total += data_stall[i];
+			return total;
+		}
+	};
+
+	//Per pc counters for [text_start, text_start + text_size), one per 2 byte parcel. A whole text segment of 64 bit counters per
+	//TP doesn't fit in memory on large configs so one profile is shared by all the TPs of a TM, which are clocked by the same unit
+	//group, and the counters are 32 bit. Logs sum profiles into 64 bit counters for printing.
+	class Profile
+	{
+	public:
+		vaddr_t text_start;
+		std::vector<ProfileCounters<uint32_t>> counters;
+
+		Profile(vaddr_t text_start, uint64_t text_size) : text_start(text_start), counters(text_size / 2, ProfileCounters<uint32_t>{}) {}
+
+		//nullptr if pc is outside the text segment
+		ProfileCounters<uint32_t>* get(vaddr_t pc)
+		{
+			uint64_t instr_index = (pc - text_start) / 2;
+			if(instr_index >= counters.size()) return nullptr;
+			return &counters[instr_index];
+		}
+	};
+
 	class Log
 	{
 	protected:
-		vaddr_t _elf_start_addr;
-		std::vector<uint64_t> _profile_counters;
+		Profile* _profile;
+		vaddr_t _text_start{ 0 };
+		std::vector<ProfileCounters<uint64_t>> _profile_counters; //sum of the accumulated profiles
+		uint64_t _branches;
+		uint64_t _mispredicts;
+		uint64_t _context_swaps;
+		uint64_t _context_swap_stalls;
 		uint _instr_index{ 0 };
 
 		uint64_t _cycles;
+		uint64_t _issue_slots;
+		uint64_t _issue_width_counters[MAX_ISSUE_WIDTH + 1]; //cycles that issued i instructions
 		uint64_t _instruction_counters[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)];
 		uint64_t _resource_stall_counters[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)];
 		uint64_t _data_stall_counters[static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES)];
 
 	public:
-		Log(uint64_t elf_start_addr) : _elf_start_addr(elf_start_addr) { reset(); }
+		Log(Profile* profile = nullptr) : _profile(profile) { reset(); }
 
 		void reset()
 		{
 			_cycles = 0;
+			_branches = 0;
+			_mispredicts = 0;
+			_context_swaps = 0;
+			_context_swap_stalls = 0;
+			_profile_counters.clear();
+			_issue_slots = 0;
+			for(uint i = 0; i <= MAX_ISSUE_WIDTH; ++i)
+				_issue_width_counters[i] = 0;
 			for (uint i = 0; i < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++i)
 			{
 				_instruction_counters[i] = 0;
 				_resource_stall_counters[i] = 0;
 				_data_stall_counters[i] = 0;
-				_profile_counters.clear();
 			}
 		}
 
 		void accumulate(const Log& other)
 		{
 			_cycles += other._cycles;
+			_branches += other._branches;
+			_mispredicts += other._mispredicts;
+			_context_swaps += other._context_swaps;
+			_context_swap_stalls += other._context_swap_stalls;
+			_issue_slots += other._issue_slots;
+			for(uint i = 0; i <= MAX_ISSUE_WIDTH; ++i)
+				_issue_width_counters[i] += other._issue_width_counters[i];
 			for (uint i = 0; i < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++i)
 			{
 				_instruction_counters[i] += other._instruction_counters[i];
@@ -132,43 +313,65 @@ public:
 				_data_stall_counters[i] += other._data_stall_counters[i];
 			}
 
-			_profile_counters.resize(std::max(_profile_counters.size(), other._profile_counters.size()), 0ull);
-			for (uint i = 0; i < other._profile_counters.size(); ++i)
-			{
-				_profile_counters[i] += other._profile_counters[i];
-			}
+			//shared profiles are accumulated on their own so they are only counted once
+			if(!other._profile_counters.empty()) _accumulate_profile(other._text_start, other._profile_counters);
 		}
 
-		void profile_instruction(vaddr_t pc)
+		void accumulate(const Profile& profile)
 		{
-			assert(pc >= _elf_start_addr);
+			_accumulate_profile(profile.text_start, profile.counters);
+		}
 
-			uint instr_index = (pc - _elf_start_addr) / 4;
-			if (instr_index >= _profile_counters.size())
-				_profile_counters.resize(instr_index + 1, 0ull);
+		//nullptr if profiling is off or pc is outside the text segment
+		ProfileCounters<uint32_t>* profile_counters(vaddr_t pc)
+		{
+			return _profile ? _profile->get(pc) : nullptr;
+		}
+
+		void log_branch(vaddr_t pc, bool mispredicted)
+		{
+			_branches++;
+			if(!mispredicted) return;
 
-			_profile_counters[instr_index]++;
+			_mispredicts++;
+			if(ProfileCounters<uint32_t>* counters = profile_counters(pc)) counters->mispredicts++;
 		}
 
-		void log_instruction_issue(const ISA::RISCV::InstrType type, vaddr_t pc)
+		void log_context_swap()
+		{
+			_context_swaps++;
+		}
+
+		//no instruction issued because the contexts were busy swapping
+		void log_context_swap_stall()
+		{
+			_context_swap_stalls++;
+		}
+
+		//called once per cycle, the instructions themselves are counted by log_instruction_issue
+		void log_issue_cycle(uint issue_width, uint issued)
 		{
 			_cycles++;
+			_issue_slots += issue_width;
+			_issue_width_counters[issued]++;
+		}
+
+		void log_instruction_issue(const ISA::RISCV::InstrType type, vaddr_t pc)
+		{
 			_instruction_counters[(uint)type]++;
-			profile_instruction(pc);
+			if(ProfileCounters<uint32_t>* counters = profile_counters(pc)) counters->issue++;
 		}
 
 		void log_resource_stall(const ISA::RISCV::InstrType type, vaddr_t pc)
 		{
-			_cycles++;
 			_resource_stall_counters[(uint)type]++;
-			profile_instruction(pc);
+			if(ProfileCounters<uint32_t>* counters = profile_counters(pc)) counters->resource_stall++;
 		}
 
 		void log_data_stall(const ISA::RISCV::InstrType type, vaddr_t pc)
 		{
-			_cycles++;
 			_data_stall_counters[(uint)type]++;
-			profile_instruction(pc);
+			if(ProfileCounters<uint32_t>* counters = profile_counters(pc)) counters->data_stall[(uint)type]++;
 		}
 
 		void print_log(FILE* stream = stdout, uint num_units = 1)
@@ -184,7 +387,7 @@ public:
 			std::sort(_instruction_counter_pairs.begin(), _instruction_counter_pairs.end(),
 				[](const std::pair<const char*, uint64_t>& a, const std::pair<const char*, uint64_t>& b) -> bool { return a.second > b.second; });
 
-			fprintf(stream, "Issue Cycles (%.2f%%)\n", 100.0f * total / _cycles);
+			fprintf(stream, "Issue Cycles (%.2f%%)\n", 100.0f * (_cycles - _issue_width_counters[0]) / _cycles);
 			fprintf(stream, "\tTotal: %lld\n", total / num_units);
 			for (uint i = 0; i < _instruction_counter_pairs.size(); ++i)
 				if (_instruction_counter_pairs[i].second) fprintf(stream, "\t%s: %lld (%.2f%%)\n", _instruction_counter_pairs[i].first, _instruction_counter_pairs[i].second / num_units, static_cast<float>(_instruction_counter_pairs[i].second) / total * 100.0f);
@@ -220,34 +423,158 @@ public:
 			fprintf(stream, "\tTotal: %lld\n", total / num_units);
 			for (uint i = 0; i < _data_stall_counter_pairs.size(); ++i)
 				if (_data_stall_counter_pairs[i].second) fprintf(stream, "\t%s: %lld (%.2f%%)\n", _data_stall_counter_pairs[i].first, _data_stall_counter_pairs[i].second / num_units, static_cast<float>(_data_stall_counter_pairs[i].second) / total * 100.0f);
+
+			uint64_t issue_cycles = 0, issued = 0;
+			for(uint i = 0; i <= MAX_ISSUE_WIDTH; ++i)
+			{
+				issue_cycles += _issue_width_counters[i];
+				issued += i * _issue_width_counters[i];
+			}
+
+			if(_context_swaps)
+			{
+				fprintf(stream, "\nContext Swaps: %lld\n", _context_swaps / num_units);
+				fprintf(stream, "\tSwap Stall Cycles: %lld (%.2f%%)\n", _context_swap_stalls / num_units, 100.0f * _context_swap_stalls / _cycles);
+			}
+
+			if(_branches)
+			{
+				fprintf(stream, "\nBranches: %lld\n", _branches / num_units);
+				fprintf(stream, "\tMispredicts: %lld (%.2f%%)\n", _mispredicts / num_units, 100.0f * _mispredicts / _branches);
+			}
+
+			fprintf(stream, "\nIssue Slot Utilization: %.2f%%\n", 100.0f * issued / _issue_slots);
+			for(uint i = 0; i <= MAX_ISSUE_WIDTH; ++i)
+				if(_issue_width_counters[i]) fprintf(stream, "\t%d Issued: %lld (%.2f%%)\n", i, _issue_width_counters[i] / num_units, 100.0f * _issue_width_counters[i] / issue_cycles);
 		}
 
-		void print_profile(uint8_t* backing_memory, FILE* stream = stdout)
+		void print_profile(uint8_t* backing_memory, FILE* stream = stdout, const ELF* elf = nullptr)
 		{
 			uint64_t total = 0;
+			std::map<const ELF::SymbolTable::ArrayElement*, uint64_t> function_totals;
+			for (uint i = 0; i < _profile_counters.size(); ++i)
+			{
+				uint64_t instr_total = _profile_counters[i].total();
+				total += instr_total;
+				function_totals[_find_function(elf, i * 2 + _text_start)] += instr_total;
+			}
 
 			fprintf(stream, "Profile\n");
-			for (uint i = 0; i < _profile_counters.size(); ++i) total += _profile_counters[i];
+			const ELF::SymbolTable::ArrayElement* last_function = nullptr;
 			for (uint i = 0; i < _profile_counters.size(); ++i)
 			{
-				//fetch
-				if (_profile_counters[i] > 0)
-				{
-					vaddr_t pc = i * 4 + _elf_start_addr;
-
-					ISA::RISCV::Instruction instr(reinterpret_cast<uint32_t*>(backing_memory)[pc / 4]);
-					const ISA::RISCV::InstructionInfo instr_info = instr.get_info();
-
-					float precent = 100.0f * (float)_profile_counters[i] / total;
-					if (precent > 1.0f) fprintf(stream, "*\t");
-					else fprintf(stream, " \t");
-
-					fprintf(stream, "%05I64x(%05.02f%%):          \t", pc, precent);
-					instr_info.print_instr(instr, stream);
-					fprintf(stream, "\n");
-				}
+				const ProfileCounters<uint64_t>& counters = _profile_counters[i];
+				uint64_t instr_total = counters.total();
+				if (instr_total == 0) continue;
+
+				vaddr_t pc = i * 2 + _text_start;
+				const ELF::SymbolTable::ArrayElement* function = _find_function(elf, pc);
+				if (function && function != last_function)
+					fprintf(stream, "%s (%05.02f%%):\n", function->name.c_str(), 100.0f * function_totals[function] / total);
+				last_function = function;
+
+				ISA::RISCV::Instruction instr(_read_instr(backing_memory, pc));
+				const ISA::RISCV::InstructionInfo instr_info = instr.get_info();
+
+				float precent = 100.0f * (float)instr_total / total;
+				if (precent > 1.0f) fprintf(stream, "*\t");
+				else fprintf(stream, " \t");
+
+				fprintf(stream, "%05I64x(%05.02f%%):          \t", pc, precent);
+				instr_info.print_instr(instr, stream);
+
+				//split the cycles by stall reason
+				fprintf(stream, "\tissue: %.0f%%", 100.0f * counters.issue / instr_total);
+				if (counters.resource_stall) fprintf(stream, ", %s pipline: %.0f%%", ISA::RISCV::InstructionTypeNameDatabase::get_instance()[instr_info.instr_type].c_str(), 100.0f * counters.resource_stall / instr_total);
+				for (uint j = 0; j < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++j)
+					if (counters.data_stall[j]) fprintf(stream, ", %s data: %.0f%%", ISA::RISCV::InstructionTypeNameDatabase::get_instance()[(ISA::RISCV::InstrType)j].c_str(), 100.0f * counters.data_stall[j] / instr_total);
+				if (counters.mispredicts > 0)
+					fprintf(stream, "\tmispredicts: %lld", counters.mispredicts);
+				fprintf(stream, "\n");
 			}
 		}
+
+		//One row per instruction with cycles split by stall reason
+		void print_profile_csv(uint8_t* backing_memory, FILE* stream, const ELF* elf = nullptr)
+		{
+			fprintf(stream, "pc,function,offset,instruction,total,issue,pipline_stall");
+			for (uint j = 0; j < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++j)
+				fprintf(stream, ",%s_data_stall", ISA::RISCV::InstructionTypeNameDatabase::get_instance()[(ISA::RISCV::InstrType)j].c_str());
+			fprintf(stream, ",mispredicts\n");
+
+			for (uint i = 0; i < _profile_counters.size(); ++i)
+			{
+				const ProfileCounters<uint64_t>& counters = _profile_counters[i];
+				uint64_t instr_total = counters.total();
+				if (instr_total == 0) continue;
+
+				vaddr_t pc = i * 2 + _text_start;
+				const ELF::SymbolTable::ArrayElement* function = _find_function(elf, pc);
+				ISA::RISCV::Instruction instr(_read_instr(backing_memory, pc));
+
+				fprintf(stream, "0x%I64x,%s,%lld,\"", pc, function ? function->name.c_str() : "", function ? pc - function->st_value.u64 : 0ull);
+				instr.get_info().print_instr(instr, stream);
+				fprintf(stream, "\",%lld,%lld,%lld", instr_total, counters.issue, counters.resource_stall);
+				for (uint j = 0; j < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++j)
+					fprintf(stream, ",%lld", counters.data_stall[j]);
+				fprintf(stream, ",%lld\n", counters.mispredicts);
+			}
+		}
+
+		//Collapsed stack format ("frame;frame;frame count") read by flamegraph.pl, inferno and speedscope. We don't track call
+		//stacks so each stack is function;pc;reason.
+		void print_profile_folded(FILE* stream, const ELF* elf = nullptr)
+		{
+			for (uint i = 0; i < _profile_counters.size(); ++i)
+			{
+				const ProfileCounters<uint64_t>& counters = _profile_counters[i];
+				if (counters.total() == 0) continue;
+
+				vaddr_t pc = i * 2 + _text_start;
+				const ELF::SymbolTable::ArrayElement* function = _find_function(elf, pc);
+				const char* function_name = function ? function->name.c_str() : "unknown";
+
+				if (counters.issue) fprintf(stream, "%s;0x%I64x;issue %lld\n", function_name, pc, counters.issue);
+				if (counters.resource_stall) fprintf(stream, "%s;0x%I64x;pipline_stall %lld\n", function_name, pc, counters.resource_stall);
+				for (uint j = 0; j < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++j)
+					if (counters.data_stall[j]) fprintf(stream, "%s;0x%I64x;%s_data_stall %lld\n", function_name, pc, ISA::RISCV::InstructionTypeNameDatabase::get_instance()[(ISA::RISCV::InstrType)j].c_str(), counters.data_stall[j]);
+			}
+		}
+
+	private:
+		template <typename T>
+		void _accumulate_profile(vaddr_t text_start, const std::vector<ProfileCounters<T>>& other_counters)
+		{
+			if(_profile_counters.empty())
+			{
+				_text_start = text_start;
+				_profile_counters.resize(other_counters.size(), ProfileCounters<uint64_t>{});
+			}
+
+			assert(_text_start == text_start && _profile_counters.size() == other_counters.size());
+			for (uint i = 0; i < other_counters.size(); ++i)
+			{
+				ProfileCounters<uint64_t>& counters = _profile_counters[i];
+				counters.issue += other_counters[i].issue;
+				counters.resource_stall += other_counters[i].resource_stall;
+				for(uint j = 0; j < static_cast<size_t>(ISA::RISCV::InstrType::NUM_TYPES); ++j)
+					counters.data_stall[j] += other_counters[i].data_stall[j];
+				counters.mispredicts += other_counters[i].mispredicts;
+			}
+		}
+
+		static const ELF::SymbolTable::ArrayElement* _find_function(const ELF* elf, vaddr_t pc)
+		{
+			if (!elf || !elf->symbol_table) return nullptr;
+			return elf->symbol_table->find_function(pc);
+		}
+
+		static uint32_t _read_instr(uint8_t* backing_memory, vaddr_t pc)
+		{
+			uint16_t parcels[2];
+			std::memcpy(parcels, backing_memory + pc, sizeof(parcels));
+			return ISA::RISCV::is_compressed(parcels[0]) ? ISA::RISCV::expand_compressed(parcels[0]) : parcels[0] | (uint32_t)parcels[1] << 16;
+		}
 	}log;
 };
 
@@ -70,6 +70,11 @@ typedef enum
     wq_capacity_token,
     address_mapping_token,
     wq_lookup_latency_token,
+    address_hash_token,
+    scheduling_policy_token,
+    wq_hi_wm_token,
+    wq_lo_wm_token,
+    batch_cap_token,
 
     comment_token,
     unknown_token
@@ -135,7 +140,12 @@ const tokenTranslator tokenTranslatorTable[] =
 
     {"WQ_CAPACITY",                 wq_capacity_token,              true},
     {"ADDRESS_MAPPING",             address_mapping_token,          true},
-    {"WQ_LOOKUP_LATENCY",           wq_lookup_latency_token,        true}
+    {"WQ_LOOKUP_LATENCY",           wq_lookup_latency_token,        true},
+    {"ADDRESS_HASH",                address_hash_token,             true},
+    {"SCHEDULING_POLICY",           scheduling_policy_token,        true},
+    {"WQ_HI_WM",                    wq_hi_wm_token,                 true},
+    {"WQ_LO_WM",                    wq_lo_wm_token,                 true},
+    {"BATCH_CAP",                   batch_cap_token,                true}
 };
 
 
@@ -277,6 +287,11 @@ void read_config_file(FILE * fin)
             case wq_capacity_token:                 WQ_CAPACITY              = input_int;                               break;
             case address_mapping_token:             ADDRESS_MAPPING          = input_int;                               break;
             case wq_lookup_latency_token:           WQ_LOOKUP_LATENCY        = input_int;                               break;
+            case address_hash_token:                ADDRESS_HASH             = input_int;                               break;
+            case scheduling_policy_token:           SCHEDULING_POLICY        = input_int;                               break;
+            case wq_hi_wm_token:                    WQ_HI_WM                 = input_int;                               break;
+            case wq_lo_wm_token:                    WQ_LO_WM                 = input_int;                               break;
+            case batch_cap_token:                   BATCH_CAP                = input_int;                               break;
 
             // badness
             default:
@@ -357,6 +372,11 @@ void print_params()
     printf("WQ_CAPACITY:                %6d\n", WQ_CAPACITY);
     printf("ADDRESS_MAPPING:            %6d\n", ADDRESS_MAPPING);
     printf("WQ_LOOKUP_LATENCY:          %6d\n", WQ_LOOKUP_LATENCY);
+    printf("ADDRESS_HASH:               %6d\n", ADDRESS_HASH);
+    printf("SCHEDULING_POLICY:          %6d\n", SCHEDULING_POLICY);
+    printf("WQ_HI_WM:                   %6d\n", WQ_HI_WM);
+    printf("WQ_LO_WM:                   %6d\n", WQ_LO_WM);
+    printf("BATCH_CAP:                  %6d\n", BATCH_CAP);
     printf("\n----------------------------------------------------------------------------------------\n");
 }
 
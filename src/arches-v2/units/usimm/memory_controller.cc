@@ -4,6 +4,7 @@
 #include <limits>
 
 #include "utils.h"
+#include "util/bit-manipulation.hpp"
 
 #include "params.h"
 #include "memory_controller.h"
@@ -88,6 +89,13 @@ double stats_average_read_queue_latency      [MAX_NUM_CHANNELS];
 double stats_average_write_latency           [MAX_NUM_CHANNELS];
 double stats_average_write_queue_latency     [MAX_NUM_CHANNELS];
 
+long long int stats_priority_reads_completed [MAX_NUM_CHANNELS];
+long long int stats_requester_reads          [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+long long int stats_requester_writes         [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+long long int stats_requester_row_hits       [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+long long int stats_requester_activates      [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+double stats_average_priority_read_latency   [MAX_NUM_CHANNELS];
+
 long long int stats_page_hits           [MAX_NUM_CHANNELS];
 double        stats_read_row_hit_rate   [MAX_NUM_CHANNELS];
 
@@ -270,6 +278,16 @@ void init_memory_controller_vars()
         stats_average_read_queue_latency[i]  = 0;
         stats_average_write_latency[i]       = 0;
         stats_average_write_queue_latency[i] = 0;
+        stats_priority_reads_completed[i]    = 0;
+        stats_average_priority_read_latency[i] = 0;
+
+        for (int j = 0; j < MAX_NUM_REQUESTERS; ++j)
+        {
+            stats_requester_reads[i][j]     = 0;
+            stats_requester_writes[i][j]    = 0;
+            stats_requester_row_hits[i][j]  = 0;
+            stats_requester_activates[i][j] = 0;
+        }
         stats_page_hits[i]                   = 0;
         stats_read_row_hit_rate[i]           = 0;
 
@@ -297,47 +315,84 @@ unsigned int log_base2(unsigned int new_value)
     return i;
 }
 
-//DK: Most uses of calc_dram_addr are only for the channel.
-//    No point in malloc/freeing this structure just to get the channel
-int calc_dram_channel(const long long int physical_address)
+// Physical to dram address mapping. Every bit of a dram address field is the parity of the physical address
+// bits picked by its mask. A mask with a single bit set is a plain bit slice (ADDRESS_MAPPING picks the order
+// of the slices), ADDRESS_HASH folds row bits into the channel and bank bits so strided streams that would all
+// land on one channel or bank get spread out. Row and column bits are never hashed so the mapping stays 1:1.
+typedef enum
+{
+    FIELD_CHANNEL,
+    FIELD_RANK,
+    FIELD_BANK,
+    FIELD_ROW,
+    FIELD_COLUMN,
+    NUM_FIELDS
+} dram_field_t;
+
+static int                    field_width[NUM_FIELDS];
+static unsigned long long int field_masks[NUM_FIELDS][64];
+
+void init_address_mapping()
 {
-    long long int input_a;
-    long long int temp_b;
-    long long int temp_a;
+    field_width[FIELD_CHANNEL] = log_base2(NUM_CHANNELS);
+    field_width[FIELD_RANK]    = log_base2(NUM_RANKS);
+    field_width[FIELD_BANK]    = log_base2(NUM_BANKS);
+    field_width[FIELD_ROW]     = log_base2(NUM_ROWS);
+    field_width[FIELD_COLUMN]  = log_base2(NUM_COLUMNS);
 
-    int channelBitWidth = log_base2(NUM_CHANNELS);
-    //int rankBitWidth  = log_base2(NUM_RANKS);
-    //int bankBitWidth  = log_base2(NUM_BANKS);
-    //int rowBitWidth   = log_base2(NUM_ROWS);
-    int colBitWidth     = log_base2(NUM_COLUMNS);
-    int byteOffsetWidth = log_base2(CACHE_LINE_SIZE);
+    // 1 is consecutive cache-lines to same row
+    // 0 is consecutive cache-lines striped across different channels
+    const dram_field_t slice_order_1[NUM_FIELDS] = {FIELD_COLUMN, FIELD_CHANNEL, FIELD_BANK, FIELD_RANK, FIELD_ROW};
+    const dram_field_t slice_order_0[NUM_FIELDS] = {FIELD_CHANNEL, FIELD_BANK, FIELD_RANK, FIELD_COLUMN, FIELD_ROW};
+    const dram_field_t *slice_order = (ADDRESS_MAPPING == 1) ? slice_order_1 : slice_order_0;
 
-    //dram_address_t * this_a = (dram_address_t*)malloc(sizeof(dram_address_t));
-    //this_a->actual_address = physical_address;
+    int next_bit = log_base2(CACHE_LINE_SIZE);          // skip the cache_offset
+    for (int f = 0; f < NUM_FIELDS; ++f)
+    {
+        const dram_field_t field = slice_order[f];
+        for (int i = 0; i < field_width[field]; ++i)
+            field_masks[field][i] = 1ull << next_bit++;
+    }
 
-    input_a = physical_address;
-    input_a = input_a >> byteOffsetWidth;             // strip out the cache_offset
+    const int  rowBitWidth = field_width[FIELD_ROW];
+    const unsigned long long int *row_masks = field_masks[FIELD_ROW];
 
-    if (ADDRESS_MAPPING == 1)
+    if (ADDRESS_HASH == 1)
     {
-        temp_b  = input_a;
-        input_a = input_a >> colBitWidth;
-        temp_a  = input_a << colBitWidth;
-
-        temp_b  = input_a;
-        input_a = input_a >> channelBitWidth;
-        temp_a  = input_a << channelBitWidth;
-        return temp_a ^ temp_b;
+        // XOR fold all the row bits into the channel and the bank
+        for (int i = 0; i < rowBitWidth; ++i)
+        {
+            if (field_width[FIELD_CHANNEL]) field_masks[FIELD_CHANNEL][i % field_width[FIELD_CHANNEL]] |= row_masks[i];
+            if (field_width[FIELD_BANK])    field_masks[FIELD_BANK]   [i % field_width[FIELD_BANK]]    |= row_masks[i];
+        }
     }
-    else
+    else if (ADDRESS_HASH == 2 && rowBitWidth)
     {
-        temp_b  = input_a;
-        input_a = input_a >> channelBitWidth;
-        temp_a  = input_a << channelBitWidth;
-        return temp_a ^ temp_b;
+        // Permutation based interleaving (Zhang et al.). The low row bits permute the bank and the next row bits
+        // permute the channel, so rows that conflict in one bank are spread over all banks
+        int row_bit = 0;
+        for (int i = 0; i < field_width[FIELD_BANK]; ++i)
+            field_masks[FIELD_BANK][i] |= row_masks[row_bit++ % rowBitWidth];
+        for (int i = 0; i < field_width[FIELD_CHANNEL]; ++i)
+            field_masks[FIELD_CHANNEL][i] |= row_masks[row_bit++ % rowBitWidth];
     }
 }
 
+static inline long long int calc_dram_field(Arches::paddr_t physical_address, dram_field_t field)
+{
+    long long int value = 0;
+    for (int i = 0; i < field_width[field]; ++i)
+        value |= (long long int)(popcnt(physical_address & field_masks[field][i]) & 0x1) << i;
+    return value;
+}
+
+//DK: Most uses of calc_dram_addr are only for the channel.
+//    No point in malloc/freeing this structure just to get the channel
+int calc_dram_channel(const long long int physical_address)
+{
+    return (int)calc_dram_field(physical_address, FIELD_CHANNEL);
+}
+
 
 // Function to decompose the incoming DRAM address into the
 // constituent channel, rank, bank, row and column ids. 
@@ -345,77 +400,8 @@ int calc_dram_channel(const long long int physical_address)
 // by this function after you have used the return value.
 dram_address_t * calc_dram_addr(const long long int physical_address)
 {
-    long long int input_a;
-    long long int temp_b;
-    long long int temp_a;
-
-    int channelBitWidth = log_base2(NUM_CHANNELS);
-    int rankBitWidth    = log_base2(NUM_RANKS);
-    int bankBitWidth    = log_base2(NUM_BANKS);
-    int rowBitWidth     = log_base2(NUM_ROWS);
-    int colBitWidth     = log_base2(NUM_COLUMNS);
-    int byteOffsetWidth = log_base2(CACHE_LINE_SIZE);
-
     dram_address_t * this_a = (dram_address_t*)malloc(sizeof(dram_address_t));
-    this_a->actual_address  = physical_address;
-    input_a = physical_address;
-    input_a = input_a >> byteOffsetWidth;       // strip out the cache_offset
-
-    if (ADDRESS_MAPPING == 1)
-    {
-        temp_b  = input_a;
-        input_a = input_a >> colBitWidth;
-        temp_a  = input_a << colBitWidth;
-        this_a->column = temp_a ^ temp_b;       // strip out the column address
-
-        temp_b  = input_a;
-        input_a = input_a >> channelBitWidth;
-        temp_a  = input_a << channelBitWidth;
-        this_a->channel = temp_a ^ temp_b;      // strip out the channel address
-
-        temp_b  = input_a;
-        input_a = input_a >> bankBitWidth;
-        temp_a  = input_a << bankBitWidth;
-        this_a->bank = temp_a ^ temp_b;         // strip out the bank address 
-
-        temp_b  = input_a;
-        input_a = input_a >> rankBitWidth;
-        temp_a  = input_a << rankBitWidth;
-        this_a->rank = temp_a ^ temp_b;         // strip out the rank address
-
-        temp_b  = input_a;
-        input_a = input_a >> rowBitWidth;
-        temp_a  = input_a << rowBitWidth;
-        this_a->row = temp_a ^ temp_b;          // strip out the row number
-    }
-    else
-    {
-        temp_b  = input_a;
-        input_a = input_a >> channelBitWidth;
-        temp_a  = input_a << channelBitWidth;
-        this_a->channel = temp_a ^ temp_b;      // strip out the channel address
-
-        temp_b  = input_a;
-        input_a = input_a >> bankBitWidth;
-        temp_a  = input_a << bankBitWidth;
-        this_a->bank = temp_a ^ temp_b;         // strip out the bank address 
-
-        temp_b  = input_a;
-        input_a = input_a >> rankBitWidth;
-        temp_a  = input_a << rankBitWidth;
-        this_a->rank = temp_a ^ temp_b;         // strip out the rank address
-
-        temp_b  = input_a;
-        input_a = input_a >> colBitWidth;
-        temp_a  = input_a << colBitWidth;
-        this_a->column = temp_a ^ temp_b;       // strip out the column address
-
-        temp_b  = input_a;
-        input_a = input_a >> rowBitWidth;
-        temp_a  = input_a << rowBitWidth;
-        this_a->row = temp_a ^ temp_b;          // strip out the row number
-    }
-
+    *this_a = calcDramAddr(physical_address);
     return(this_a);
 }
 
@@ -424,82 +410,23 @@ int numDramChannels()
     return NUM_CHANNELS;
 }
 
+std::vector<uint64_t> dramChannelHash()
+{
+    return std::vector<uint64_t>(field_masks[FIELD_CHANNEL], field_masks[FIELD_CHANNEL] + field_width[FIELD_CHANNEL]);
+}
+
 // Function to decompose the incoming DRAM address into the
 // constituent channel, rank, bank, row and column ids. 
 // Note : This version does not return a pointer (save calls to malloc/free)
 dram_address_t calcDramAddr( Arches::paddr_t physical_address)
 {
-    long long int input_a;
-    long long int temp_b, temp_a;
-
-    const int channelBitWidth = log_base2(NUM_CHANNELS);
-    const int rankBitWidth    = log_base2(NUM_RANKS);
-    const int bankBitWidth    = log_base2(NUM_BANKS);
-    const int rowBitWidth     = log_base2(NUM_ROWS);
-    const int colBitWidth     = log_base2(NUM_COLUMNS);
-    const int byteOffsetWidth = log_base2(CACHE_LINE_SIZE);
-
     dram_address_t retVal;
     retVal.actual_address = physical_address;
-
-    input_a = physical_address;
-    input_a = input_a >> byteOffsetWidth;       // strip out the cache_offset
-
-    if (ADDRESS_MAPPING == 1)
-    {
-        temp_b  =  input_a;
-        input_a = (input_a >> colBitWidth);
-        temp_a  = (input_a << colBitWidth);
-        retVal.column = (temp_a ^ temp_b);      // strip out the column address
-
-        temp_b  = input_a;
-        input_a = (input_a >> channelBitWidth);
-        temp_a  = (input_a << channelBitWidth);
-        retVal.channel = (temp_a ^ temp_b);     // strip out the channel address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> bankBitWidth);
-        temp_a  = (input_a << bankBitWidth);
-        retVal.bank = (temp_a ^ temp_b);        // strip out the bank address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> rankBitWidth);
-        temp_a  = (input_a << rankBitWidth);
-        retVal.rank = (temp_a ^ temp_b);        // strip out the rank address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> rowBitWidth);
-        temp_a  = (input_a << rowBitWidth);
-        retVal.row = (temp_a ^ temp_b);         // strip out the row number
-    }
-    else
-    {
-        temp_b  =  input_a;
-        input_a = (input_a >> channelBitWidth);
-        temp_a  = (input_a << channelBitWidth);
-        retVal.channel = (temp_a ^ temp_b);     // strip out the channel address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> bankBitWidth);
-        temp_a  = (input_a << bankBitWidth);
-        retVal.bank = (temp_a ^ temp_b);        // strip out the bank address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> rankBitWidth);
-        temp_a  = (input_a << rankBitWidth);
-        retVal.rank = (temp_a ^ temp_b);        // strip out the rank address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> colBitWidth);
-        temp_a  = (input_a << colBitWidth);
-        retVal.column = (temp_a ^ temp_b);      //strip out the column address
-
-        temp_b  =  input_a;
-        input_a = (input_a >> rowBitWidth);
-        temp_a  = (input_a << rowBitWidth);
-        retVal.row = (temp_a ^ temp_b);         // strip out the row number
-    }
-
+    retVal.channel        = calc_dram_field(physical_address, FIELD_CHANNEL);
+    retVal.rank           = calc_dram_field(physical_address, FIELD_RANK);
+    retVal.bank           = calc_dram_field(physical_address, FIELD_BANK);
+    retVal.row            = calc_dram_field(physical_address, FIELD_ROW);
+    retVal.column         = calc_dram_field(physical_address, FIELD_COLUMN);
     return retVal;
 }
 
@@ -524,6 +451,9 @@ request_t init_new_node(const dram_address_t &dram_address,
     new_node.operation_type    = type;
     new_node.command_issuable  = false;
     new_node.request_served    = false;
+    new_node.priority          = archesRequest.priority;
+    new_node.marked            = false;
+    new_node.activated         = false;
 
     //dram_address_t * this_node_addr = calc_dram_addr(physical_address);
 
@@ -710,6 +640,7 @@ reqInsertRet_t insert_read(const dram_address_t &dram_address,
         else
         {
             foundReq->arches_reqs.push_back(arches_request);
+            foundReq->priority |= arches_request.priority;
         }
 
         return toReturn;
@@ -1156,6 +1087,8 @@ bool issue_request_command(request_t *request)
                 stats_num_activate_write[channel][rank][bank]++;
 
             stats_num_activate[channel][rank]++;
+            stats_requester_activates[channel][request->arches_reqs[0].requester]++;
+            request->activated = true;
             average_gap_between_activates[channel][rank] = ((average_gap_between_activates[channel][rank] * (stats_num_activate[channel][rank] - 1)) + (CYCLE_VAL - last_activate[channel][rank])) / stats_num_activate[channel][rank];
             last_activate[channel][rank]                 = CYCLE_VAL;
             command_issued_current_cycle[channel]        = true;
@@ -1166,6 +1099,9 @@ bool issue_request_command(request_t *request)
         case COL_READ_CMD:
         {
             current_col_reads[channel][rank][bank]++;
+            stats_requester_reads[channel][request->arches_reqs[0].requester]++;
+            if (!request->activated)
+                stats_requester_row_hits[channel][request->arches_reqs[0].requester]++;
 
             assert(dram_state[channel][rank][bank].state == ROW_ACTIVE);
 
@@ -1250,6 +1186,11 @@ bool issue_request_command(request_t *request)
             stats_reads_completed[channel]++;
             stats_average_read_latency[channel]       = ((stats_reads_completed[channel] - 1)*stats_average_read_latency[channel]       +  request->latency                               ) / stats_reads_completed[channel];
             stats_average_read_queue_latency[channel] = ((stats_reads_completed[channel] - 1)*stats_average_read_queue_latency[channel] + (request->dispatch_time - request->arrival_time)) / stats_reads_completed[channel];
+            if (request->priority)
+            {
+                stats_priority_reads_completed[channel]++;
+                stats_average_priority_read_latency[channel] = ((stats_priority_reads_completed[channel] - 1)*stats_average_priority_read_latency[channel] + request->latency) / stats_priority_reads_completed[channel];
+            }
             //UT_MEM_DEBUG("Req:%lld finishes at Cycle: %lld\n", request->id, request->completion_time);
 
             //printf("Cycle: %10lld, Reads  Completed = %5lld, this_latency= %5lld, latency = %f\n", CYCLE_VAL, stats_reads_completed[channel], request->latency, stats_average_read_latency[channel]);	
@@ -1272,6 +1213,10 @@ bool issue_request_command(request_t *request)
         {
             assert(dram_state[channel][rank][bank].state == ROW_ACTIVE);
 
+            stats_requester_writes[channel][request->arches_reqs[0].requester]++;
+            if (!request->activated)
+                stats_requester_row_hits[channel][request->arches_reqs[0].requester]++;
+
             //UT_MEM_DEBUG("\nCycle: %lld Cmd: COL_WRITE Req:%lld Chan:%d Rank:%d Bank:%d \n", CYCLE_VAL, request->id, channel, rank, bank);
 
             dram_state[channel][rank][bank].next_pre       = max((cycle + T_CWD + T_DATA_TRANS + T_WR), dram_state[channel][rank][bank].next_pre);
@@ -2130,61 +2075,67 @@ void update_memory()
     //memset(cas_issued_current_cycle, 0, sizeof(int) * NUM_CHANNELS * NUM_RANKS * NUM_BANKS);
 
     for (int channel = 0; channel < NUM_CHANNELS; channel++)
+        update_memory_channel(channel);
+}
+
+
+// per channel part of update_memory. Only touches state indexed by this
+// channel so different channels can be updated concurrently
+void update_memory_channel(const int channel)
+{
+    // make every channel ready to receive a new command
+    command_issued_current_cycle[channel] = false;
+    for (int rank = 0; rank < NUM_RANKS; rank++)
     {
-        // make every channel ready to receive a new command
-        command_issued_current_cycle[channel] = false;
-        for (int rank = 0; rank < NUM_RANKS; rank++)
+        //reset variable
+        for (int bank = 0; bank < NUM_BANKS; bank++)
         {
-            //reset variable
-            for (int bank = 0; bank < NUM_BANKS; bank++)
-            {
-                cas_issued_current_cycle[channel][rank][bank] = CIC_NONE;
-            }
+            cas_issued_current_cycle[channel][rank][bank] = CIC_NONE;
+        }
 
-            // clean out the activate record for
-            // CYCLE_VAL - T_FAW
-            flush_activate_record(channel, rank, CYCLE_VAL);
+        // clean out the activate record for
+        // CYCLE_VAL - T_FAW
+        flush_activate_record(channel, rank, CYCLE_VAL);
 
-            // if we are at the refresh completion
-            // deadline
-            if (CYCLE_VAL == next_refresh_completion_deadline[channel][rank])
-            {
-                // calculate the next
-                // refresh_issue_deadline
-                num_issued_refreshes[channel][rank]             = 0;
-                last_refresh_completion_deadline[channel][rank] = CYCLE_VAL;
-                next_refresh_completion_deadline[channel][rank] = CYCLE_VAL + 8 * T_REFI;
-                refresh_issue_deadline[channel][rank]           = next_refresh_completion_deadline[channel][rank] - T_RP - 8 * T_RFC;
-                forced_refresh_mode_on[channel][rank]           = false;
+        // if we are at the refresh completion
+        // deadline
+        if (CYCLE_VAL == next_refresh_completion_deadline[channel][rank])
+        {
+            // calculate the next
+            // refresh_issue_deadline
+            num_issued_refreshes[channel][rank]             = 0;
+            last_refresh_completion_deadline[channel][rank] = CYCLE_VAL;
+            next_refresh_completion_deadline[channel][rank] = CYCLE_VAL + 8 * T_REFI;
+            refresh_issue_deadline[channel][rank]           = next_refresh_completion_deadline[channel][rank] - T_RP - 8 * T_RFC;
+            forced_refresh_mode_on[channel][rank]           = false;
 //                issued_forced_refresh_commands[channel][rank]   = 0;
-            }
-            else if (CYCLE_VAL == refresh_issue_deadline[channel][rank] &&
-                     num_issued_refreshes[channel][rank] < 8)
-            {
-                // refresh_issue_deadline has been
-                // reached. Do the auto-refreshes
-                forced_refresh_mode_on[channel][rank] = true;
-                issue_forced_refresh_commands(channel, rank);
-            }
-            else if (CYCLE_VAL < refresh_issue_deadline[channel][rank])
-            {
-                //update the refresh_issue deadline
-                refresh_issue_deadline[channel][rank] = next_refresh_completion_deadline[channel][rank] - T_RP - (8 - num_issued_refreshes[channel][rank]) * T_RFC;
-            }
         }
+        else if (CYCLE_VAL == refresh_issue_deadline[channel][rank] &&
+                 num_issued_refreshes[channel][rank] < 8)
+        {
+            // refresh_issue_deadline has been
+            // reached. Do the auto-refreshes
+            forced_refresh_mode_on[channel][rank] = true;
+            issue_forced_refresh_commands(channel, rank);
+        }
+        else if (CYCLE_VAL < refresh_issue_deadline[channel][rank])
+        {
+            //update the refresh_issue deadline
+            refresh_issue_deadline[channel][rank] = next_refresh_completion_deadline[channel][rank] - T_RP - (8 - num_issued_refreshes[channel][rank]) * T_RFC;
+        }
+    }
 
-        // update the variables corresponding to the non-queue
-        // variables
-        update_issuable_commands(channel);
+    // update the variables corresponding to the non-queue
+    // variables
+    update_issuable_commands(channel);
 
-        // update the request cmds in the queues
-        update_read_queue_commands(channel);
+    // update the request cmds in the queues
+    update_read_queue_commands(channel);
 
-        update_write_queue_commands(channel);
+    update_write_queue_commands(channel);
 
-        // remove finished requests
-        clean_queues(channel);
-    }
+    // remove finished requests
+    clean_queues(channel);
 }
 
 
@@ -15,9 +15,10 @@
 #include "stdafx.hpp"
 
 #define MAX_QUEUE_LENGTH 80
-#define MAX_NUM_CHANNELS 16
+#define MAX_NUM_CHANNELS 64
 #define MAX_NUM_RANKS    16
 #define MAX_NUM_BANKS    32
+#define MAX_NUM_REQUESTERS 8
 
 #define BIG_ACTIVATION_WINDOW 1000000
 
@@ -68,6 +69,8 @@ typedef struct arches_request_t
 {
     uint return_id;
     uint channel;
+    bool priority; // favored by the stream aware scheduling policy
+    uint requester; // which class of ports sent this, dram commands are counted against the first requester of a request
 } arches_request_t;
 
 // Call-back for TRaX from USIMM
@@ -123,6 +126,9 @@ typedef struct req
     optype_t         operation_type;     // Read/Write
     bool             command_issuable;   // can this request be issued in the current cycle
     bool             request_served;     // if request has it's final command issued or not
+    bool             priority;           // one of the merged arches requests came from a priority port
+    bool             marked;             // part of the current batch (batched scheduling policy)
+    bool             activated;          // an ACT was issued for this request so its column command was not a row hit
 //    int                     instruction_id;     // 0 to ROBSIZE-1
 //    long long int           instruction_pc;     // phy address of instruction that generated this request (valid only for reads)
 
@@ -251,6 +257,13 @@ extern double stats_average_read_queue_latency      [MAX_NUM_CHANNELS];
 extern double stats_average_write_latency           [MAX_NUM_CHANNELS];
 extern double stats_average_write_queue_latency     [MAX_NUM_CHANNELS];
 
+extern long long int stats_priority_reads_completed [MAX_NUM_CHANNELS];
+extern long long int stats_requester_reads          [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+extern long long int stats_requester_writes         [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+extern long long int stats_requester_row_hits       [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+extern long long int stats_requester_activates      [MAX_NUM_CHANNELS][MAX_NUM_REQUESTERS];
+extern double stats_average_priority_read_latency   [MAX_NUM_CHANNELS];
+
 extern long long int stats_page_hits        [MAX_NUM_CHANNELS];
 extern double        stats_read_row_hit_rate[MAX_NUM_CHANNELS];
 
@@ -292,6 +305,9 @@ void init_memory_controller_vars();
 // called every cycle to update the read/write queues
 void update_memory();
 
+// update the read/write queues of a single channel
+void update_memory_channel(const int channel);
+
 // activate to bank allowed or not
 bool is_activate_allowed(const int channel,
                          const int rank,
@@ -388,6 +404,8 @@ reqInsertRet_t insert_write(const dram_address_t &dram_address,
 
 int numDramChannels();
 dram_address_t calcDramAddr(Arches::paddr_t physical_address);
+std::vector<uint64_t> dramChannelHash(); // bit i of the channel is the parity of the physical address bits in mask i
+void init_address_mapping();
 void registerUsimmListener(UsimmListener* listener);
 
 // convert the TRaX address to byte-addressed, cache-line-aligned
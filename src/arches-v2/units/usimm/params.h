@@ -88,4 +88,19 @@ extern int WQ_LOOKUP_LATENCY;           // WQ associative lookup
 // 2 is consecutive cache-lines striped across different banks 
 extern int ADDRESS_MAPPING;
 
+// Channel and bank hashing on top of ADDRESS_MAPPING
+// 0 is none, channel and bank are plain bit slices
+// 1 XORs all row bits into the channel and bank bits
+// 2 is permutation based interleaving, the low row bits permute the bank and the next row bits the channel
+extern int ADDRESS_HASH;
+
+// Command scheduling policy
+// 0 is FR-FCFS
+// 1 is batched FR-FCFS, the oldest BATCH_CAP reads per bank are marked and served before any newer read (PAR-BS style)
+// 2 is stream aware, row hits from priority ports are served before other requests
+extern int SCHEDULING_POLICY;
+extern int WQ_HI_WM;                    // start draining writes when the write queue grows past this
+extern int WQ_LO_WM;                    // stop draining writes once the write queue shrinks to this
+extern int BATCH_CAP;                   // max reads per bank marked in one batch
+
 #endif // __PARAMS_H__
@@ -3,6 +3,7 @@
 #include "utils.h"
 
 #include "memory_controller.h"
+#include "scheduler.h"
 #include "params.h"
 
 extern Arches::cycles_t CYCLE_VAL;
@@ -10,6 +11,15 @@ extern Arches::cycles_t CYCLE_VAL;
 int BANK_CAN_BE_CLOSED[MAX_NUM_CHANNELS][MAX_NUM_RANKS][MAX_NUM_BANKS];
 long long int schedule_count;
 
+// 1 means we are in write-drain mode for that channel
+int drain_writes[MAX_NUM_CHANNELS];
+
+// Stats. Kept per channel since channels are scheduled in parallel
+long long int stats_write_drains  [MAX_NUM_CHANNELS];
+long long int stats_batches_formed[MAX_NUM_CHANNELS];
+
+static const scheduling_policy_t* policy;
+
 
 void init_scheduler_vars()
 {
@@ -23,21 +33,17 @@ void init_scheduler_vars()
                 BANK_CAN_BE_CLOSED[i][j][k] = 0;
             }
         }
+
+        drain_writes[i]         = 0;
+        stats_write_drains[i]   = 0;
+        stats_batches_formed[i] = 0;
     }
+
+    policy = get_scheduling_policy(SCHEDULING_POLICY);
     return;
 }
 
 
-// write queue high water mark; begin draining writes if write queue exceeds this value
-#define HI_WM 40
-
-// end write queue drain once write queue has this many writes in it
-#define LO_WM 20
-
-// 1 means we are in write-drain mode for that channel
-int drain_writes[MAX_NUM_CHANNELS];
-
-
 /* Each cycle it is possible to issue a valid command from the read or write queues
    OR
    a valid precharge command to any bank (issue_precharge_command())
@@ -62,21 +68,136 @@ int drain_writes[MAX_NUM_CHANNELS];
    is_refresh_allowed, is_autoprecharge_allowed, is_activate_allowed.
 */
 
-void schedule(int channel)
+// A precharge is held back while another request in the queue still wants the open row
+static bool row_is_still_needed(int channel, const std::list<request_t> &queueRef, const request_t &request)
+{
+    const command_t col_cmd    = (request.operation_type == READ) ? COL_READ_CMD : COL_WRITE_CMD;
+    const int64_t   active_row = dram_state[channel][request.dram_addr.rank][request.dram_addr.bank].active_row;
+
+    std::list<request_t>::const_iterator iter = queueRef.begin();
+    for (; iter != queueRef.end(); ++iter)
+    {
+        if ((iter->dram_addr.row == active_row) && (iter->next_command == col_cmd))
+            return true;
+    }
+    return false;
+}
+
+// Issue the command of the oldest request that is ready and passes the filter. Returns false if nothing was issued
+template <typename Filter>
+static bool issue_oldest(int channel, std::list<request_t> &queueRef, Filter filter)
+{
+    std::list<request_t>::iterator iter = queueRef.begin();
+    for (; iter != queueRef.end(); ++iter)
+    {
+        if (!iter->command_issuable || !filter(*iter))
+            continue;
+
+        if (iter->next_command == PRE_CMD && row_is_still_needed(channel, queueRef, *iter))
+            continue;
+
+        issue_request_command(&(*iter));
+        return true;
+    }
+    return false;
+}
+
+static bool any_request(const request_t &)
+{
+    return true;
+}
+
+static bool fr_fcfs(int channel, std::list<request_t> &queueRef)
+{
+    return issue_oldest(channel, queueRef, any_request);
+}
+
+// PAR-BS style batching. Once every marked read has been served the oldest BATCH_CAP reads to each bank are
+// marked and form the next batch. Marked reads go first (row hits first), so a stream of row hits can't
+// starve older reads to other rows for longer than one batch. Requests don't carry a thread id so there is no
+// thread ranking within a batch.
+static bool batched_fr_fcfs(int channel, std::list<request_t> &queueRef)
+{
+    bool batch_done = true;
+    std::list<request_t>::iterator iter = queueRef.begin();
+    for (; iter != queueRef.end(); ++iter)
+    {
+        if (iter->marked && !iter->request_served)
+        {
+            batch_done = false;
+            break;
+        }
+    }
+
+    if (batch_done && !queueRef.empty())
+    {
+        int marked_per_bank[MAX_NUM_RANKS][MAX_NUM_BANKS];
+        memset(marked_per_bank, 0, sizeof(marked_per_bank));
+
+        for (iter = queueRef.begin(); iter != queueRef.end(); ++iter)
+        {
+            int &marked = marked_per_bank[iter->dram_addr.rank][iter->dram_addr.bank];
+            if (!iter->request_served && marked < BATCH_CAP)
+            {
+                iter->marked = true;
+                marked++;
+            }
+        }
+        stats_batches_formed[channel]++;
+    }
+
+    if (issue_oldest(channel, queueRef, [](const request_t &request) { return request.marked && request.next_command == COL_READ_CMD; }))
+        return true;
+    if (issue_oldest(channel, queueRef, [](const request_t &request) { return request.marked; }))
+        return true;
+    return fr_fcfs(channel, queueRef);
+}
+
+// Row hits from priority ports (the stream scheduler's treelet loads) go first, everything else is FR-FCFS
+static bool stream_aware_fr_fcfs(int channel, std::list<request_t> &queueRef)
 {
-    schedule_count++;
+    if (issue_oldest(channel, queueRef, [](const request_t &request) { return request.priority && request.next_command == COL_READ_CMD; }))
+        return true;
+    return fr_fcfs(channel, queueRef);
+}
 
-#define Priority_factor  1
+static void batched_fr_fcfs_stats()
+{
+    long long int batches_formed = 0;
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+        batches_formed += stats_batches_formed[c];
+
+    printf("Batch Cap :                     %d\n",     BATCH_CAP);
+    printf("Batches Formed :                %lld\n",   batches_formed);
+}
+
+// Indexed by SCHEDULING_POLICY
+static const scheduling_policy_t scheduling_policies[] =
+{
+    {"FR-FCFS",              fr_fcfs,              nullptr},
+    {"Batched FR-FCFS",      batched_fr_fcfs,      batched_fr_fcfs_stats},
+    {"Stream Aware FR-FCFS", stream_aware_fr_fcfs, nullptr},
+};
 
-    // we need to initialize the scheduler's variable
-    //if (Debug == 1)
-    //      print_read_queue();
+const scheduling_policy_t* get_scheduling_policy(int index)
+{
+    const int num_policies = sizeof(scheduling_policies) / sizeof(scheduling_policies[0]);
+    if (index < 0 || index >= num_policies)
+    {
+        printf("PANIC: unknown SCHEDULING_POLICY %d, using %s\n", index, scheduling_policies[0].name);
+        index = 0;
+    }
+    return &scheduling_policies[index];
+}
 
+void schedule(int channel)
+{
     memset(BANK_CAN_BE_CLOSED[channel], 0, sizeof(int) * MAX_NUM_RANKS * MAX_NUM_BANKS);
 
     // if in write drain mode, keep draining writes until the
-    // write queue occupancy drops to LO_WM
-    if (drain_writes[channel] && (write_queue_length[channel] > LO_WM))
+    // write queue occupancy drops to WQ_LO_WM
+    const int was_draining = drain_writes[channel];
+    if (drain_writes[channel] && (write_queue_length[channel] > WQ_LO_WM))
     {
         drain_writes[channel] = 1; // Keep draining.
     }
@@ -86,9 +207,9 @@ void schedule(int channel)
     }
 
     // initiate write drain if either the write queue occupancy
-    // has reached the HI_WM , OR, if there are no pending read
+    // has reached WQ_HI_WM, OR, if there are no pending read
     // requests
-    if (write_queue_length[channel] > HI_WM)
+    if (write_queue_length[channel] > WQ_HI_WM)
     {
         drain_writes[channel] = 1;
     }
@@ -98,222 +219,59 @@ void schedule(int channel)
             drain_writes[channel] = 1;
     }
 
-    // If in write drain mode, look through all the write queue
-    // elements (already arranged in the order of arrival), and
-    // issue the command for the first request that is ready
-    if (/*SCHEDULING ==*/ 1)  // Apply FR_FCFS
-    {
-        //printf("FR-FCFS \n");
-        const int choose = 0;  // 1  => Meysam  0 => Ali
-        if (choose == 1)
-        {
-            if (drain_writes[channel])
-            {
-                /// printf("enter to write queue \n");
-                std::list<request_t> &queueRef      = write_queue_head[channel];
-                std::list<request_t>::iterator iter = queueRef.begin();
-                for (; iter != queueRef.end(); ++iter)
-                {
-                    const bool issuable = (iter->dram_addr.row == dram_state[channel][iter->dram_addr.rank][iter->dram_addr.bank].active_row);
-                    BANK_CAN_BE_CLOSED[channel][iter->dram_addr.rank][iter->dram_addr.bank] = (issuable ? 0 : 1);
-                }
-
-                // we check all requests to find which one has the issuable Col_Write_CMD for the current open row
-                //now if we could not find this command we need to do according to FCFS but we are awared of this fact
-                // that if there is any Col_Write_CMD for the current open row but it is not issuable we need to make
-                //all precharge commands hold to that unissuable command gets issuable.
-                for (iter = queueRef.begin(); iter != queueRef.end(); ++iter)
-                {
-                    if (iter->command_issuable)
-                    {
-                        if (iter->next_command == PRE_CMD)
-                        {
-                            if (BANK_CAN_BE_CLOSED[channel][iter->dram_addr.rank][iter->dram_addr.bank])
-                            {
-                                issue_request_command(&(*iter));
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            issue_request_command(&(*iter));
-                            break;
-                        }
-                    }
-                }
-            }
-        } // end choose == 1
-
-        else
-        {
-            if (drain_writes[channel])
-            {
-                std::list<request_t> &queueRef      = write_queue_head[channel];
-                std::list<request_t>::iterator iter = queueRef.begin();
-                for (; iter != queueRef.end(); ++iter)
-                {
-                    if (iter->command_issuable)
-                    {
-                        if (iter->next_command == PRE_CMD)
-                        {
-                            bool row_is_still_needed             = false;
-                            std::list<request_t>::iterator iter2 = queueRef.begin();
-                            for (; iter2 != queueRef.end(); ++iter2)
-                            {
-                                if ((iter2->dram_addr.row == dram_state[channel][iter->dram_addr.rank][iter->dram_addr.bank].active_row) &&
-                                    (iter2->next_command == COL_WRITE_CMD))
-                                {
-                                    row_is_still_needed = true;
-                                }
-                            }
-                            if (!row_is_still_needed)
-                            {
-                                issue_request_command(&(*iter));
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            issue_request_command(&(*iter));
-                            break;
-                        }
-                    }
-                } // end iter for
-            }
+    if (drain_writes[channel] && !was_draining && write_queue_length[channel])
+        stats_write_drains[channel]++;
 
-            // Draining Reads
-            // look through the queue and find the first request whose
-            // command can be issued in this cycle and issue it
-            // Simple FCFS
-
-            // ali
-            if (!drain_writes[channel])
-            {
-                std::list<request_t> &queueRef      = read_queue_head[channel];
-                std::list<request_t>::iterator iter = queueRef.begin();
-                for (; iter != queueRef.end(); ++iter)
-                {
-                    if (iter->command_issuable)
-                    {
-                        // TODO: take this out
-                        //issue_request_command(rd_ptr);
-                        //break;
-
-                        //if(rd_ptr->
-                        //if(really old)
-                        //issue and break;
-
-                        if (iter->next_command == PRE_CMD)
-                        {
-                            bool row_is_still_needed             = false;
-                            std::list<request_t>::iterator iter2 = queueRef.begin();
-                            for (; iter2 != queueRef.end(); ++iter2)
-                            {
-                                if ((iter2->dram_addr.row == dram_state[channel][iter->dram_addr.rank][iter->dram_addr.bank].active_row) &&
-                                    (iter2->next_command == COL_READ_CMD))
-                                {
-                                    row_is_still_needed = true;
-                                }
-                            }
-                            if (!row_is_still_needed)
-                            {
-                                issue_request_command(&(*iter));
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            issue_request_command(&(*iter));
-                            break;
-                        }
-                    }
-                } // end iter for
-            }
-        } //else choose
-        // end ali
+    // Writes are always FR-FCFS, the policies only differ in how reads are picked
+    if (drain_writes[channel])
+    {
+        fr_fcfs(channel, write_queue_head[channel]);
+        return;
+    }
 
-        if (choose == 1)
-        {
-            if (!drain_writes[channel])
-            {
-                std::list<request_t> &queueRef      = read_queue_head[channel];
-                std::list<request_t>::iterator iter = queueRef.begin();
-                for (; iter != queueRef.end(); ++iter)
-                {
-                    const bool issuable = (iter->dram_addr.row == dram_state[channel][iter->dram_addr.rank][iter->dram_addr.bank].active_row);
-                    BANK_CAN_BE_CLOSED[channel][iter->dram_addr.rank][iter->dram_addr.bank] = (issuable ? 0 : 1);
-                }
-
-                // we check all requests to find which one has the issuable Col_read_CMD for the current open row 
-                //now if we could not find this command we need to do according to FCFS but we are awared of this fact
-                // that if there is any Col_Read_CMD for the current open row but it is not issuable we need to make 
-                //all precharge commands hold to that unissuable command gets issuable.
-                for (iter = queueRef.begin(); iter != queueRef.end(); ++iter)
-                {
-                    if (iter->command_issuable)
-                    {
-                        // to add fairness to FR-FCFS and prevent from starvation 
-                        // hereby we check the latency of rquest resident in read queue 
-                        // to find any request which is waited for more than Priority_factor
-                        // times average latency of read queue.
-                        if (iter->next_command == PRE_CMD)
-                        {
-                            if (BANK_CAN_BE_CLOSED[channel][iter->dram_addr.rank][iter->dram_addr.bank])
-                            {
-                                issue_request_command(&(*iter));
-                                break;
-                            }
-                        }
-                        else
-                        {
-                            issue_request_command(&(*iter));
-                            break;
-                        }
-                    }
-                }
-            }
-        } // end choose == 1
-    } // FR_FCFS
+    policy->schedule_reads(channel, read_queue_head[channel]);
+}
 
-#if 0
-    else if (SCHEDULING == 0) //Apply FCFS
+void scheduler_stats()
+{
+    long long int write_drains      = 0;
+    long long int read_cmds         = 0;
+    long long int read_activates    = 0;
+    long long int reads             = 0;
+    long long int priority_reads    = 0;
+    double        read_latency      = 0;
+    double        priority_latency  = 0;
+
+    for (int c = 0; c < NUM_CHANNELS; ++c)
     {
-        //printf("FCFS \n");
-        if(drain_writes[channel])
-        {
-            LL_FOREACH(write_queue_head[channel], wr_ptr)
-            {
-                if(wr_ptr->command_issuable)
-                {
-                    issue_request_command(wr_ptr);
-                    break;
-                }
-            }
+        write_drains     += stats_write_drains[c];
+        reads            += stats_reads_completed[c];
+        priority_reads   += stats_priority_reads_completed[c];
+        read_latency     += stats_average_read_latency[c] * stats_reads_completed[c];
+        priority_latency += stats_average_priority_read_latency[c] * stats_priority_reads_completed[c];
 
-            return;
-        }
-
-        // Draining Reads
-        // look through the queue and find the first request whose
-        // command can be issued in this cycle and issue it
-        // Simple FCFS
-        if(!drain_writes[channel])
+        for (int r = 0; r < NUM_RANKS; ++r)
         {
-            LL_FOREACH(read_queue_head[channel],rd_ptr)
+            for (int b = 0; b < NUM_BANKS; ++b)
             {
-                if(rd_ptr->command_issuable)
-                {
-                    issue_request_command(rd_ptr);
-                    break;
-                }
+                read_cmds      += stats_num_read[c][r][b];
+                read_activates += stats_num_activate_read[c][r][b] + stats_num_activate_spec[c][r][b];
             }
-            return;
         }
     }
-#endif
-}
 
-void scheduler_stats()
-{
-    // Nothing to print for now.
+    long long int other_reads = reads - priority_reads;
+
+    printf("-------- Scheduler Stats -----------\n");
+    printf("Scheduling Policy :             %s\n",     policy->name);
+    printf("Write Queue Watermarks :        %d/%d\n",  WQ_HI_WM, WQ_LO_WM);
+    printf("Write Drains :                  %lld\n",   write_drains);
+    if (policy->print_stats)
+        policy->print_stats();
+    printf("Read Row Hit Rate :             %7.5f\n",  read_cmds ? (double)(read_cmds - read_activates) / read_cmds : 0.0);
+    printf("Average Read Latency :          %7.5f\n",  reads ? read_latency / reads : 0.0);
+    printf("Priority Reads Serviced :       %lld\n",   priority_reads);
+    printf("Average Priority Read Latency : %7.5f\n",  priority_reads ? priority_latency / priority_reads : 0.0);
+    printf("Average Other Read Latency :    %7.5f\n",  other_reads ? (read_latency - priority_latency) / other_reads : 0.0);
+    printf("------------------------------------\n");
 }
@@ -2,10 +2,21 @@
 #define __SCHEDULER_H__
 
 #include "stdafx.hpp"
+#include "memory_controller.h"
+
+// A read scheduling policy, picked by SCHEDULING_POLICY. Writes are always FR-FCFS. To add a policy write its functions
+// in scheduler.cc and append it to scheduling_policies, the controller doesn't need to change.
+struct scheduling_policy_t
+{
+    const char* name;
+    bool (*schedule_reads)(int channel, std::list<request_t> &queueRef); // issue at most one command, returns true if one was issued
+    void (*print_stats)();                                                // policy specific stats, may be null
+};
 
 void init_scheduler_vars(); // called from main
 void scheduler_stats();     // called from main
 void schedule(int);         // scheduler function called every cycle
+const scheduling_policy_t* get_scheduling_policy(int index); // falls back to FR-FCFS for an unknown index
 
 extern Arches::cycles_t CYCLE_VAL;
 extern long long int schedule_count;
@@ -119,6 +119,13 @@ int WQ_LOOKUP_LATENCY;                  // WQ associative lookup
 // 2 is consecutive cache-lines striped across different banks 
 int ADDRESS_MAPPING;                    // Address mapping mode (1)
 
+// Optional in the config file so they need defaults
+int ADDRESS_HASH      = 0;              // Channel/bank hashing (0 bit slice, 1 XOR fold, 2 permutation)
+int SCHEDULING_POLICY = 0;              // Command scheduling policy (0 FR-FCFS, 1 batched, 2 stream aware)
+int WQ_HI_WM          = 40;             // Write drain high water mark
+int WQ_LO_WM          = 20;             // Write drain low water mark
+int BATCH_CAP         = 5;              // Reads per bank marked in one batch
+
 //--------------------------end params.h globals
 
 
@@ -414,6 +421,7 @@ int usimm_setup(char* config_filename,
         ROB[i].optype      = (int*)malloc(sizeof(int)*ROBSIZE);
     }
     init_memory_controller_vars();
+    init_address_mapping();
     init_scheduler_vars();
 
     // stats
@@ -706,6 +714,30 @@ float getUsimmPower()
     return total_system_power;
 }
 
+// Energy of everything the memory system did so far in nJ (mW * us)
+double getUsimmEnergy()
+{
+    return (double)getUsimmPower() * CYCLE_VAL / DRAM_CLK_FREQUENCY;
+}
+
+// Energy in nJ of the activates, reads and writes issued for a requester. Uses the same per command currents as
+// calculate_power. Background, refresh and termination power aren't caused by any one requester so they are left out.
+double getUsimmRequesterEnergy(int requester)
+{
+    const double act_energy   = (IDD0 - (IDD3N * T_RAS + IDD2N * (T_RC - T_RAS)) / T_RC) * VDD * T_RC;
+    const double read_energy  = ((IDD4R - IDD3N) * VDD + 3.2 * 10) * T_DATA_TRANS;
+    const double write_energy = (IDD4W - IDD3N) * VDD * T_DATA_TRANS;
+
+    double energy = 0;
+    for (int c = 0; c < NUM_CHANNELS; ++c)
+    {
+        energy += stats_requester_activates[c][requester] * act_energy;
+        energy += stats_requester_reads[c][requester]     * read_energy;
+        energy += stats_requester_writes[c][requester]    * write_energy;
+    }
+    return energy * chips_per_rank / DRAM_CLK_FREQUENCY;
+}
+
 
 void printUsimmStats(uint32_t const L2_line_size,
                      uint32_t const word_size,
@@ -834,6 +866,29 @@ void printUsimmStats(uint32_t const L2_line_size,
 }
 
 
+// Clocks a single channel for the current DRAM cycle. Channels share no state
+// so this can be called for different channels concurrently, but all channels
+// must be clocked before usimmAdvanceClock() is called.
+void usimmClockChannel(int channel)
+{
+    // Execute function to find ready instructions.
+    update_memory_channel(channel);
+
+    // Execute user-provided function to select ready instructions for issue.
+    // Based on this selection, update DRAM data structures and set instruction completion times.
+    schedule(channel);
+    gather_stats(channel);
+}
+
+
+void usimmAdvanceClock()
+{
+    update_mem_count++;
+    schedule_count += NUM_CHANNELS;
+    CYCLE_VAL++;
+}
+
+
 // Call this function once per TRaX global cycle
 void usimmClock()
 {
@@ -871,17 +926,10 @@ void usimmClock()
     }       // End of for loop that is retiring instructions for all cores.
 #endif
 
-    // Execute function to find ready instructions.
-    update_memory();
-
-    // Execute user-provided function to select ready instructions for issue.
-    // Based on this selection, update DRAM data structures and set instruction completion times.
     for (int c = 0; c < NUM_CHANNELS; ++c)
-    {
-        schedule(c);
-        gather_stats(c);
-    }
-    CYCLE_VAL++;
+        usimmClockChannel(c);
+
+    usimmAdvanceClock();
 }
 
 
@@ -13,7 +13,11 @@
 
 int usimm_setup(char* config_filename, char* usimm_vi_file);
 float getUsimmPower();
+double getUsimmEnergy();
+double getUsimmRequesterEnergy(int requester);
 void usimmClock();
+void usimmClockChannel(int channel);
+void usimmAdvanceClock();
 bool usimmIsBusy();
 void usimmDestroy();
 
@@ -0,0 +1,52 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "simulator/transactions.hpp"
+
+namespace Arches { namespace Util {
+
+//Bump allocator for state that lives as long as the simulation. Allocations are carved out of large aligned blocks so
+//they pack densely and are only freed when the arena is destroyed.
+class Arena
+{
+private:
+	size_t _block_size;
+	size_t _offset;
+	std::vector<std::unique_ptr<uint8_t[]>> _blocks;
+	uint8_t* _block{nullptr};
+
+public:
+	Arena(size_t block_size = 16ull * 1024 * 1024) : _block_size(block_size), _offset(block_size) {}
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	//zero filled
+	uint8_t* allocate(size_t size, size_t alignment = CACHE_BLOCK_SIZE)
+	{
+		assert((alignment & (alignment - 1)) == 0 && alignment <= 4096);
+
+		_offset = (_offset + alignment - 1) & ~(alignment - 1);
+		if(_offset + size > _block_size)
+		{
+			//oversized requests get their own block
+			size_t block_size = std::max(size, _block_size);
+			_blocks.emplace_back(new uint8_t[block_size + 4096]());
+
+			uintptr_t base = reinterpret_cast<uintptr_t>(_blocks.back().get());
+			_block = reinterpret_cast<uint8_t*>((base + 4095) & ~(uintptr_t)4095);
+			_offset = 0;
+			if(block_size > _block_size)
+			{
+				_offset = _block_size;
+				return _block;
+			}
+		}
+
+		uint8_t* ptr = _block + _offset;
+		_offset += size;
+		return ptr;
+	}
+};
+
+}}
@@ -80,3 +80,12 @@ inline uint64_t pext(uint64_t data, uint64_t mask)
 	return _pext_u64(data, mask);
 }
 
+//bit i of the result is the parity of the data bits selected by masks[i]
+inline uint64_t xor_hash(uint64_t data, const std::vector<uint64_t>& masks)
+{
+	uint64_t result = 0;
+	for(uint i = 0; i < masks.size(); ++i)
+		result |= (popcnt(data & masks[i]) & 0x1) << i;
+	return result;
+}
+
@@ -0,0 +1,257 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "util/bit-manipulation.hpp"
+
+namespace Arches { namespace Util {
+
+#define TAGE_NUM_TABLES 4
+#define TAGE_TAG_BITS 8
+#define BTB_ASSOCIATIVITY 4
+
+//Direction predictor for the TP front end. The global history is kept per thread by the caller and passed in so all threads
+//of a TP can share one set of tables.
+class BranchPredictor
+{
+public:
+	enum class Type : uint8_t
+	{
+		STATIC, //not taken
+		BIMODAL,
+		GSHARE,
+		TAGE,
+	};
+
+private:
+	//TAGE tagged components, history lengths roughly geometric up to the 64 bits of history we keep
+	static constexpr uint _tage_history_lengths[TAGE_NUM_TABLES] = {5, 12, 27, 60};
+
+	struct TaggedEntry
+	{
+		uint8_t tag{0};
+		uint8_t ctr{4}; //3 bit, taken if >= 4
+		uint8_t useful{0};
+	};
+
+	Type _type;
+	uint _size_log2;
+	std::vector<uint8_t> _counters; //2 bit, taken if >= 2. Bimodal/gshare table or the TAGE base predictor
+	std::vector<TaggedEntry> _tagged[TAGE_NUM_TABLES];
+	uint _tagged_size_log2{0};
+	uint64_t _updates{0};
+
+	static uint64_t _fold(uint64_t history, uint length, uint bits)
+	{
+		history &= generate_nbit_mask(length);
+		uint64_t folded = 0;
+		for(uint i = 0; i < length; i += bits)
+			folded ^= history >> i;
+		return folded & generate_nbit_mask(bits);
+	}
+
+	uint64_t _index(vaddr_t pc, uint64_t history) const
+	{
+		uint64_t index = pc >> 1;
+		if(_type == Type::GSHARE) index ^= history;
+		return index & generate_nbit_mask(_size_log2);
+	}
+
+	uint64_t _tagged_index(uint table, vaddr_t pc, uint64_t history) const
+	{
+		return ((pc >> 1) ^ (pc >> (_tagged_size_log2 + 1)) ^ _fold(history, _tage_history_lengths[table], _tagged_size_log2)) & generate_nbit_mask(_tagged_size_log2);
+	}
+
+	uint8_t _tag(uint table, vaddr_t pc, uint64_t history) const
+	{
+		return (uint8_t)(((pc >> 1) ^ _fold(history, _tage_history_lengths[table], TAGE_TAG_BITS) ^ (_fold(history, _tage_history_lengths[table], TAGE_TAG_BITS - 1) << 1)) & generate_nbit_mask(TAGE_TAG_BITS));
+	}
+
+	//finds the longest (provider) and second longest (alternate) matching tagged tables. -1 if there is none
+	void _tage_lookup(vaddr_t pc, uint64_t history, int& provider, int& alternate) const
+	{
+		provider = alternate = -1;
+		for(int table = TAGE_NUM_TABLES - 1; table >= 0; --table)
+		{
+			if(_tagged[table][_tagged_index(table, pc, history)].tag != _tag(table, pc, history)) continue;
+			if(provider < 0) provider = table;
+			else
+			{
+				alternate = table;
+				break;
+			}
+		}
+	}
+
+	bool _tage_component_prediction(int table, vaddr_t pc, uint64_t history) const
+	{
+		if(table < 0) return _counters[(pc >> 1) & generate_nbit_mask(_size_log2)] >= 2;
+		return _tagged[table][_tagged_index(table, pc, history)].ctr >= 4;
+	}
+
+public:
+	BranchPredictor(Type type = Type::STATIC, uint size_log2 = 10) : _type(type), _size_log2(size_log2)
+	{
+		if(_type == Type::STATIC) return;
+
+		_counters.resize(1ull << _size_log2, 1);
+		if(_type == Type::TAGE)
+		{
+			//the tagged tables together are the same size as the base table
+			assert(_size_log2 >= 4);
+			_tagged_size_log2 = _size_log2 - 2;
+			for(uint i = 0; i < TAGE_NUM_TABLES; ++i)
+				_tagged[i].resize(1ull << _tagged_size_log2);
+		}
+	}
+
+	bool predict(vaddr_t pc, uint64_t history) const
+	{
+		switch(_type)
+		{
+		case Type::BIMODAL:
+		case Type::GSHARE:
+			return _counters[_index(pc, history)] >= 2;
+
+		case Type::TAGE:
+		{
+			int provider, alternate;
+			_tage_lookup(pc, history, provider, alternate);
+			return _tage_component_prediction(provider, pc, history);
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	void update(vaddr_t pc, uint64_t history, bool taken)
+	{
+		if(_type == Type::STATIC) return;
+
+		if(_type != Type::TAGE)
+		{
+			uint8_t& ctr = _counters[_index(pc, history)];
+			if(taken) ctr = std::min(ctr + 1, 3);
+			else      ctr = std::max(ctr - 1, 0);
+			return;
+		}
+
+		int provider, alternate;
+		_tage_lookup(pc, history, provider, alternate);
+		bool prediction = _tage_component_prediction(provider, pc, history);
+
+		if(provider >= 0)
+		{
+			TaggedEntry& entry = _tagged[provider][_tagged_index(provider, pc, history)];
+			bool alternate_prediction = _tage_component_prediction(alternate, pc, history);
+			if(alternate_prediction != prediction)
+			{
+				if(prediction == taken) entry.useful = std::min(entry.useful + 1, 3);
+				else                    entry.useful = std::max(entry.useful - 1, 0);
+			}
+
+			if(taken) entry.ctr = std::min(entry.ctr + 1, 7);
+			else      entry.ctr = std::max(entry.ctr - 1, 0);
+		}
+		else
+		{
+			uint8_t& ctr = _counters[(pc >> 1) & generate_nbit_mask(_size_log2)];
+			if(taken) ctr = std::min(ctr + 1, 3);
+			else      ctr = std::max(ctr - 1, 0);
+		}
+
+		//on a mispredict allocate an entry in a longer history table
+		if(prediction != taken)
+		{
+			bool allocated = false;
+			for(uint table = provider + 1; table < TAGE_NUM_TABLES; ++table)
+			{
+				TaggedEntry& entry = _tagged[table][_tagged_index(table, pc, history)];
+				if(entry.useful != 0) continue;
+
+				entry.tag = _tag(table, pc, history);
+				entry.ctr = taken ? 4 : 3;
+				allocated = true;
+				break;
+			}
+
+			if(!allocated)
+				for(uint table = provider + 1; table < TAGE_NUM_TABLES; ++table)
+				{
+					TaggedEntry& entry = _tagged[table][_tagged_index(table, pc, history)];
+					if(entry.useful) entry.useful--;
+				}
+		}
+
+		//age useful bits so stale entries can be replaced
+		if((++_updates & 0x3ffffull) == 0)
+			for(uint table = 0; table < TAGE_NUM_TABLES; ++table)
+				for(TaggedEntry& entry : _tagged[table])
+					entry.useful >>= 1;
+	}
+};
+
+//Set associative branch target buffer. Holds the target of taken branches and jumps.
+class BranchTargetBuffer
+{
+private:
+	struct Entry
+	{
+		vaddr_t pc{0};
+		vaddr_t target{0};
+		uint8_t lru{0};
+	};
+
+	std::vector<Entry> _entries;
+	uint _set_mask{0};
+
+public:
+	BranchTargetBuffer(uint size = 0)
+	{
+		if(size == 0) return;
+
+		assert(size % BTB_ASSOCIATIVITY == 0);
+		uint num_sets = size / BTB_ASSOCIATIVITY;
+		assert((num_sets & (num_sets - 1)) == 0);
+		_set_mask = num_sets - 1;
+		_entries.resize(size);
+		for(uint i = 0; i < size; ++i)
+			_entries[i].lru = i % BTB_ASSOCIATIVITY;
+	}
+
+	bool enabled() const { return !_entries.empty(); }
+
+	bool lookup(vaddr_t pc, vaddr_t& target)
+	{
+		Entry* set = &_entries[((pc >> 1) & _set_mask) * BTB_ASSOCIATIVITY];
+		for(uint i = 0; i < BTB_ASSOCIATIVITY; ++i)
+		{
+			if(set[i].pc != pc) continue;
+			target = set[i].target;
+			return true;
+		}
+		return false;
+	}
+
+	void update(vaddr_t pc, vaddr_t target)
+	{
+		Entry* set = &_entries[((pc >> 1) & _set_mask) * BTB_ASSOCIATIVITY];
+
+		uint way = 0;
+		for(; way < BTB_ASSOCIATIVITY; ++way)
+			if(set[way].pc == pc) break;
+
+		if(way == BTB_ASSOCIATIVITY)
+			for(way = 0; way < BTB_ASSOCIATIVITY; ++way)
+				if(set[way].lru == BTB_ASSOCIATIVITY - 1) break;
+
+		for(uint i = 0; i < BTB_ASSOCIATIVITY; ++i)
+			if(set[i].lru < set[way].lru) set[i].lru++;
+
+		set[way].pc = pc;
+		set[way].target = target;
+		set[way].lru = 0;
+	}
+};
+
+}}
@@ -0,0 +1,176 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches { namespace Util {
+
+//Request stream seen by main memory. Used to rerun the dram model on a captured workload without the rest of the sim.
+struct DRAMTraceRecord
+{
+	cycles_t cycle;
+	paddr_t  paddr;
+	uint16_t port;
+	uint8_t  size;
+	uint8_t  requester;
+	bool     store;
+};
+
+//Records are delta and varint coded. Cycles and addresses are stored as the (zigzag) difference from the previous record
+//and size, port and requester are only stored when they change, so most records take 3-5 bytes instead of 24.
+//
+//Record layout:
+//  u8     header: bit 0 store, bit 1 new size, bit 2 new port, bit 3 new requester
+//  varint cycle delta
+//  varint zigzag paddr delta
+//  u8     size (if bit 1)
+//  varint port (if bit 2)
+//  u8     requester (if bit 3)
+#define DRAM_TRACE_MAGIC 0x54524441 //"ADRT"
+#define DRAM_TRACE_VERSION 2
+
+class DRAMTraceWriter
+{
+private:
+	FILE* _file;
+	std::vector<uint8_t> _buffer;
+	DRAMTraceRecord _last{};
+	uint64_t _num_records{0};
+
+	void _put_varint(uint64_t value)
+	{
+		while(value >= 0x80)
+		{
+			_buffer.push_back((uint8_t)value | 0x80);
+			value >>= 7;
+		}
+		_buffer.push_back((uint8_t)value);
+	}
+
+	void _flush()
+	{
+		if(!_buffer.empty()) fwrite(_buffer.data(), 1, _buffer.size(), _file);
+		_buffer.clear();
+	}
+
+public:
+	DRAMTraceWriter(const std::string& path)
+	{
+		_file = fopen(path.c_str(), "wb");
+		if(!_file) throw "failed to open dram trace " + path;
+
+		uint32_t header[2] = {DRAM_TRACE_MAGIC, DRAM_TRACE_VERSION};
+		fwrite(header, sizeof(header), 1, _file);
+
+		_buffer.reserve(64 * 1024);
+	}
+
+	~DRAMTraceWriter()
+	{
+		_flush();
+		fclose(_file);
+	}
+
+	uint64_t num_records() const { return _num_records; }
+
+	void write(const DRAMTraceRecord& record)
+	{
+		assert(record.cycle >= _last.cycle);
+
+		uint8_t header = record.store;
+		if(record.size != _last.size) header |= 0x2;
+		if(record.port != _last.port) header |= 0x4;
+		if(record.requester != _last.requester) header |= 0x8;
+		_buffer.push_back(header);
+
+		int64_t paddr_delta = (int64_t)(record.paddr - _last.paddr);
+		_put_varint(record.cycle - _last.cycle);
+		_put_varint(((uint64_t)paddr_delta << 1) ^ (uint64_t)(paddr_delta >> 63));
+		if(header & 0x2) _buffer.push_back(record.size);
+		if(header & 0x4) _put_varint(record.port);
+		if(header & 0x8) _buffer.push_back(record.requester);
+
+		_last = record;
+		_num_records++;
+
+		if(_buffer.size() >= 60 * 1024) _flush();
+	}
+};
+
+class DRAMTraceReader
+{
+private:
+	FILE* _file;
+	std::vector<uint8_t> _buffer;
+	size_t _offset{0};
+	DRAMTraceRecord _last{};
+
+	//keeps at least one max size record (1 + 10 + 10 + 1 + 3 + 1 bytes) in the buffer unless the file is done
+	void _fill()
+	{
+		if(_buffer.size() - _offset >= 32) return;
+
+		_buffer.erase(_buffer.begin(), _buffer.begin() + _offset);
+		_offset = 0;
+
+		size_t size = _buffer.size();
+		_buffer.resize(64 * 1024);
+		_buffer.resize(size + fread(_buffer.data() + size, 1, _buffer.size() - size, _file));
+	}
+
+	//_fill keeps a whole record buffered so running out here means the trace was cut off mid record
+	uint8_t _get_byte()
+	{
+		if(_offset >= _buffer.size()) throw std::string("dram trace is truncated");
+		return _buffer[_offset++];
+	}
+
+	uint64_t _get_varint()
+	{
+		uint64_t value = 0;
+		for(uint shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = _get_byte();
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if(!(byte & 0x80)) return value;
+		}
+		throw std::string("dram trace has a bad varint");
+	}
+
+public:
+	DRAMTraceReader(const std::string& path)
+	{
+		_file = fopen(path.c_str(), "rb");
+		if(!_file) throw "failed to open dram trace " + path;
+
+		uint32_t header[2];
+		if(fread(header, sizeof(header), 1, _file) != 1 || header[0] != DRAM_TRACE_MAGIC || header[1] != DRAM_TRACE_VERSION)
+			throw path + " is not a dram trace";
+	}
+
+	~DRAMTraceReader()
+	{
+		fclose(_file);
+	}
+
+	//returns false at the end of the trace. Throws if the trace is truncated or corrupt
+	bool read(DRAMTraceRecord& record)
+	{
+		_fill();
+		if(_offset == _buffer.size()) return false;
+
+		uint8_t header = _get_byte();
+		if(header & ~0xf) throw std::string("dram trace has a bad record header");
+		record.store = header & 0x1;
+		record.cycle = _last.cycle + _get_varint();
+
+		uint64_t zigzag = _get_varint();
+		record.paddr = _last.paddr + (paddr_t)((zigzag >> 1) ^ (~(zigzag & 0x1) + 1));
+		record.size = (header & 0x2) ? _get_byte() : _last.size;
+		record.port = (header & 0x4) ? (uint16_t)_get_varint() : _last.port;
+		record.requester = (header & 0x8) ? _get_byte() : _last.requester;
+
+		_last = record;
+		return true;
+	}
+};
+
+}}
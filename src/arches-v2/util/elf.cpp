@@ -189,18 +189,57 @@ ELF::SymbolTable::ArrayElement::ArrayElement(Util::File* file, ELF_Header const*
 	}
 	else {
 		assert(elf_header->e_ident.ei_class == ELF_Header::E_IDENT::EI_CLASS::ELFCLASS64);
+		//Note different order of fields.
 		st_name      = elf_header->fix_endianness(file->read_bin<uint32_t>());
-		st_value.u64 = elf_header->fix_endianness(file->read_bin<uint64_t>());
-		st_size.u64  = elf_header->fix_endianness(file->read_bin<uint64_t>());
 		st_info      = elf_header->fix_endianness(file->read_bin<uint8_t>());
 		st_other     = elf_header->fix_endianness(file->read_bin<uint8_t>());
 		st_shndx     = elf_header->fix_endianness(file->read_bin<uint16_t>());
+		st_value.u64 = elf_header->fix_endianness(file->read_bin<uint64_t>());
+		st_size.u64  = elf_header->fix_endianness(file->read_bin<uint64_t>());
 	}
 }
 
-ELF::SymbolTable::SymbolTable(Util::File* file, const ELF_Header* elf_header, const SectionHeader::ArrayElement& section)
+ELF::SymbolTable::SymbolTable(Util::File* file, const ELF_Header* elf_header, const SectionHeader::ArrayElement& section, const SectionHeader::ArrayElement& string_section)
 {
+	bool is_32 = elf_header->e_ident.ei_class == ELF_Header::E_IDENT::EI_CLASS::ELFCLASS32;
+	uint64_t size    = is_32 ? section.sh_size.u32    : section.sh_size.u64;
+	uint64_t entsize = is_32 ? section.sh_entsize.u32 : section.sh_entsize.u64;
+	if(entsize == 0) return;
+
+	arr.resize(size / entsize);
+	fseek(file->backing, static_cast<long int>(is_32 ? section.sh_offset.u32 : section.sh_offset.u64), SEEK_SET);
+	for(size_t i = 0; i < arr.size(); ++i) {
+		arr[i] = ArrayElement(file, elf_header);
+	}
+
+	uint64_t strings_size = is_32 ? string_section.sh_size.u32 : string_section.sh_size.u64;
+	fseek(file->backing, static_cast<long int>(is_32 ? string_section.sh_offset.u32 : string_section.sh_offset.u64), SEEK_SET);
+	std::vector<uint8_t> strings = file->read_bin(static_cast<size_t>(strings_size));
+	strings.push_back('\0');
 
+	for(uint i = 0; i < arr.size(); ++i) {
+		ArrayElement& symbol = arr[i];
+		if(is_32) {
+			symbol.st_value.u64 = symbol.st_value.u32;
+			symbol.st_size.u64 = symbol.st_size.u32;
+		}
+
+		if(symbol.st_name < strings_size) symbol.name = reinterpret_cast<const char*>(strings.data() + symbol.st_name);
+		if(symbol.type() == ArrayElement::STT::STT_FUNC && symbol.st_shndx != 0) _functions.push_back(i);
+	}
+
+	std::sort(_functions.begin(), _functions.end(), [&](uint a, uint b) { return arr[a].st_value.u64 < arr[b].st_value.u64; });
+}
+
+const ELF::SymbolTable::ArrayElement* ELF::SymbolTable::find_function(vaddr_t addr) const
+{
+	auto it = std::upper_bound(_functions.begin(), _functions.end(), addr, [&](vaddr_t addr, uint i) { return addr < arr[i].st_value.u64; });
+	if(it == _functions.begin()) return nullptr;
+
+	const ArrayElement& symbol = arr[*(it - 1)];
+	//size 0 symbols (hand written assembly) extend to the next function
+	if(symbol.st_size.u64 != 0 && addr >= symbol.st_value.u64 + symbol.st_size.u64) return nullptr;
+	return &symbol;
 }
 
 ELF::ELF(std::string const& path) {
@@ -209,11 +248,19 @@ ELF::ELF(std::string const& path) {
 	elf_header     = nullptr;
 	program_header = nullptr;
 	section_header = nullptr;
+	symbol_table   = nullptr;
 	try {
 		elf_header     = _new ELF_Header   (&file           );
 		program_header = _new ProgramHeader(&file,elf_header);
 		section_header = _new SectionHeader(&file, elf_header);
 
+		for (SectionHeader::ArrayElement& section : section_header->arr) {
+			if (section.sh_type == SectionHeader::ArrayElement::SH_TYPE::SHT_SYMTAB && section.sh_link < section_header->arr.size()) {
+				symbol_table = _new SymbolTable(&file, elf_header, section, section_header->arr[section.sh_link]);
+				break;
+			}
+		}
+
 		for (ProgramHeader::ArrayElement& elem : program_header->arr) {
 			if (elem.p_type==ProgramHeader::ArrayElement::P_TYPE::PT_LOAD) {
 				LoadableSegment* seg = _new LoadableSegment(elf_header);
@@ -246,6 +293,7 @@ ELF::ELF(std::string const& path) {
 		delete program_header;
 		delete elf_header;
 		delete section_header;
+		delete symbol_table;
 		throw;
 	}
 }
@@ -256,6 +304,16 @@ ELF::~ELF() {
 	delete program_header;
 	delete elf_header;
 	delete section_header;
+	delete symbol_table;
+}
+
+const ELF::LoadableSegment* ELF::text_segment() const {
+	for (const ProgramHeader::ArrayElement& elem : program_header->arr) {
+		if (elem.segment && (static_cast<uint32_t>(elem.p_flags) & static_cast<uint32_t>(ProgramHeader::ArrayElement::P_FLAGS::PF_X))) {
+			return elem.segment;
+		}
+	}
+	return nullptr;
 }
 
 
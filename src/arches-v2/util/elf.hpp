@@ -393,6 +393,18 @@ class ELF final
 				union { uint32_t u32; uint64_t u64; } st_value;
 				union { uint32_t u32; uint64_t u64; } st_size;
 
+				//Resolved from the linked string table
+				std::string name;
+
+				enum class STT : uint8_t {
+					STT_NOTYPE  = 0x0,
+					STT_OBJECT  = 0x1,
+					STT_FUNC    = 0x2,
+					STT_SECTION = 0x3,
+					STT_FILE    = 0x4,
+				};
+				STT type() const { return static_cast<STT>(st_info & 0xf); }
+
 			public:
 				ArrayElement() = default;
 				ArrayElement(Util::File* file, ELF_Header const* elf_header);
@@ -401,9 +413,16 @@ class ELF final
 
 			std::vector<ArrayElement> arr;
 
+		private:
+			//Indices of function symbols sorted by address
+			std::vector<uint> _functions;
+
 		public:
-			SymbolTable(Util::File* file, const ELF_Header* elf_header, const SectionHeader::ArrayElement& section);
+			SymbolTable(Util::File* file, const ELF_Header* elf_header, const SectionHeader::ArrayElement& section, const SectionHeader::ArrayElement& string_section);
 			~SymbolTable() = default;
+
+			//Function containing addr or nullptr
+			const ArrayElement* find_function(vaddr_t addr) const;
 		};
 		SymbolTable* symbol_table;
 
@@ -427,6 +446,9 @@ class ELF final
 	public:
 		explicit ELF(std::string const& path);
 		~ELF();
+
+		//Executable segment or nullptr
+		const LoadableSegment* text_segment() const;
 };
 
 
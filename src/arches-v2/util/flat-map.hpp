@@ -0,0 +1,89 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "util/bit-manipulation.hpp"
+
+namespace Arches { namespace Util {
+
+//Open addressing hash map from 32 bit keys for a known maximum number of entries. Linear probing with backward shift
+//deletion so there are no tombstones and lookups stay short. ~0 is reserved as the empty key.
+template <typename V>
+class FlatMap
+{
+private:
+	static constexpr uint32_t EMPTY_KEY = ~0u;
+
+	struct Entry
+	{
+		uint32_t key{EMPTY_KEY};
+		V        value;
+	};
+
+	std::vector<Entry> _entries;
+	uint32_t _mask{0};
+	uint     _shift{0};
+	uint     _size{0};
+
+	//fibonacci hashing. Consecutive keys like node and triangle ids spread across the table
+	uint32_t _home(uint32_t key) const
+	{
+		return (key * 0x9e3779b1u) >> _shift;
+	}
+
+public:
+	//the table is kept at most half full
+	FlatMap(uint max_entries = 0)
+	{
+		uint capacity = 2;
+		while(capacity < max_entries * 2) capacity *= 2;
+		_entries.resize(capacity);
+		_mask = capacity - 1;
+		_shift = 32 - log2i(capacity);
+	}
+
+	uint size() const { return _size; }
+
+	//nullptr if the key isn't present
+	V* find(uint32_t key)
+	{
+		for(uint32_t i = _home(key);; i = (i + 1) & _mask)
+		{
+			if(_entries[i].key == key) return &_entries[i].value;
+			if(_entries[i].key == EMPTY_KEY) return nullptr;
+		}
+	}
+
+	void insert(uint32_t key, const V& value)
+	{
+		assert(key != EMPTY_KEY && _size + 1 < _entries.size());
+		uint32_t i = _home(key);
+		while(_entries[i].key != EMPTY_KEY && _entries[i].key != key) i = (i + 1) & _mask;
+		if(_entries[i].key == EMPTY_KEY) _size++;
+		_entries[i] = {key, value};
+	}
+
+	void erase(uint32_t key)
+	{
+		uint32_t i = _home(key);
+		while(_entries[i].key != key)
+		{
+			if(_entries[i].key == EMPTY_KEY) return;
+			i = (i + 1) & _mask;
+		}
+
+		//shift later entries of the probe run back into the hole if it is between them and their home
+		for(uint32_t j = (i + 1) & _mask; _entries[j].key != EMPTY_KEY; j = (j + 1) & _mask)
+		{
+			uint32_t home = _home(_entries[j].key);
+			if(((j - home) & _mask) >= ((j - i) & _mask))
+			{
+				_entries[i] = _entries[j];
+				i = j;
+			}
+		}
+		_entries[i].key = EMPTY_KEY;
+		_size--;
+	}
+};
+
+}}
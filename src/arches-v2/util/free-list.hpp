@@ -0,0 +1,48 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "util/bit-manipulation.hpp"
+
+namespace Arches { namespace Util {
+
+//Fixed pool of ids with one bit per id. Allocation hands out the lowest free id.
+class BitmapFreeList
+{
+private:
+	std::vector<uint64_t> _free;
+	uint _num_free;
+
+public:
+	BitmapFreeList(uint size = 0) : _free((size + 63) / 64, 0x0ull), _num_free(size)
+	{
+		for(uint i = 0; i < size; ++i)
+			_free[i >> 6] |= 0x1ull << (i & 0x3f);
+	}
+
+	bool empty() const { return _num_free == 0; }
+	uint num_free() const { return _num_free; }
+
+	//~0 if there are no free ids
+	uint allocate()
+	{
+		for(uint i = 0; i < _free.size(); ++i)
+		{
+			if(!_free[i]) continue;
+
+			uint id = i * 64 + (uint)ctz(_free[i]);
+			_free[i] &= _free[i] - 1;
+			_num_free--;
+			return id;
+		}
+		return ~0u;
+	}
+
+	void free(uint id)
+	{
+		assert(!(_free[id >> 6] & (0x1ull << (id & 0x3f))));
+		_free[id >> 6] |= 0x1ull << (id & 0x3f);
+		_num_free++;
+	}
+};
+
+}}
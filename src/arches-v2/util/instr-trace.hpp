@@ -0,0 +1,325 @@
+#pragma once
+#include "stdafx.hpp"
+
+#include "simulator/transactions.hpp"
+#include "util/bit-manipulation.hpp"
+
+namespace Arches { namespace Util {
+
+//Dynamic instruction stream of every thread. Used to drive the TP timing model without executing the kernel.
+//
+//The instruction at each pc is read from the loaded program so a record only holds what execution produced: the next pc if
+//it isn't sequential and the memory request if the instruction made one. Runs of plain sequential instructions are run
+//length coded and addresses are delta and varint coded so most instructions take well under a byte.
+//
+//File layout:
+//  u32 magic, u32 version
+//  chunks: u32 stream id, u32 size, size bytes of records. A stream's chunks are in order but interleaved with other streams.
+//
+//Record layout:
+//  u8     header: bit 7 run of (bits 0-6) + 1 sequential instructions with no request. Otherwise
+//                 bit 0 jump, bit 1 request, bit 2 request data, bit 3 write mask, bit 4 flags
+//  varint zigzag next pc - pc (if jump)
+//  varint zigzag vaddr delta, u8 type, u8 size, u8 dst (if request)
+//  varint flags (if bit 4)
+//  varint write mask (if bit 3, otherwise the mask covers size bytes)
+//  size bytes of data (if bit 2)
+#define INSTR_TRACE_MAGIC 0x52544941 //"AITR"
+#define INSTR_TRACE_VERSION 1
+#define INSTR_TRACE_CHUNK_SIZE (16 * 1024)
+
+class InstrTraceWriter
+{
+private:
+	FILE* _file;
+	std::mutex _mutex;
+	uint64_t _num_chunks{0};
+
+public:
+	InstrTraceWriter(const std::string& path)
+	{
+		_file = fopen(path.c_str(), "wb");
+		if(!_file) throw "failed to open instruction trace " + path;
+
+		uint32_t header[2] = {INSTR_TRACE_MAGIC, INSTR_TRACE_VERSION};
+		fwrite(header, sizeof(header), 1, _file);
+	}
+
+	~InstrTraceWriter()
+	{
+		fclose(_file);
+	}
+
+	uint64_t num_chunks() const { return _num_chunks; }
+
+	//called by TPs in parallel
+	void write_chunk(uint32_t stream_id, const std::vector<uint8_t>& chunk)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		uint32_t header[2] = {stream_id, (uint32_t)chunk.size()};
+		fwrite(header, sizeof(header), 1, _file);
+		fwrite(chunk.data(), 1, chunk.size(), _file);
+		_num_chunks++;
+	}
+};
+
+class InstrTraceReader
+{
+private:
+	struct Chunk
+	{
+		int64_t  offset;
+		uint32_t size;
+	};
+
+	//long is 32 bits on windows so traces past 2GB need the 64 bit file offsets
+	static int64_t _tell(FILE* file)
+	{
+	#ifdef _WIN32
+		return _ftelli64(file);
+	#else
+		return ftello(file);
+	#endif
+	}
+
+	static int _seek(FILE* file, int64_t offset, int origin)
+	{
+	#ifdef _WIN32
+		return _fseeki64(file, offset, origin);
+	#else
+		return fseeko(file, offset, origin);
+	#endif
+	}
+
+	FILE* _file;
+	std::mutex _mutex;
+	std::map<uint32_t, std::vector<Chunk>> _streams;
+
+public:
+	InstrTraceReader(const std::string& path)
+	{
+		_file = fopen(path.c_str(), "rb");
+		if(!_file) throw "failed to open instruction trace " + path;
+
+		uint32_t header[2];
+		if(fread(header, sizeof(header), 1, _file) != 1 || header[0] != INSTR_TRACE_MAGIC || header[1] != INSTR_TRACE_VERSION)
+			throw path + " is not an instruction trace";
+
+		_seek(_file, 0, SEEK_END);
+		int64_t file_size = _tell(_file);
+		_seek(_file, sizeof(header), SEEK_SET);
+
+		//index the chunks so each stream can be read on its own
+		while(fread(header, sizeof(header), 1, _file) == 1)
+		{
+			int64_t offset = _tell(_file);
+			if(offset + header[1] > file_size) throw path + " is truncated";
+			_streams[header[0]].push_back({offset, header[1]});
+			_seek(_file, header[1], SEEK_CUR);
+		}
+	}
+
+	~InstrTraceReader()
+	{
+		fclose(_file);
+	}
+
+	//returns false past the last chunk of the stream. Called by TPs in parallel
+	bool read_chunk(uint32_t stream_id, uint chunk_index, std::vector<uint8_t>& chunk)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _streams.find(stream_id);
+		if(it == _streams.end() || chunk_index >= it->second.size()) return false;
+
+		const Chunk& info = it->second[chunk_index];
+		chunk.resize(info.size);
+		_seek(_file, info.offset, SEEK_SET);
+		return fread(chunk.data(), 1, info.size, _file) == info.size;
+	}
+};
+
+//Per thread record coder. Chunks are handed to the writer as they fill and when the thread halts.
+class InstrTraceEncoder
+{
+private:
+	InstrTraceWriter* _writer{nullptr};
+	uint32_t _stream_id{0};
+	std::vector<uint8_t> _buffer;
+	uint _run{0};
+	vaddr_t _last_vaddr{0};
+
+	void _put_varint(uint64_t value)
+	{
+		while(value >= 0x80)
+		{
+			_buffer.push_back((uint8_t)value | 0x80);
+			value >>= 7;
+		}
+		_buffer.push_back((uint8_t)value);
+	}
+
+	void _put_zigzag(int64_t value)
+	{
+		_put_varint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+	}
+
+	void _flush_run()
+	{
+		if(_run == 0) return;
+		_buffer.push_back(0x80 | (uint8_t)(_run - 1));
+		_run = 0;
+	}
+
+public:
+	InstrTraceEncoder() = default;
+	InstrTraceEncoder(InstrTraceWriter* writer, uint32_t stream_id) : _writer(writer), _stream_id(stream_id)
+	{
+		_buffer.reserve(INSTR_TRACE_CHUNK_SIZE + 128);
+	}
+
+	//req is null if the instruction didn't make a memory request
+	void write(vaddr_t pc, uint8_t instr_size, vaddr_t next_pc, const MemoryRequest* req)
+	{
+		bool jump = next_pc != pc + instr_size;
+		if(!jump && !req)
+		{
+			if(++_run == 128) _flush_run();
+			return;
+		}
+
+		_flush_run();
+
+		uint8_t header = 0;
+		if(jump) header |= 0x1;
+		if(req)
+		{
+			header |= 0x2;
+			if(req->type != MemoryRequest::Type::LOAD)
+			{
+				header |= 0x4;
+				if(req->write_mask != generate_nbit_mask(req->size)) header |= 0x8;
+			}
+			if(req->flags) header |= 0x10;
+		}
+		_buffer.push_back(header);
+
+		if(jump) _put_zigzag((int64_t)(next_pc - pc));
+		if(req)
+		{
+			_put_zigzag((int64_t)(req->vaddr - _last_vaddr));
+			_buffer.push_back((uint8_t)req->type);
+			_buffer.push_back(req->size);
+			_buffer.push_back((uint8_t)req->dst);
+			_last_vaddr = req->vaddr;
+
+			if(header & 0x10) _put_varint(req->flags);
+			if(header & 0x8) _put_varint(req->write_mask);
+			if(header & 0x4) _buffer.insert(_buffer.end(), req->data, req->data + req->size);
+		}
+
+		if(next_pc == 0x0ull) flush();
+		else if(_buffer.size() >= INSTR_TRACE_CHUNK_SIZE) flush();
+	}
+
+	void flush()
+	{
+		_flush_run();
+		if(_buffer.empty()) return;
+		_writer->write_chunk(_stream_id, _buffer);
+		_buffer.clear();
+	}
+};
+
+class InstrTraceDecoder
+{
+private:
+	InstrTraceReader* _reader{nullptr};
+	uint32_t _stream_id{0};
+	uint _chunk_index{0};
+	std::vector<uint8_t> _buffer;
+	size_t _offset{0};
+	uint _run{0};
+	vaddr_t _last_vaddr{0};
+
+	//records never span chunks so running out here means the chunk was cut off mid record
+	uint8_t _get_byte()
+	{
+		if(_offset >= _buffer.size()) throw std::string("instruction trace chunk is truncated");
+		return _buffer[_offset++];
+	}
+
+	uint64_t _get_varint()
+	{
+		uint64_t value = 0;
+		for(uint shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = _get_byte();
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if(!(byte & 0x80)) return value;
+		}
+		throw std::string("instruction trace has a bad varint");
+	}
+
+	int64_t _get_zigzag()
+	{
+		uint64_t zigzag = _get_varint();
+		return (int64_t)((zigzag >> 1) ^ (~(zigzag & 0x1) + 1));
+	}
+
+public:
+	InstrTraceDecoder() = default;
+	InstrTraceDecoder(InstrTraceReader* reader, uint32_t stream_id) : _reader(reader), _stream_id(stream_id) {}
+
+	//Replays the instruction at pc. has_request is set if it made a memory request. Returns false at the end of the stream and
+	//throws if the trace is corrupt
+	bool read(vaddr_t pc, uint8_t instr_size, vaddr_t& next_pc, bool& has_request, MemoryRequest& req)
+	{
+		next_pc = pc + instr_size;
+		has_request = false;
+		if(_run)
+		{
+			_run--;
+			return true;
+		}
+
+		if(_offset == _buffer.size())
+		{
+			_offset = 0;
+			if(!_reader->read_chunk(_stream_id, _chunk_index++, _buffer))
+			{
+				_buffer.clear();
+				return false;
+			}
+		}
+
+		uint8_t header = _get_byte();
+		if(header & 0x80)
+		{
+			_run = header & 0x7f;
+			return true;
+		}
+
+		if(header & 0x1) next_pc = pc + _get_zigzag();
+		if(header & 0x2)
+		{
+			has_request = true;
+			req.vaddr = _last_vaddr + _get_zigzag();
+			req.type = (MemoryRequest::Type)_get_byte();
+			req.size = _get_byte();
+			req.dst = _get_byte();
+			_last_vaddr = req.vaddr;
+
+			req.flags = (header & 0x10) ? (uint16_t)_get_varint() : 0;
+			req.write_mask = (header & 0x8) ? _get_varint() : generate_nbit_mask(req.size);
+			if(header & 0x4)
+			{
+				if(req.size > sizeof(req.data) || _buffer.size() - _offset < req.size) throw std::string("instruction trace chunk is truncated");
+				std::memcpy(req.data, _buffer.data() + _offset, req.size);
+				_offset += req.size;
+			}
+		}
+		return true;
+	}
+};
+
+}}
@@ -0,0 +1,46 @@
+#pragma once
+#include "stdafx.hpp"
+
+namespace Arches { namespace Util {
+
+//Fixed capacity FIFO. Storage is allocated once at construction.
+template <typename T>
+class RingBuffer
+{
+private:
+	std::vector<T> _data;
+	uint _head{0};
+	uint _size{0};
+
+public:
+	RingBuffer(uint capacity = 0) : _data(capacity) {}
+
+	bool empty() const { return _size == 0; }
+	bool full() const { return _size == _data.size(); }
+	uint size() const { return _size; }
+	uint capacity() const { return (uint)_data.size(); }
+
+	T& front()
+	{
+		assert(!empty());
+		return _data[_head];
+	}
+
+	void push(const T& entry)
+	{
+		assert(!full());
+		uint tail = _head + _size;
+		if(tail >= _data.size()) tail -= _data.size();
+		_data[tail] = entry;
+		_size++;
+	}
+
+	void pop()
+	{
+		assert(!empty());
+		if(++_head == _data.size()) _head = 0;
+		_size--;
+	}
+};
+
+}}
@@ -152,6 +152,62 @@ inline float _intersect(const rtm::AABB& aabb, const rtm::Ray& ray, const rtm::v
 #endif
 }
 
+inline float _intersect(const rtm::QuantizedAABB& qaabb, const rtm::QuantizationFrame& frame, const rtm::Ray& ray, const rtm::vec3& inv_d)
+{
+#ifdef BOX_PIPLINE
+	const float* frame_words = (const float*)&frame;
+	uint32_t box_word0 = qaabb.min[0] | qaabb.min[1] << 8 | qaabb.min[2] << 16 | qaabb.max[0] << 24;
+	uint32_t box_word1 = qaabb.max[1] | qaabb.max[2] << 8;
+
+	register float f0 asm("f0") = ray.o.x;
+	register float f1 asm("f1") = ray.o.y;
+	register float f2 asm("f2") = ray.o.z;
+	register float f3 asm("f3") = inv_d.x;
+	register float f4 asm("f4") = inv_d.y;
+	register float f5 asm("f5") = inv_d.z;
+
+	register float f6 asm("f6") = frame_words[0];
+	register float f7 asm("f7") = frame_words[1];
+	register float f8 asm("f8") = frame_words[2];
+	register float f9 asm("f9") = *(float*)&box_word0;
+	register float f10 asm("f10") = *(float*)&box_word1;
+
+	//qboxisect is custom0 imm slot 3
+	float t;
+	asm volatile
+		(
+			".insn u 0x0b, %0, 0x18"
+			:
+	"=f" (t)
+		:
+		"f" (f0),
+		"f" (f1),
+		"f" (f2),
+		"f" (f3),
+		"f" (f4),
+		"f" (f5),
+		"f" (f6),
+		"f" (f7),
+		"f" (f8),
+		"f" (f9),
+		"f" (f10)
+		);
+
+	return t;
+#else
+	return rtm::intersect(qaabb, frame, ray, inv_d);
+#endif
+}
+
+inline float _intersect(const Treelet::Node& node, uint child, const rtm::Ray& ray, const rtm::vec3& inv_d)
+{
+#if TREELET_QUANTIZED_NODES
+	return _intersect(node.child_qaabb[child], node.frame, ray, inv_d);
+#else
+	return _intersect(node.child_aabb[child], ray, inv_d);
+#endif
+}
+
 inline bool _intersect(const rtm::Triangle& tri, const rtm::Ray& ray, rtm::Hit& hit)
 {
 #ifdef TRI_PIPLINE
@@ -251,15 +307,14 @@ bool inline intersect_treelet(const Treelet& treelet, const rtm::Ray& ray, rtm::
 		{
 			const uint& child0_index = current_entry.data.child[0].index;
 			const uint& child1_index = current_entry.data.child[1].index;
-			const rtm::AABB& child0_aabb = treelet.nodes[current_entry.index].child_aabb[0];
-			const rtm::AABB& child1_aabb = treelet.nodes[current_entry.index].child_aabb[1];
+			const Treelet::Node& node = treelet.nodes[current_entry.index];
 			const Treelet::Node& child0 = treelet.nodes[child0_index];
 			const Treelet::Node& child1 = treelet.nodes[child1_index];
 			const bool& left_child_treelet = current_entry.data.child[0].is_treelet;
 			const bool& right_child_treelet = current_entry.data.child[1].is_treelet;
 			float hit_ts[2];
-			hit_ts[0] = _intersect(child0_aabb, ray, inv_d);
-			hit_ts[1] = _intersect(child1_aabb, ray, inv_d);
+			hit_ts[0] = _intersect(node, 0, ray, inv_d);
+			hit_ts[1] = _intersect(node, 1, ray, inv_d);
 			if (left_child_treelet || right_child_treelet)
 			{
 				if (hit_ts[0] < hit_ts[1])
@@ -4,6 +4,10 @@
 
 #define TREELET_SIZE (7 * 8 * 1024)
 
+//store child boxes as 8 bit offsets in the frame of their parent. Halves the node size from 64 to 32 bytes. Kernel and simulator
+//must agree
+#define TREELET_QUANTIZED_NODES 0
+
 struct alignas(8 * 1024) Treelet
 {
 	struct alignas(32) Header
@@ -35,7 +39,12 @@ struct alignas(8 * 1024) Treelet
 		};
 
 		//rtm::AABB aabb;
+#if TREELET_QUANTIZED_NODES
+		rtm::QuantizationFrame frame;
+		rtm::QuantizedAABB     child_qaabb[2];
+#else
 		rtm::AABB child_aabb[2];
+#endif
 		Data      data;
 	};
 
@@ -58,6 +67,12 @@ struct alignas(8 * 1024) Treelet
 	Treelet() {}
 };
 
+#if TREELET_QUANTIZED_NODES
+static_assert(sizeof(Treelet::Node) == 32, "quantized treelet nodes must be half a cache line");
+#else
+static_assert(sizeof(Treelet::Node) == 64, "treelet nodes must be one cache line");
+#endif
+
 #ifndef __riscv
 class TreeletBVH
 {
@@ -292,10 +307,17 @@ public:
 				else
 				{
 					assert(node.data.lst_chld_ofst == 1);
+#if TREELET_QUANTIZED_NODES
+					tnode.frame = rtm::QuantizationFrame::from_aabb(node.aabb);
+#endif
 					for (uint i = 0; i < 2; ++i)
 					{
 						uint child_node_id = node.data.fst_chld_ind + i;
+#if TREELET_QUANTIZED_NODES
+						tnode.child_qaabb[i] = tnode.frame.quantize(bvh.nodes[child_node_id].aabb);
+#else
 						tnode.child_aabb[i] = bvh.nodes[child_node_id].aabb;
+#endif
 
 						if (root_node_treelet.find(child_node_id) != root_node_treelet.end())
 						{
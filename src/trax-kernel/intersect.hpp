@@ -12,6 +12,9 @@ struct MeshPointers
 	rtm::Triangle*  tris;
 };
 
+//traceray flags, must match UnitRTCore. Any hit rays stop at the first hit and only return the hit id
+#define TRACERAY_ANY_HIT 0x1u
+
 template<uint32_t FLAGS>
 inline void _traceray(uint id, const rtm::Ray& ray, rtm::Hit& hit)
 {
@@ -37,6 +40,13 @@ inline void _traceray(uint id, const rtm::Ray& ray, rtm::Hit& hit)
 		: "f" (src0), "f" (src1), "f" (src2), "f" (src3), "f" (src4), "f" (src5), "f" (src6), "f" (src7), "I" (FLAGS) 
 	);
 
+	if(FLAGS & TRACERAY_ANY_HIT)
+	{
+		float _dst0 = dst0;
+		hit.id = *(uint*)&_dst0;
+		return;
+	}
+
 	float _dst3 = dst3;
 
 	hit.t = dst0;
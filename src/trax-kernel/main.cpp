@@ -66,7 +66,7 @@ inline static void kernel(const KernelArgs& args)
 						rtm::Hit shit;
 						shit.t = sray.t_max; shit.id = ~0u;
 					#ifdef USE_TRACERAY
-						_traceray<0x1u>(index, sray, shit);
+						_traceray<TRACERAY_ANY_HIT>(index, sray, shit);
 					#else
 						intersect(args.mesh, sray, shit, true);
 					#endif